@@ -0,0 +1,39 @@
+// Replaces the global allocator to count heap use for AllocTracker.  Only
+// binaries which depend on the alloc_hook library get it.  Each block starts
+// with its size so that freeing it can be counted too.
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "alloc_tracker.h"
+
+namespace {
+
+constexpr size_t kHeader = alignof(std::max_align_t);
+
+void* allocate(size_t size) {
+  char* block = static_cast<char*>(std::malloc(size + kHeader));
+  if (!block) throw std::bad_alloc();
+  *reinterpret_cast<size_t*>(block) = size;
+  z2music::AllocTracker::allocated(size);
+  return block + kHeader;
+}
+
+void deallocate(void* ptr) {
+  if (!ptr) return;
+  char* block = static_cast<char*>(ptr) - kHeader;
+  z2music::AllocTracker::freed(*reinterpret_cast<size_t*>(block));
+  std::free(block);
+}
+
+const bool installed = (z2music::AllocTracker::install(), true);
+
+}  // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { deallocate(ptr); }
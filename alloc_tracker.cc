@@ -0,0 +1,48 @@
+#include "alloc_tracker.h"
+
+#include <algorithm>
+
+namespace z2music {
+
+bool AllocTracker::installed_ = false;
+std::atomic<bool> AllocTracker::enabled_{false};
+std::atomic<int64_t> AllocTracker::allocs_{0};
+std::atomic<int64_t> AllocTracker::bytes_{0};
+std::atomic<int64_t> AllocTracker::live_{0};
+std::atomic<int64_t> AllocTracker::peak_{0};
+
+void AllocTracker::allocated(size_t size) {
+  const int64_t live = live_.fetch_add(size, std::memory_order_relaxed) + size;
+  if (!enabled()) return;
+  allocs_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(size, std::memory_order_relaxed);
+  raise_peak(live);
+}
+
+void AllocTracker::raise_peak(int64_t bytes) {
+  int64_t peak = peak_.load(std::memory_order_relaxed);
+  while (bytes > peak && !peak_.compare_exchange_weak(
+                             peak, bytes, std::memory_order_relaxed)) {
+  }
+}
+
+// The peak is restarted from what is live now, then put back to the larger
+// of the two when the scope ends, so that enclosing scopes still see it.
+AllocTracker::Scope::Scope()
+    : allocs_(AllocTracker::allocs()),
+      bytes_(AllocTracker::bytes_.load(std::memory_order_relaxed)),
+      live_(AllocTracker::live()),
+      outer_peak_(peak_.exchange(live_, std::memory_order_relaxed)) {}
+
+AllocTracker::Scope::~Scope() { raise_peak(outer_peak_); }
+
+AllocTracker::Stats AllocTracker::Scope::stats() const {
+  Stats stats;
+  stats.allocs = AllocTracker::allocs() - allocs_;
+  stats.bytes = AllocTracker::bytes_.load(std::memory_order_relaxed) - bytes_;
+  stats.peak =
+      std::max<int64_t>(0, peak_.load(std::memory_order_relaxed) - live_);
+  return stats;
+}
+
+}  // namespace z2music
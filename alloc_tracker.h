@@ -0,0 +1,70 @@
+#ifndef Z2MUSIC_ALLOC_TRACKER_H_
+#define Z2MUSIC_ALLOC_TRACKER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace z2music {
+
+// Heap use, as reported by the global operator new and delete in
+// alloc_hook.cc.  Binaries which don't link the alloc_hook library keep the
+// standard allocator, installed() is false and every count stays at zero.
+// Linked in, live bytes are always tracked so that frees balance, but counts
+// and peaks are only kept once enable() is called.
+class AllocTracker {
+ public:
+  struct Stats {
+    int64_t allocs = 0;
+    int64_t bytes = 0;
+    // Most bytes live at once, above what was live at the start
+    int64_t peak = 0;
+  };
+
+  // Heap use from construction on.  Scopes can be nested, but the peak is
+  // for the whole process, so a scope's peak includes other threads.
+  class Scope {
+   public:
+    Scope();
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    Stats stats() const;
+
+   private:
+    int64_t allocs_;
+    int64_t bytes_;
+    int64_t live_;
+    int64_t outer_peak_;
+  };
+
+  static void enable() { enabled_.store(true, std::memory_order_relaxed); }
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static bool installed() { return installed_; }
+
+  static int64_t live() { return live_.load(std::memory_order_relaxed); }
+  static int64_t allocs() { return allocs_.load(std::memory_order_relaxed); }
+
+  // Called by the hook
+  static void install() { installed_ = true; }
+  static void allocated(size_t size);
+  static void freed(size_t size) {
+    live_.fetch_sub(size, std::memory_order_relaxed);
+  }
+
+ private:
+  static bool installed_;
+  static std::atomic<bool> enabled_;
+  static std::atomic<int64_t> allocs_;
+  static std::atomic<int64_t> bytes_;
+  static std::atomic<int64_t> live_;
+  static std::atomic<int64_t> peak_;
+
+  static void raise_peak(int64_t bytes);
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_ALLOC_TRACKER_H_
@@ -0,0 +1,80 @@
+#include "alloc_tracker.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "metrics.h"
+#include "pattern.h"
+#include "rom.h"
+
+namespace z2music {
+namespace {
+
+std::vector<std::unique_ptr<char[]>> blocks;
+
+void allocate(size_t size) { blocks.emplace_back(new char[size]); }
+
+TEST(AllocTrackerTest, Installed) { EXPECT_TRUE(AllocTracker::installed()); }
+
+TEST(AllocTrackerTest, CountsScope) {
+  AllocTracker::enable();
+  blocks.reserve(8);
+
+  AllocTracker::Scope scope;
+  allocate(1000);
+  allocate(500);
+  blocks.pop_back();
+  allocate(200);
+
+  const AllocTracker::Stats stats = scope.stats();
+  EXPECT_EQ(stats.allocs, 3);
+  EXPECT_EQ(stats.bytes, 1700);
+  EXPECT_EQ(stats.peak, 1500);
+  blocks.clear();
+}
+
+TEST(AllocTrackerTest, NestedScopes) {
+  AllocTracker::enable();
+  blocks.reserve(8);
+
+  AllocTracker::Scope outer;
+  allocate(1000);
+  blocks.clear();
+  {
+    AllocTracker::Scope inner;
+    allocate(100);
+    EXPECT_EQ(inner.stats().peak, 100);
+    blocks.clear();
+  }
+
+  // The inner scope's peak was lower, so the outer one keeps its own
+  const AllocTracker::Stats stats = outer.stats();
+  EXPECT_EQ(stats.allocs, 2);
+  EXPECT_EQ(stats.peak, 1000);
+}
+
+TEST(AllocTrackerTest, MetricsStages) {
+  Metrics::reset();
+  Metrics::enable();
+  AllocTracker::enable();
+
+  FakeRom rom;
+  Song& song = rom.song(Rom::SongTitle::TownTheme);
+  song.add_pattern({0x18, Pattern::parse_notes("A4.4 C5 E5 A5"), {}, {}, {}});
+  song.set_sequence({0});
+  rom.commit();
+
+  // Encoding the pattern has to allocate its note data
+  const std::string json = Metrics::json();
+  const size_t encode = json.find("\"encode\": {\"calls\": 1,");
+  ASSERT_NE(encode, std::string::npos);
+  const size_t allocs = json.find("\"allocs\": ", encode);
+  ASSERT_NE(allocs, std::string::npos);
+  EXPECT_NE(json[allocs + 10], '0');
+}
+
+}  // namespace
+}  // namespace z2music
@@ -0,0 +1,75 @@
+#include "batch.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "thread_pool.h"
+
+namespace z2music {
+
+std::vector<Batch::Job> Batch::parse(std::string_view manifest,
+                                     const std::filesystem::path& dir,
+                                     std::vector<std::string>& errors) {
+  std::vector<Job> jobs;
+  std::istringstream lines{std::string(manifest)};
+  std::string line;
+  for (size_t number = 1; std::getline(lines, line); ++number) {
+    std::istringstream words(line);
+    std::string project, output, extra;
+    if (!(words >> project) || project[0] == '#') continue;
+
+    if (!(words >> output) || (words >> extra)) {
+      errors.push_back(std::to_string(number) +
+                       ": expected a project and an output");
+      continue;
+    }
+
+    jobs.push_back({(dir / project).string(), (dir / output).string(), number});
+  }
+  return jobs;
+}
+
+std::vector<Batch::Result> Batch::run(const std::vector<Job>& jobs,
+                                      bool ips) const {
+  std::vector<Result> results(jobs.size());
+  {
+    ThreadPool pool(threads_, 2 * ThreadPool::default_threads());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      pool.submit([&, i] { results[i] = run(jobs[i], ips); });
+    }
+  }
+  return results;
+}
+
+Batch::Result Batch::run(const Job& job, bool ips) const {
+  const auto start = std::chrono::steady_clock::now();
+  auto elapsed = [start] {
+    const std::chrono::duration<double, std::milli> ms =
+        std::chrono::steady_clock::now() - start;
+    return ms.count();
+  };
+
+  std::ifstream in(job.project, std::ios::binary);
+  if (!in) return {false, "Could not open " + job.project + "\n", elapsed()};
+  std::ostringstream data;
+  data << in.rdbuf();
+
+  const bool patch =
+      ips || std::filesystem::path(job.output).extension() == ".ips";
+  auto result = builder_.build(
+      data.str(), patch ? Builder::Output::Ips : Builder::Output::Rom);
+  if (!result.ok) return {false, std::move(result.diagnostics), elapsed()};
+
+  std::ofstream out(job.output, std::ios::binary);
+  out.write(result.data.data(), result.data.size());
+  out.close();
+  if (!out) {
+    result.diagnostics += "Could not write " + job.output + "\n";
+    return {false, std::move(result.diagnostics), elapsed()};
+  }
+
+  return {true, std::move(result.diagnostics), elapsed()};
+}
+
+}  // namespace z2music
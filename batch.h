@@ -0,0 +1,52 @@
+#ifndef Z2MUSIC_BATCH_H_
+#define Z2MUSIC_BATCH_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "builder.h"
+
+namespace z2music {
+
+// Builds a list of projects against one base ROM, in parallel.
+class Batch {
+ public:
+  struct Job {
+    std::string project;
+    std::string output;
+    // Line of the manifest the job came from
+    size_t line;
+  };
+
+  struct Result {
+    bool ok;
+    std::string diagnostics;
+    double ms;
+  };
+
+  // Reads a manifest with a "project output" pair on each line.  Blank lines
+  // and lines starting with # are skipped, and relative paths are relative to
+  // dir.  Lines which aren't a pair are added to errors.
+  static std::vector<Job> parse(std::string_view manifest,
+                                const std::filesystem::path& dir,
+                                std::vector<std::string>& errors);
+
+  explicit Batch(const Builder& builder, size_t threads = 0)
+      : builder_(builder), threads_(threads) {}
+
+  // Runs every job, writing an IPS patch for outputs ending in .ips or for
+  // every output if ips is set.  Results are in the same order as the jobs.
+  std::vector<Result> run(const std::vector<Job>& jobs, bool ips) const;
+
+ private:
+  const Builder& builder_;
+  const size_t threads_;
+
+  Result run(const Job& job, bool ips) const;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_BATCH_H_
@@ -0,0 +1,126 @@
+#include "batch.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "builder.h"
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "ips.h"
+#include "project.h"
+#include "test_projects.h"
+
+namespace z2music {
+namespace {
+
+const std::string kProject =
+    "song TownTheme\n"
+    "pattern 0x18\n"
+    "a4.4 c5 e5 a5\n"
+    "\n\n\n"
+    "sequence 1\n";
+
+void write(const std::filesystem::path& path, const std::string& data) {
+  std::ofstream file(path, std::ios::binary);
+  file << data;
+}
+
+std::string read(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream data;
+  data << file.rdbuf();
+  return data.str();
+}
+
+TEST(BatchTest, ParsesManifests) {
+  std::vector<std::string> errors;
+  const auto jobs = Batch::parse(
+      "# comment\n"
+      "a.txt a.nes\n"
+      "\n"
+      "  /abs/b.txt b.ips\n"
+      "c.txt\n"
+      "d.txt d.nes extra\n",
+      "dir", errors);
+
+  ASSERT_EQ(jobs.size(), 2);
+  EXPECT_EQ(jobs[0].project, "dir/a.txt");
+  EXPECT_EQ(jobs[0].output, "dir/a.nes");
+  EXPECT_EQ(jobs[0].line, 2);
+  EXPECT_EQ(jobs[1].project, "/abs/b.txt");
+  EXPECT_EQ(jobs[1].output, "dir/b.ips");
+
+  ASSERT_EQ(errors.size(), 2);
+  EXPECT_EQ(errors[0], "5: expected a project and an output");
+  EXPECT_EQ(errors[1], "6: expected a project and an output");
+}
+
+TEST(BatchTest, RunsJobs) {
+  const std::filesystem::path dir = ::testing::TempDir();
+  write(dir / "good.txt", kProject);
+  write(dir / "bad.txt", "song Nope\n");
+
+  std::vector<std::string> errors;
+  const auto jobs = Batch::parse(
+      "good.txt good.nes\n"
+      "good.txt good.ips\n"
+      "bad.txt bad.nes\n"
+      "missing.txt missing.nes\n",
+      dir, errors);
+  ASSERT_TRUE(errors.empty());
+
+  const FakeRom base;
+  const Builder builder(base);
+  const auto results = Batch(builder, 2).run(jobs, false);
+  ASSERT_EQ(results.size(), 4);
+
+  FakeRom expected;
+  Project::parse(kProject).apply(expected);
+  expected.commit();
+
+  EXPECT_TRUE(results[0].ok);
+  EXPECT_EQ(read(dir / "good.nes"), expected.image());
+  EXPECT_TRUE(results[1].ok);
+  EXPECT_EQ(apply_ips(base.image(), read(dir / "good.ips")),
+            expected.image());
+
+  EXPECT_FALSE(results[2].ok);
+  EXPECT_NE(results[2].diagnostics.find("Unknown song name Nope"),
+            std::string::npos);
+  EXPECT_FALSE(std::filesystem::exists(dir / "bad.nes"));
+
+  EXPECT_FALSE(results[3].ok);
+  EXPECT_NE(results[3].diagnostics.find("Could not open"), std::string::npos);
+}
+
+TEST(BatchTest, ReportsProjectsWhichDontFit) {
+  const std::filesystem::path dir = ::testing::TempDir();
+  write(dir / "fits.txt", kProject);
+  write(dir / "full.txt", too_many_pitches());
+
+  std::vector<std::string> errors;
+  const auto jobs = Batch::parse(
+      "fits.txt fits1.nes\n"
+      "full.txt full.nes\n"
+      "fits.txt fits2.nes\n",
+      dir, errors);
+  ASSERT_TRUE(errors.empty());
+
+  const FakeRom base;
+  const Builder builder(base);
+  const auto results = Batch(builder, 2).run(jobs, false);
+  ASSERT_EQ(results.size(), 3);
+
+  EXPECT_TRUE(results[0].ok);
+  EXPECT_TRUE(std::filesystem::exists(dir / "fits1.nes"));
+  EXPECT_FALSE(results[1].ok);
+  EXPECT_NE(results[1].diagnostics.find("only slots for 31"),
+            std::string::npos);
+  EXPECT_FALSE(std::filesystem::exists(dir / "full.nes"));
+  EXPECT_TRUE(results[2].ok);
+  EXPECT_TRUE(std::filesystem::exists(dir / "fits2.nes"));
+}
+
+}  // namespace
+}  // namespace z2music
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/log_severity.h"
+#include "absl/log/globals.h"
+#include "alloc_tracker.h"
+#include "benchmark/benchmark.h"
+#include "duration_lut.h"
+#include "fake_rom.h"
+#include "pattern.h"
+#include "pitch.h"
+#include "pitch_lut.h"
+#include "project.h"
+#include "project_writer.h"
+#include "registry.h"
+#include "rom.h"
+#include "score.h"
+
+namespace z2music {
+namespace {
+
+struct ProjectFile {
+  std::string name;
+  std::string text;
+};
+
+std::vector<ProjectFile> read_projects(const std::filesystem::path& dir) {
+  std::vector<ProjectFile> projects;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    if (entry.path().extension() != ".z2music") continue;
+    std::ifstream file(entry.path(), std::ios::binary);
+    std::ostringstream text;
+    text << file.rdbuf();
+    // Skip anything with errors, since it would never be applied
+    if (!Project::parse(text.str()).ok()) continue;
+    projects.push_back({entry.path().stem().string(), text.str()});
+  }
+  std::sort(projects.begin(), projects.end(),
+            [](const auto& a, const auto& b) { return a.name < b.name; });
+  return projects;
+}
+
+FakeRom applied_rom(const std::string& text) {
+  FakeRom rom;
+  rom.make_decodable();
+  Project::parse(text).apply(rom);
+  return rom;
+}
+
+// The channel lines of every pattern, which go through parse_notes
+std::vector<std::string> note_lines(const std::string& text) {
+  std::vector<std::string> lines;
+  std::istringstream input(text);
+  int channels = 0;
+  for (std::string line; std::getline(input, line);) {
+    if (channels > 0) {
+      --channels;
+      if (!line.empty()) lines.push_back(line);
+    } else if (line.rfind("pattern", 0) == 0) {
+      channels = 4;
+    }
+  }
+  return lines;
+}
+
+size_t pattern_count(const Rom& rom) {
+  size_t count = 0;
+  for (const auto& entry : kSongs) {
+    count += rom.song(entry.title).pattern_count();
+  }
+  return count;
+}
+
+// Reports heap use per iteration once the benchmark loop is done, and fails
+// the benchmark if it allocates more often than its budget allows, so that
+// allocation regressions show up as errors rather than as slightly slower
+// times.  Budgets are mostly per pattern, about a quarter above what each
+// benchmark needs now, and a few allocations per run are let through for the
+// benchmark library and for buffers which are reused between iterations.
+class HeapBudget {
+ public:
+  HeapBudget(benchmark::State& state, double allocs)
+      : state_(state), budget_(allocs) {}
+
+  ~HeapBudget() {
+    const AllocTracker::Stats stats = heap_.stats();
+    const double n = std::max<double>(state_.iterations(), 1);
+    state_.counters["allocs"] = stats.allocs / n;
+    state_.counters["alloc_bytes"] = stats.bytes / n;
+    state_.counters["peak_bytes"] = stats.peak;
+    if (stats.allocs > budget_ * n + kSlack) {
+      state_.SkipWithError("allocates more than its budget");
+    }
+  }
+
+ private:
+  benchmark::State& state_;
+  static constexpr int64_t kSlack = 8;
+
+  const double budget_;
+  const AllocTracker::Scope heap_;
+};
+
+void BM_DecodeImage(benchmark::State& state, const std::string& text) {
+  FakeRom rom = applied_rom(text);
+  rom.commit();
+  const std::string image = rom.image();
+
+  const HeapBudget heap(state, 128 + 8 * pattern_count(rom));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Rom::from_image(image));
+  }
+  state.SetBytesProcessed(state.iterations() * image.size());
+}
+
+// The address of every pattern header in the song tables, as the game
+// finds them: a byte offset to each song, then one to each pattern.
+std::vector<Address> pattern_addresses(const Rom& rom) {
+  std::vector<Address> patterns;
+  for (size_t t = 0; t < kSongTables; ++t) {
+    const Address table = rom.song_table_address(static_cast<SongTable>(t));
+    for (size_t i = 0; i < Score::kSlots; ++i) {
+      const Address song = table + rom.getc(table + i);
+      for (Address p = song; rom.getc(p) != 0; ++p) {
+        patterns.push_back(table + rom.getc(p));
+      }
+    }
+  }
+  std::sort(patterns.begin(), patterns.end());
+  patterns.erase(std::unique(patterns.begin(), patterns.end()),
+                 patterns.end());
+  return patterns;
+}
+
+// Reads the length and highest note of every channel straight from the
+// image, which is all some checks need, without decoding it into songs.
+void BM_ScanNotes(benchmark::State& state, const std::string& text) {
+  FakeRom rom = applied_rom(text);
+  rom.commit();
+  const Rom decoded = Rom::from_image(rom.image());
+  const std::vector<Address> patterns = pattern_addresses(decoded);
+
+  const HeapBudget heap(state, 0);
+  for (auto _ : state) {
+    for (Address pattern : patterns) {
+      for (auto ch : {Pattern::Channel::Pulse1, Pattern::Channel::Pulse2,
+                      Pattern::Channel::Triangle, Pattern::Channel::Noise}) {
+        int length = 0;
+        int highest = 0;
+        for (const Note note : decoded.notes(pattern, ch)) {
+          length += note.ticks();
+          highest = std::max(highest, note.pitch().midi());
+        }
+        benchmark::DoNotOptimize(length);
+        benchmark::DoNotOptimize(highest);
+      }
+    }
+  }
+  state.counters["patterns"] = patterns.size();
+}
+
+void BM_ParseProject(benchmark::State& state, const std::string& text) {
+  const HeapBudget heap(state, 36 * pattern_count(applied_rom(text)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Project::parse(text));
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+void BM_ParseNotes(benchmark::State& state, const std::string& text) {
+  const auto lines = note_lines(text);
+  size_t bytes = 0;
+  for (const auto& line : lines) bytes += line.size();
+
+  const HeapBudget heap(state, 24 * pattern_count(applied_rom(text)));
+  for (auto _ : state) {
+    for (const auto& line : lines) {
+      benchmark::DoNotOptimize(Pattern::parse_notes(line));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+void BM_Commit(benchmark::State& state, const std::string& text) {
+  FakeRom rom = applied_rom(text);
+  const HeapBudget heap(state, 24 * pattern_count(rom));
+  for (auto _ : state) {
+    rom.encode_cache().clear();
+    rom.commit();
+  }
+}
+
+void BM_CommitCached(benchmark::State& state, const std::string& text) {
+  FakeRom rom = applied_rom(text);
+  rom.commit();
+  const HeapBudget heap(state, 12 * pattern_count(rom));
+  for (auto _ : state) rom.commit();
+}
+
+void BM_DumpNotes(benchmark::State& state, const std::string& text) {
+  const FakeRom rom = applied_rom(text);
+  std::string output;
+  const HeapBudget heap(state, 0);
+  for (auto _ : state) {
+    for (const auto& entry : kSongs) {
+      const Song& song = rom.song(entry.title);
+      for (size_t i = 0; i < song.pattern_count(); ++i) {
+        for (auto ch : {Pattern::Channel::Pulse1, Pattern::Channel::Pulse2,
+                        Pattern::Channel::Triangle, Pattern::Channel::Noise}) {
+          output.clear();
+          song.pattern(i).dump_notes(ch, output);
+          benchmark::DoNotOptimize(output);
+        }
+      }
+    }
+  }
+}
+
+void BM_DumpProject(benchmark::State& state, const std::string& text) {
+  const FakeRom rom = applied_rom(text);
+  const HeapBudget heap(state, 16);
+  for (auto _ : state) {
+    ProjectWriter writer;
+    for (const auto& entry : kSongs) {
+      writer.add_song(entry.name, rom.song(entry.title));
+    }
+    benchmark::DoNotOptimize(writer.str());
+  }
+}
+
+void BM_PitchLUTIndex(benchmark::State& state) {
+  FakeRom rom;
+  const PitchLUT& lut = rom.pitch_lut();
+  const std::vector<Pitch> pitches(lut.begin(), lut.end());
+  const HeapBudget heap(state, 0);
+  for (auto _ : state) {
+    for (const auto& pitch : pitches) {
+      benchmark::DoNotOptimize(lut.index_for(pitch));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * pitches.size());
+}
+BENCHMARK(BM_PitchLUTIndex);
+
+// Every (offset, value) pair in the LUT, as the song data refers to them
+std::vector<std::pair<byte, byte>> lut_entries(const DurationLUT& lut) {
+  std::vector<std::pair<byte, byte>> entries;
+  byte offset = 0;
+  for (const auto& row : lut.rows()) {
+    for (byte b = 0; b < row.size(); ++b) entries.emplace_back(offset, b);
+    offset += row.size();
+  }
+  return entries;
+}
+
+void BM_DurationEncode(benchmark::State& state) {
+  FakeRom rom;
+  const DurationLUT& lut = rom.duration_lut();
+  // Round trips every entry, so nothing misses the LUT
+  std::vector<std::pair<int, byte>> durations;
+  for (const auto& [offset, b] : lut_entries(lut)) {
+    durations.emplace_back(lut.decode(b, offset), offset);
+  }
+
+  const HeapBudget heap(state, 1);
+  for (auto _ : state) {
+    DurationLUT::Encoder encoder(lut);
+    for (const auto& [ticks, offset] : durations) {
+      benchmark::DoNotOptimize(encoder.encode(ticks, offset));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * durations.size());
+}
+BENCHMARK(BM_DurationEncode);
+
+void BM_DurationDecode(benchmark::State& state) {
+  FakeRom rom;
+  const DurationLUT& lut = rom.duration_lut();
+  const auto entries = lut_entries(lut);
+  const HeapBudget heap(state, 0);
+  for (auto _ : state) {
+    for (const auto& [offset, b] : entries) {
+      benchmark::DoNotOptimize(lut.decode(b, offset));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(BM_DurationDecode);
+
+}  // namespace
+}  // namespace z2music
+
+int main(int argc, char** argv) {
+  // JSON unless asked for something else, so results can be compared over
+  // time.  Run from the repository or through bazel run to find projects/.
+  std::vector<char*> args(argv, argv + argc);
+  std::string json = "--benchmark_format=json";
+  const bool has_format = std::any_of(args.begin(), args.end(), [](char* arg) {
+    return std::string_view(arg).rfind("--benchmark_format", 0) == 0;
+  });
+  if (!has_format) args.insert(args.begin() + 1, json.data());
+  int count = args.size();
+
+  using z2music::ProjectFile;
+  static const std::vector<ProjectFile> projects =
+      z2music::read_projects("projects");
+  for (const auto& project : projects) {
+    const std::string& text = project.text;
+    const std::string& name = project.name;
+    benchmark::RegisterBenchmark(("BM_DecodeImage/" + name).c_str(),
+                                 z2music::BM_DecodeImage, text);
+    benchmark::RegisterBenchmark(("BM_ScanNotes/" + name).c_str(),
+                                 z2music::BM_ScanNotes, text);
+    benchmark::RegisterBenchmark(("BM_ParseProject/" + name).c_str(),
+                                 z2music::BM_ParseProject, text);
+    benchmark::RegisterBenchmark(("BM_ParseNotes/" + name).c_str(),
+                                 z2music::BM_ParseNotes, text);
+    benchmark::RegisterBenchmark(("BM_Commit/" + name).c_str(),
+                                 z2music::BM_Commit, text);
+    benchmark::RegisterBenchmark(("BM_CommitCached/" + name).c_str(),
+                                 z2music::BM_CommitCached, text);
+    benchmark::RegisterBenchmark(("BM_DumpNotes/" + name).c_str(),
+                                 z2music::BM_DumpNotes, text);
+    benchmark::RegisterBenchmark(("BM_DumpProject/" + name).c_str(),
+                                 z2music::BM_DumpProject, text);
+  }
+
+  // TRACE formats its messages, allocating, whenever INFO is logged.  Opt
+  // builds compile it out, but in any other build the budgets would only hold
+  // with this.
+  absl::SetMinLogLevel(absl::LogSeverityAtLeast::kWarning);
+
+  z2music::AllocTracker::enable();
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
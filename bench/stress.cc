@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "alloc_tracker.h"
+#include "benchmark/benchmark.h"
+#include "fake_rom.h"
+#include "pattern.h"
+#include "project.h"
+#include "project_writer.h"
+#include "registry.h"
+#include "rom.h"
+#include "score.h"
+#include "song.h"
+#include "song_generator.h"
+
+namespace z2music {
+namespace {
+
+// The generated song goes in the last table, which has the most room after
+// it, up to the end of the music bank at $c000.
+constexpr SongTitle kTitle = SongTitle::GreatPalaceTheme;
+constexpr SongTable kTable = SongTable::GreatPalace;
+constexpr Address kBankEnd = 0x01c000;
+
+// Songs, sequences and pattern headers are found by a byte offset from the
+// start of the table, and each channel by a byte offset from pulse 1.
+constexpr size_t kOffsetLimit = 256;
+constexpr size_t kPitchSlots = 31;
+
+// How much of each limited resource a ROM's music needs
+struct Usage {
+  size_t pitches = 0;
+  size_t table_offsets = 0;
+  size_t channel_offsets = 0;
+  size_t table_bytes = 0;
+  size_t space = 0;
+  size_t rows = 0;
+};
+
+Usage usage(const Rom& rom) {
+  Usage usage;
+
+  PitchSet pitches;
+  for (const auto& entry : kSongs) {
+    const Song& song = rom.song(entry.title);
+    if (!song.title()) song.pitches_used(pitches);
+  }
+  pitches.erase(Pitch::none());
+  usage.pitches = pitches.size();
+
+  // The same as Rom::commit, without writing anything
+  const Score& score = rom.score(kTable);
+  size_t offsets = Score::kSlots + 1;
+  size_t notes = 0;
+  std::vector<byte> tempos;
+  for (const auto& song : score) {
+    if (song.empty()) continue;
+    offsets += song.metadata_length();
+    for (size_t i = 0; i < song.pattern_count(); ++i) {
+      const Pattern& pattern = song.pattern(i);
+      notes += pattern.note_data_length();
+      usage.channel_offsets = std::max(
+          usage.channel_offsets,
+          pattern.note_data_length(Pattern::Channel::Pulse1) +
+              pattern.note_data_length(Pattern::Channel::Pulse2) +
+              pattern.note_data_length(Pattern::Channel::Triangle));
+      if (std::find(tempos.begin(), tempos.end(), pattern.tempo()) ==
+          tempos.end()) {
+        tempos.push_back(pattern.tempo());
+      }
+    }
+  }
+  usage.table_offsets = offsets;
+  usage.table_bytes = offsets + notes;
+  usage.rows = tempos.size();
+
+  const Address start = rom.song_table_address(kTable);
+  Address end = kBankEnd;
+  for (size_t t = 0; t < kSongTables; ++t) {
+    const Address other = rom.song_table_address(static_cast<SongTable>(t));
+    if (other > start && other < end) end = other;
+  }
+  usage.space = end - start;
+
+  return usage;
+}
+
+// Which limit the music runs into first, if any
+const char* exceeded(const Usage& usage) {
+  if (usage.pitches > kPitchSlots) return "more pitches than LUT slots";
+  if (usage.table_offsets > kOffsetLimit) {
+    return "song table past a byte offset";
+  }
+  if (usage.channel_offsets >= kOffsetLimit) {
+    return "pattern channels past a byte offset";
+  }
+  if (usage.table_bytes > usage.space) return "song table runs into data";
+  return nullptr;
+}
+
+std::string dump(const Song& song) {
+  ProjectWriter writer;
+  writer.add_song(song_name(kTitle), song);
+  return writer.str();
+}
+
+size_t note_count(const Song& song) {
+  size_t count = 0;
+  for (size_t i = 0; i < song.pattern_count(); ++i) {
+    for (auto ch : {Pattern::Channel::Pulse1, Pattern::Channel::Pulse2,
+                    Pattern::Channel::Triangle, Pattern::Channel::Noise}) {
+      count += song.pattern(i).notes(ch).size();
+    }
+  }
+  return count;
+}
+
+// Generates a song with the given patterns, pattern length in quarter notes
+// and pitches, then times writing it out as a project, parsing and applying
+// it, committing, decoding the image and checking that the song survived.
+void BM_RoundTrip(benchmark::State& state) {
+  FakeRom base;
+  base.make_decodable();
+
+  SongGenerator::Options options;
+  options.patterns = state.range(0);
+  options.pattern_length = state.range(1) * Note::Quarter;
+  options.pitches = state.range(2);
+  options.low = Pitch::C2;
+  options.high = Pitch::B6;
+
+  const Song song = SongGenerator(base.duration_lut(), 1).generate(options);
+  const std::string text = dump(song);
+  const size_t notes = note_count(song);
+
+  FakeRom sized = base;
+  sized.song(kTitle) = song;
+  const Usage used = usage(sized);
+  state.counters["notes"] = notes;
+  state.counters["pitches"] = used.pitches;
+  state.counters["table_offsets"] = used.table_offsets;
+  state.counters["channel_offsets"] = used.channel_offsets;
+  state.counters["table_bytes"] = used.table_bytes;
+  state.counters["space"] = used.space;
+  state.counters["lut_rows"] = used.rows;
+  if (const char* limit = exceeded(used)) {
+    state.SkipWithError(limit);
+    return;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  std::chrono::duration<double, std::micro> parse{}, commit{}, decode{},
+      compare{};
+  AllocTracker::enable();
+  const AllocTracker::Scope heap;
+  bool same = true;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    FakeRom rom = base;
+    state.ResumeTiming();
+
+    const auto start = Clock::now();
+    Project::parse(text).apply(rom);
+    const auto parsed = Clock::now();
+    rom.commit();
+    const auto committed = Clock::now();
+    const Rom decoded = Rom::from_image(rom.image());
+    const auto done = Clock::now();
+    same = same && dump(decoded.song(kTitle)) == text;
+    const auto compared = Clock::now();
+
+    parse += parsed - start;
+    commit += committed - parsed;
+    decode += done - committed;
+    compare += compared - done;
+  }
+
+  if (!same) state.SkipWithError("decoded song is different");
+
+  const double n = state.iterations();
+  state.counters["parse_us"] = parse.count() / n;
+  state.counters["commit_us"] = commit.count() / n;
+  state.counters["decode_us"] = decode.count() / n;
+  state.counters["compare_us"] = compare.count() / n;
+  state.counters["heap_peak"] = heap.stats().peak;
+  state.counters["allocs"] = heap.stats().allocs / n;
+  state.counters["notes_per_s"] =
+      benchmark::Counter(notes, benchmark::Counter::kIsIterationInvariantRate);
+  state.SetComplexityN(notes);
+}
+BENCHMARK(BM_RoundTrip)
+    ->ArgNames({"patterns", "quarters", "pitches"})
+    ->ArgsProduct({{1, 4, 16, 32, 64}, {4, 16, 48}, {12, 31, 40}})
+    ->Unit(benchmark::kMicrosecond)
+    ->Complexity();
+
+}  // namespace
+}  // namespace z2music
+
+BENCHMARK_MAIN();
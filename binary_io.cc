@@ -0,0 +1,203 @@
+#include "binary_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+namespace z2music {
+
+namespace {
+constexpr Pattern::Channel kChannelOrder[] = {
+    Pattern::Channel::Pulse1, Pattern::Channel::Pulse2,
+    Pattern::Channel::Triangle, Pattern::Channel::Noise};
+}  // namespace
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9e3779b185ebca87;
+constexpr uint64_t kPrime2 = 0xc2b2ae3d27d4eb4f;
+constexpr uint64_t kPrime3 = 0x165667b19e3779f9;
+constexpr uint64_t kPrime4 = 0x85ebca77c2b2ae63;
+constexpr uint64_t kPrime5 = 0x27d4eb2f165667c5;
+
+uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+uint64_t read64(const char* p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+uint32_t read32(const char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+uint64_t round(uint64_t acc, uint64_t input) {
+  return rotl(acc + input * kPrime2, 31) * kPrime1;
+}
+
+uint64_t merge(uint64_t h, uint64_t acc) {
+  return (h ^ round(0, acc)) * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+// XXH64, so that every input bit reaches every output bit.  The rotates
+// matter: with only xors and multiplies a change can never move into lower
+// bits, and two changes to the top bit cancel out.  A ROM image is 256 KiB,
+// so the bulk of it goes through four independent lanes.
+uint64_t fingerprint(std::string_view data, uint64_t seed) {
+  const char* p = data.data();
+  const char* const end = p + data.size();
+  uint64_t h;
+
+  if (data.size() >= 32) {
+    uint64_t v1 = seed + kPrime1 + kPrime2;
+    uint64_t v2 = seed + kPrime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kPrime1;
+    for (; p + 32 <= end; p += 32) {
+      v1 = round(v1, read64(p));
+      v2 = round(v2, read64(p + 8));
+      v3 = round(v3, read64(p + 16));
+      v4 = round(v4, read64(p + 24));
+    }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+  } else {
+    h = seed + kPrime5;
+  }
+
+  h += data.size();
+  for (; p + 8 <= end; p += 8) {
+    h = rotl(h ^ round(0, read64(p)), 27) * kPrime1 + kPrime4;
+  }
+  if (p + 4 <= end) {
+    h = rotl(h ^ (read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h = rotl(h ^ (static_cast<uint8_t>(*p) * kPrime5), 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+void BinaryWriter::string(std::string_view s) {
+  count(s.size());
+  bytes(s.substr(0, 0xffff));
+}
+
+void BinaryWriter::pattern(const Pattern& pattern) {
+  u8(pattern.tempo());
+  u8(pattern.voiced() ? pattern.voice1() : byte(0));
+  u8(pattern.voiced() ? pattern.voice2() : byte(0));
+  u8(0);
+
+  for (auto ch : kChannelOrder) count(pattern.notes(ch).size());
+
+  for (auto ch : kChannelOrder) {
+    for (const auto& note : pattern.notes(ch)) {
+      if (note.ticks() < 0 || note.ticks() > 0xffff) ok_ = false;
+      u16(note.pitch().timer());
+      u16(note.ticks());
+    }
+  }
+}
+
+void BinaryWriter::pitches(const PitchLUT& lut) {
+  u16(std::distance(lut.begin(), lut.end()));
+  for (const auto& pitch : lut) u16(pitch.timer());
+}
+
+void BinaryWriter::durations(const DurationLUT& lut) {
+  u16(lut.rows().size());
+  for (const auto& row : lut.rows()) {
+    u16(row.size());
+    for (byte b : row.values()) u8(b);
+  }
+}
+
+std::string_view BinaryReader::bytes(size_t length) {
+  if (!have(length)) return {};
+  const std::string_view result = data_.substr(pos_, length);
+  pos_ += length;
+  return result;
+}
+
+std::string BinaryReader::string() {
+  const uint16_t length = u16();
+  return std::string(bytes(length));
+}
+
+void BinaryReader::align() {
+  pos_ = std::min(data_.size(), (pos_ + 3) & ~size_t(3));
+}
+
+Pattern BinaryReader::pattern() {
+  const byte tempo = u8();
+  const byte voice1 = u8();
+  const byte voice2 = u8();
+  u8();
+
+  uint16_t counts[4];
+  for (auto& count : counts) count = u16();
+
+  Pattern pattern = tempo == 0 ? Pattern(voice1, voice2, {}, {}, {}, {})
+                               : Pattern(tempo, {}, {}, {}, {});
+
+  for (size_t c = 0; c < 4; ++c) {
+    if (!have(counts[c] * size_t(4))) break;
+
+    std::vector<Note> notes;
+    notes.reserve(counts[c]);
+    for (size_t i = 0; i < counts[c]; ++i) {
+      const WordBE timer = u16();
+      notes.emplace_back(Pitch(timer), u16());
+    }
+    pattern.set_notes(kChannelOrder[c], std::move(notes));
+  }
+
+  return pattern;
+}
+
+PitchLUT BinaryReader::pitches() {
+  PitchLUT lut;
+  const uint16_t count = u16();
+  for (size_t i = 0; i < count && !failed_; ++i) {
+    lut.add_pitch(Pitch(WordBE(u16())));
+  }
+  return lut;
+}
+
+DurationLUT BinaryReader::durations() {
+  DurationLUT lut;
+  const uint16_t rows = u16();
+  for (size_t i = 0; i < rows && !failed_; ++i) {
+    const std::string_view data = bytes(u16());
+    lut.add_row(std::vector<byte>(data.begin(), data.end()));
+  }
+  return lut;
+}
+
+bool BinaryReader::have(size_t length) {
+  if (!failed_ && data_.size() - pos_ < length) fail("Unexpected end of data");
+  return !failed_;
+}
+
+void BinaryReader::fail_at(size_t position, const std::string& message) {
+  if (failed_) return;
+  failed_ = true;
+  error_ = message;
+  error_position_ = position;
+}
+
+}  // namespace z2music
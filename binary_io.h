@@ -0,0 +1,114 @@
+#ifndef Z2MUSIC_BINARY_IO_H_
+#define Z2MUSIC_BINARY_IO_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "duration_lut.h"
+#include "pattern.h"
+#include "pitch_lut.h"
+#include "util.h"
+
+namespace z2music {
+
+// A fast 64 bit hash for cache keys.  Pass the result of one call as the
+// seed of the next to hash several pieces together.  Equal fingerprints
+// don't make equal data, so caches still compare what they find.
+uint64_t fingerprint(std::string_view data, uint64_t seed = 0);
+
+// Appends little endian values to a string, for the binary file formats.
+class BinaryWriter {
+ public:
+  explicit BinaryWriter(std::string& out) : out_(out) {}
+
+  void u8(uint8_t v) { out_ += static_cast<char>(v); }
+  void u16(uint16_t v) {
+    u8(v & 0xff);
+    u8(v >> 8);
+  }
+  void u32(uint32_t v) {
+    u16(v & 0xffff);
+    u16(v >> 16);
+  }
+  void u64(uint64_t v) {
+    u32(v & 0xffffffff);
+    u32(v >> 32);
+  }
+  // A u16 count, which fails the writer if n doesn't fit
+  void count(size_t n) {
+    if (n > 0xffff) ok_ = false;
+    u16(n);
+  }
+  void bytes(std::string_view data) { out_ += data; }
+  void string(std::string_view s);
+  void align() {
+    while (out_.size() % 4) u8(0);
+  }
+
+  // Tempo and voicing, the note count for each channel, then every note as
+  // a u16 timer and u16 ticks.
+  void pattern(const Pattern& pattern);
+
+  // The pitch timers or duration rows of a LUT, with their counts
+  void pitches(const PitchLUT& lut);
+  void durations(const DurationLUT& lut);
+
+  // False if anything written didn't fit in its field
+  bool ok() const { return ok_; }
+
+ private:
+  std::string& out_;
+  bool ok_ = true;
+};
+
+// Reads what BinaryWriter writes.  Reading past the end or calling fail()
+// stops all further reads, which then return zeros, so callers can check
+// failed() once at the end.
+class BinaryReader {
+ public:
+  explicit BinaryReader(std::string_view data) : data_(data) {}
+
+  uint8_t u8() { return have(1) ? static_cast<uint8_t>(data_[pos_++]) : 0; }
+  uint16_t u16() {
+    const uint16_t lo = u8();
+    return lo | (u8() << 8);
+  }
+  uint32_t u32() {
+    const uint32_t lo = u16();
+    return lo | (static_cast<uint32_t>(u16()) << 16);
+  }
+  uint64_t u64() {
+    const uint64_t lo = u32();
+    return lo | (static_cast<uint64_t>(u32()) << 32);
+  }
+  std::string_view bytes(size_t length);
+  std::string string();
+  void align();
+
+  Pattern pattern();
+  PitchLUT pitches();
+  DurationLUT durations();
+
+  bool have(size_t length);
+  void fail(const std::string& message) { fail_at(pos_, message); }
+  void fail_at(size_t position, const std::string& message);
+
+  bool failed() const { return failed_; }
+  const std::string& error() const { return error_; }
+  size_t error_position() const { return error_position_; }
+  size_t position() const { return pos_; }
+  bool done() const { return pos_ == data_.size(); }
+
+ private:
+  std::string_view data_;
+  size_t pos_ = 0;
+
+  bool failed_ = false;
+  std::string error_;
+  size_t error_position_ = 0;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_BINARY_IO_H_
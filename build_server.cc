@@ -0,0 +1,373 @@
+#include "build_server.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "absl/log/log.h"
+#include "binary_io.h"
+#include "thread_pool.h"
+
+namespace z2music {
+
+namespace {
+
+#ifdef __linux__
+bool read_all(int fd, char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = recv(fd, data, size, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+std::optional<std::string> read_message(int fd, size_t max_size) {
+  char size_bytes[4];
+  if (!read_all(fd, size_bytes, sizeof(size_bytes))) return std::nullopt;
+  const uint32_t size =
+      BinaryReader(std::string_view(size_bytes, sizeof(size_bytes))).u32();
+  if (size > max_size) return std::nullopt;
+
+  std::string message(size, '\0');
+  if (!read_all(fd, message.data(), size)) return std::nullopt;
+  return message;
+}
+
+bool write_message(int fd, std::string_view message) {
+  std::string data;
+  BinaryWriter w(data);
+  w.u32(message.size());
+  w.bytes(message);
+  return write_all(fd, data.data(), data.size());
+}
+
+bool socket_address(const std::string& socket, sockaddr_un& address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  if (socket.size() >= sizeof(address.sun_path)) {
+    LOG(ERROR) << "Socket path is too long: " << socket;
+    return false;
+  }
+  std::strncpy(address.sun_path, socket.c_str(), sizeof(address.sun_path));
+  return true;
+}
+#endif
+
+}  // namespace
+
+BuildServer::BuildServer(BaseLoader loader,
+                         std::vector<Optimizer::Pass> passes, size_t threads)
+    : loader_(std::move(loader)),
+      passes_(std::move(passes)),
+      threads_(threads > 0 ? threads : ThreadPool::default_threads()),
+      started_(std::chrono::steady_clock::now()) {}
+
+std::shared_ptr<const Builder> BuildServer::builder(const std::string& base) {
+  {
+    std::lock_guard<std::mutex> lock(builders_mutex_);
+    auto it = builders_.find(base);
+    if (it != builders_.end()) {
+      it->second.used = ++clock_;
+      return it->second.builder;
+    }
+  }
+
+  // Decoding a base ROM takes a while, so other builds go on meanwhile.  Two
+  // requests for a new base at once both load it and the first one is kept.
+  const auto rom = loader_(base);
+  if (!rom) return nullptr;
+  auto loaded = std::make_shared<const Builder>(*rom, passes_);
+
+  std::lock_guard<std::mutex> lock(builders_mutex_);
+  auto [it, inserted] = builders_.try_emplace(base, Base{std::move(loaded), 0});
+  it->second.used = ++clock_;
+  if (!inserted) return it->second.builder;
+
+  LOG(INFO) << "Loaded base ROM " << base;
+  const auto result = it->second.builder;
+
+  // Builds still running on an evicted base keep it until they finish
+  while (builders_.size() > kMaxBases) {
+    auto oldest = builders_.begin();
+    for (auto i = builders_.begin(); i != builders_.end(); ++i) {
+      if (i->second.used < oldest->second.used) oldest = i;
+    }
+    LOG(INFO) << "Dropping base ROM " << oldest->first;
+    builders_.erase(oldest);
+  }
+  return result;
+}
+
+BuildServer::Response BuildServer::handle(const Request& request) {
+  if (request.kind == Kind::Stats) return {true, stats(), ""};
+
+  const auto start = std::chrono::steady_clock::now();
+
+  Response response;
+  if (const auto b = builder(request.base)) {
+    auto result = b->build(request.project, request.output);
+    response = {result.ok, std::move(result.data),
+                std::move(result.diagnostics)};
+  } else {
+    response = {false, "", "Unknown base ROM: " + request.base + "\n"};
+  }
+
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  record(response, elapsed.count());
+  return response;
+}
+
+void BuildServer::record(const Response& response, double ms) {
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  if (latencies_.size() < kLatencySamples) {
+    latencies_.push_back(ms);
+  } else {
+    latencies_[builds_ % kLatencySamples] = ms;
+  }
+
+  ++builds_;
+  if (!response.ok) ++failures_;
+  bytes_out_ += response.data.size();
+  total_ms_ += ms;
+}
+
+std::string BuildServer::stats() const {
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  const std::chrono::duration<double> uptime =
+      std::chrono::steady_clock::now() - started_;
+
+  std::vector<double> sorted = latencies_;
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&sorted](double p) {
+    return sorted.empty() ? 0.0 : sorted[(sorted.size() - 1) * p];
+  };
+
+  std::ostringstream out;
+  out << "builds " << builds_ << std::endl;
+  out << "failures " << failures_ << std::endl;
+  out << "bytes_out " << bytes_out_ << std::endl;
+  out << "uptime_s " << uptime.count() << std::endl;
+  out << "builds_per_s " << builds_ / uptime.count() << std::endl;
+  out << "latency_mean_ms " << (builds_ ? total_ms_ / builds_ : 0.0)
+      << std::endl;
+  out << "latency_p50_ms " << percentile(0.5) << std::endl;
+  out << "latency_p99_ms " << percentile(0.99) << std::endl;
+  out << "latency_max_ms " << (sorted.empty() ? 0.0 : sorted.back())
+      << std::endl;
+  return out.str();
+}
+
+std::string BuildServer::encode(const Request& request) {
+  std::string data;
+  BinaryWriter w(data);
+  w.u8(static_cast<uint8_t>(request.kind));
+  if (request.kind == Kind::Build) {
+    w.string(request.base);
+    w.u8(static_cast<uint8_t>(request.output));
+    w.u32(request.project.size());
+    w.bytes(request.project);
+  }
+  return data;
+}
+
+std::optional<BuildServer::Request> BuildServer::decode_request(
+    std::string_view data) {
+  BinaryReader r(data);
+  Request request;
+
+  const uint8_t kind = r.u8();
+  if (kind > static_cast<uint8_t>(Kind::Stats)) return std::nullopt;
+  request.kind = static_cast<Kind>(kind);
+
+  if (request.kind == Kind::Build) {
+    request.base = r.string();
+    const uint8_t output = r.u8();
+    if (output > static_cast<uint8_t>(Builder::Output::Ips)) {
+      return std::nullopt;
+    }
+    request.output = static_cast<Builder::Output>(output);
+    request.project = r.bytes(r.u32());
+  }
+
+  if (r.failed() || !r.done()) return std::nullopt;
+  return request;
+}
+
+std::string BuildServer::encode(const Response& response) {
+  std::string data;
+  BinaryWriter w(data);
+  w.u8(response.ok ? 0 : 1);
+  w.u32(response.data.size());
+  w.bytes(response.data);
+  w.u32(response.diagnostics.size());
+  w.bytes(response.diagnostics);
+  return data;
+}
+
+std::optional<BuildServer::Response> BuildServer::decode_response(
+    std::string_view data) {
+  BinaryReader r(data);
+  Response response;
+  response.ok = r.u8() == 0;
+  response.data = r.bytes(r.u32());
+  response.diagnostics = r.bytes(r.u32());
+
+  if (r.failed() || !r.done()) return std::nullopt;
+  return response;
+}
+
+#ifdef __linux__
+
+bool BuildServer::serve(const std::string& socket) {
+  sockaddr_un address;
+  if (!socket_address(socket, address)) return false;
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    LOG(ERROR) << "Unable to create socket: " << std::strerror(errno);
+    return false;
+  }
+
+  // A socket left behind by an earlier server would make bind fail, but
+  // anything else at the path is someone's file.
+  struct stat existing;
+  if (lstat(socket.c_str(), &existing) == 0) {
+    if (!S_ISSOCK(existing.st_mode)) {
+      LOG(ERROR) << "Not replacing " << socket << ", which is not a socket";
+      close(fd);
+      return false;
+    }
+    unlink(socket.c_str());
+  }
+
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    LOG(ERROR) << "Unable to listen on " << socket << ": "
+               << std::strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  listener_ = fd;
+  if (stopping_) shutdown(fd, SHUT_RDWR);
+  LOG(INFO) << "Serving builds on " << socket << " with " << threads_
+            << " workers";
+
+  {
+    // When every worker is busy and the queue is full, stop accepting and
+    // let connections wait in the listen backlog.
+    ThreadPool pool(threads_, threads_ * 4);
+    while (!stopping_) {
+      const int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0) {
+        if (errno == EINTR || stopping_) continue;
+        LOG(ERROR) << "Unable to accept connection: " << std::strerror(errno);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+
+      pool.submit([this, client] {
+        serve_client(client);
+        close(client);
+      });
+    }
+  }
+
+  listener_ = -1;
+  close(fd);
+  unlink(socket.c_str());
+  return true;
+}
+
+void BuildServer::stop() {
+  stopping_ = true;
+  // Wakes up the accept() in serve()
+  const int fd = listener_;
+  if (fd >= 0) shutdown(fd, SHUT_RDWR);
+}
+
+void BuildServer::serve_client(int client) {
+  // Don't let a client which never finishes its request hold a worker
+  const timeval timeout = {10, 0};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  const auto message = read_message(client, kMaxMessage);
+  if (!message) return;
+
+  const auto request = decode_request(*message);
+  const Response response =
+      request ? handle(*request) : Response{false, "", "Invalid request\n"};
+  write_message(client, encode(response));
+}
+
+std::optional<BuildServer::Response> BuildServer::send(
+    const std::string& socket, const Request& request) {
+  sockaddr_un address;
+  if (!socket_address(socket, address)) return std::nullopt;
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return std::nullopt;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+      0) {
+    LOG(ERROR) << "Unable to connect to " << socket << ": "
+               << std::strerror(errno);
+    close(fd);
+    return std::nullopt;
+  }
+
+  std::optional<Response> response;
+  if (write_message(fd, encode(request))) {
+    if (const auto message = read_message(fd, kMaxMessage)) {
+      response = decode_response(*message);
+    }
+  }
+  close(fd);
+  return response;
+}
+
+#else
+
+bool BuildServer::serve(const std::string& /*socket*/) {
+  LOG(ERROR) << "Serving builds is only supported on Linux";
+  return false;
+}
+
+void BuildServer::stop() { stopping_ = true; }
+
+void BuildServer::serve_client(int /*client*/) {}
+
+std::optional<BuildServer::Response> BuildServer::send(
+    const std::string& /*socket*/, const Request& /*request*/) {
+  LOG(ERROR) << "Serving builds is only supported on Linux";
+  return std::nullopt;
+}
+
+#endif
+
+}  // namespace z2music
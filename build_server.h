@@ -0,0 +1,120 @@
+#ifndef Z2MUSIC_BUILD_SERVER_H_
+#define Z2MUSIC_BUILD_SERVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "builder.h"
+#include "optimizer.h"
+#include "rom.h"
+
+namespace z2music {
+
+// Serves builds over a Unix domain socket, so tools which build many projects
+// don't pay for starting a process and decoding the base ROM every time.  Base
+// ROMs are loaded the first time they are asked for, and the kMaxBases most
+// recently used are kept.  Each connection makes one request and gets one
+// response, and connections are handled at the same time on a pool of
+// workers.
+//
+// Messages are a u32 size and then the message, little endian like the other
+// binary formats:
+//
+//   request   u8 kind, then for a build: u16 size and the base ROM id,
+//             u8 output (0 ROM, 1 IPS), u32 size and the project
+//   response  u8 status (0 ok, 1 failed), u32 size and the ROM, patch or
+//             stats, then u32 size and the diagnostics
+class BuildServer {
+ public:
+  enum class Kind : uint8_t { Build = 0, Stats = 1 };
+
+  static constexpr size_t kMaxBases = 8;
+
+  struct Request {
+    Kind kind = Kind::Build;
+    std::string base;
+    Builder::Output output = Builder::Output::Rom;
+    std::string project;
+  };
+
+  struct Response {
+    bool ok;
+    std::string data;
+    std::string diagnostics;
+  };
+
+  // Returns the base ROM for an id, or nullptr if there isn't one.
+  typedef std::function<std::unique_ptr<Rom>(const std::string& id)>
+      BaseLoader;
+
+  explicit BuildServer(BaseLoader loader,
+                       std::vector<Optimizer::Pass> passes = {},
+                       size_t threads = 0);
+
+  // Answers a request directly.  Safe to call from any thread.
+  Response handle(const Request& request);
+
+  // Listens on the socket until stop() is called.  Returns false if the
+  // socket couldn't be opened, or if something other than a socket is
+  // already at its path.  Serving and sending are only supported on Linux.
+  bool serve(const std::string& socket);
+  void stop();
+
+  // Throughput and latency of the builds so far, one "name value" per line
+  std::string stats() const;
+
+  // Sends a request to a server and waits for the response.
+  static std::optional<Response> send(const std::string& socket,
+                                      const Request& request);
+
+  static std::string encode(const Request& request);
+  static std::optional<Request> decode_request(std::string_view data);
+  static std::string encode(const Response& response);
+  static std::optional<Response> decode_response(std::string_view data);
+
+ private:
+  static constexpr size_t kMaxMessage = 64 << 20;
+  static constexpr size_t kLatencySamples = 1024;
+
+  const BaseLoader loader_;
+  const std::vector<Optimizer::Pass> passes_;
+  const size_t threads_;
+
+  struct Base {
+    std::shared_ptr<const Builder> builder;
+    uint64_t used;
+  };
+
+  std::mutex builders_mutex_;
+  std::map<std::string, Base> builders_;
+  uint64_t clock_ = 0;
+
+  std::atomic<int> listener_{-1};
+  std::atomic<bool> stopping_{false};
+
+  const std::chrono::steady_clock::time_point started_;
+  mutable std::mutex stats_mutex_;
+  size_t builds_ = 0;
+  size_t failures_ = 0;
+  size_t bytes_out_ = 0;
+  double total_ms_ = 0;
+  // The most recent build times, for percentiles
+  std::vector<double> latencies_;
+
+  std::shared_ptr<const Builder> builder(const std::string& base);
+  void record(const Response& response, double ms);
+  void serve_client(int client);
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_BUILD_SERVER_H_
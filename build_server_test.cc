@@ -0,0 +1,221 @@
+#include "build_server.h"
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "builder.h"
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "ips.h"
+#include "project.h"
+#include "rom_layout.h"
+#include "test_projects.h"
+
+namespace z2music {
+namespace {
+
+const std::string kProject =
+    "song TownTheme\n"
+    "pattern 0x18\n"
+    "a4.4 c5 e5 a5\n"
+    "r.4 r r r\n"
+    "\n"
+    "x.8 x\n"
+    "sequence 1 1\n";
+
+std::string expected_image() {
+  FakeRom rom;
+  Project::parse(kProject).apply(rom);
+  rom.commit();
+  return rom.image();
+}
+
+TEST(BuilderTest, BuildsRomsAndPatches) {
+  const FakeRom base;
+  const Builder builder(base);
+
+  const auto rom = builder.build(kProject, Builder::Output::Rom);
+  ASSERT_TRUE(rom.ok);
+  EXPECT_EQ(rom.data, expected_image());
+
+  const auto binary = Project::parse(kProject).to_binary();
+  ASSERT_TRUE(binary);
+  const auto patch = builder.build(*binary, Builder::Output::Ips);
+  ASSERT_TRUE(patch.ok);
+  EXPECT_EQ(apply_ips(base.image(), patch.data), expected_image());
+
+  const auto bad = builder.build("song Nope\n", Builder::Output::Rom);
+  EXPECT_FALSE(bad.ok);
+  EXPECT_NE(bad.diagnostics.find("error: Unknown song name Nope"),
+            std::string::npos);
+
+  const auto full = builder.build(too_many_pitches(), Builder::Output::Rom);
+  EXPECT_FALSE(full.ok);
+  EXPECT_NE(full.diagnostics.find("only slots for 31"), std::string::npos);
+}
+
+TEST(BuilderTest, PatchesMovedLoaders) {
+  // Each loader loads from its table, then jumps out
+  FakeRom base;
+  base.make_decodable();
+  const RomLayout& layout = base.layout();
+  for (const auto& table : layout.tables) base.putc(table.loader + 3, 0x4c);
+  const Builder builder(base);
+
+  const std::string project = "loader Town 0xb800\n" + kProject;
+  const auto rom = builder.build(project, Builder::Output::Rom);
+  ASSERT_TRUE(rom.ok);
+  const Address operand =
+      layout.table(SongTable::Town).loader + Rom::kHeaderSize + 1;
+  EXPECT_EQ(rom.data[operand], 0x00);
+  EXPECT_EQ(static_cast<byte>(rom.data[operand + 1]), 0xb8);
+
+  // The patch is against the base as loaded, so it moves the loader too
+  const auto patch = builder.build(project, Builder::Output::Ips);
+  ASSERT_TRUE(patch.ok);
+  EXPECT_EQ(apply_ips(base.image(), patch.data), rom.data);
+}
+
+TEST(BuildServerTest, EncodesMessages) {
+  BuildServer::Request request;
+  request.base = "base.nes";
+  request.output = Builder::Output::Ips;
+  request.project = kProject;
+
+  const auto decoded =
+      BuildServer::decode_request(BuildServer::encode(request));
+  ASSERT_TRUE(decoded.has_value());
+  EXPECT_EQ(decoded->kind, BuildServer::Kind::Build);
+  EXPECT_EQ(decoded->base, request.base);
+  EXPECT_EQ(decoded->output, request.output);
+  EXPECT_EQ(decoded->project, request.project);
+
+  EXPECT_FALSE(BuildServer::decode_request("\x07").has_value());
+  EXPECT_FALSE(
+      BuildServer::decode_request(BuildServer::encode(request) + "x"));
+
+  const BuildServer::Response response = {false, "", "1:1: error: Oops\n"};
+  const auto round_trip =
+      BuildServer::decode_response(BuildServer::encode(response));
+  ASSERT_TRUE(round_trip.has_value());
+  EXPECT_FALSE(round_trip->ok);
+  EXPECT_EQ(round_trip->diagnostics, response.diagnostics);
+}
+
+TEST(BuildServerTest, ServesBuilds) {
+  int loads = 0;
+  BuildServer server(
+      [&loads](const std::string& id) -> std::unique_ptr<Rom> {
+        if (id != "fake") return nullptr;
+        ++loads;
+        return std::make_unique<FakeRom>();
+      },
+      {}, 2);
+
+  const std::string socket = ::testing::TempDir() + "/build_server_test.sock";
+  std::thread thread([&] { EXPECT_TRUE(server.serve(socket)); });
+
+  BuildServer::Request request;
+  request.base = "fake";
+  request.project = kProject;
+
+  // Wait for the server to start listening
+  std::optional<BuildServer::Response> response;
+  for (int i = 0; i < 100 && !response; ++i) {
+    response = BuildServer::send(socket, request);
+    if (!response) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(response.has_value());
+  EXPECT_TRUE(response->ok);
+  EXPECT_EQ(response->data, expected_image());
+
+  request.output = Builder::Output::Ips;
+  response = BuildServer::send(socket, request);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_EQ(apply_ips(FakeRom().image(), response->data), expected_image());
+
+  request.base = "missing";
+  response = BuildServer::send(socket, request);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_FALSE(response->ok);
+
+  request.kind = BuildServer::Kind::Stats;
+  response = BuildServer::send(socket, request);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_NE(response->data.find("builds 3\n"), std::string::npos);
+  EXPECT_NE(response->data.find("failures 1\n"), std::string::npos);
+
+  server.stop();
+  thread.join();
+  EXPECT_EQ(loads, 1);
+}
+
+TEST(BuildServerTest, SurvivesProjectsWhichDontFit) {
+  BuildServer server([](const std::string&) -> std::unique_ptr<Rom> {
+    return std::make_unique<FakeRom>();
+  });
+
+  const std::string socket = ::testing::TempDir() + "/build_server_full.sock";
+  std::thread thread([&] { EXPECT_TRUE(server.serve(socket)); });
+
+  BuildServer::Request request;
+  request.base = "fake";
+  request.project = too_many_pitches();
+
+  std::optional<BuildServer::Response> response;
+  for (int i = 0; i < 100 && !response; ++i) {
+    response = BuildServer::send(socket, request);
+    if (!response) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(response.has_value());
+  EXPECT_FALSE(response->ok);
+  EXPECT_NE(response->diagnostics.find("only slots for 31"),
+            std::string::npos);
+
+  request.project = kProject;
+  response = BuildServer::send(socket, request);
+  ASSERT_TRUE(response.has_value());
+  EXPECT_TRUE(response->ok);
+  EXPECT_EQ(response->data, expected_image());
+
+  server.stop();
+  thread.join();
+}
+
+TEST(BuildServerTest, KeepsRecentBases) {
+  int loads = 0;
+  BuildServer server([&loads](const std::string&) -> std::unique_ptr<Rom> {
+    ++loads;
+    return std::make_unique<FakeRom>();
+  });
+
+  BuildServer::Request request;
+  request.project = kProject;
+  for (size_t i = 0; i <= BuildServer::kMaxBases; ++i) {
+    request.base = std::to_string(i);
+    EXPECT_TRUE(server.handle(request).ok);
+  }
+  EXPECT_EQ(loads, BuildServer::kMaxBases + 1);
+
+  // The last one is still loaded, but the first was dropped for it
+  server.handle(request);
+  EXPECT_EQ(loads, BuildServer::kMaxBases + 1);
+  request.base = "0";
+  server.handle(request);
+  EXPECT_EQ(loads, BuildServer::kMaxBases + 2);
+}
+
+TEST(BuildServerTest, KeepsFilesAtSocketPath) {
+  const std::string path = ::testing::TempDir() + "/not_a_socket.z2music";
+  std::ofstream(path) << kProject;
+
+  BuildServer server([](const std::string&) { return nullptr; });
+  EXPECT_FALSE(server.serve(path));
+  EXPECT_TRUE(std::filesystem::is_regular_file(path));
+}
+
+}  // namespace
+}  // namespace z2music
@@ -0,0 +1,45 @@
+#include "builder.h"
+
+#include <sstream>
+
+#include "ips.h"
+#include "project.h"
+
+namespace z2music {
+
+Builder::Builder(const Rom& base, std::vector<Optimizer::Pass> passes)
+    : base_(base), image_(base.image()), passes_(std::move(passes)) {}
+
+Builder::Result Builder::build(std::string_view data, Output output) const {
+  const Project project = Project::load(data, base_.layout());
+
+  std::ostringstream diagnostics;
+  for (const auto& d : project.diagnostics()) diagnostics << d << std::endl;
+  if (!project.ok()) return {false, "", diagnostics.str()};
+
+  // Builds already run side by side, so each one encodes on a single thread
+  Rom rom = base_;
+  rom.set_encode_threads(1);
+  project.apply(rom);
+
+  if (!passes_.empty()) {
+    Optimizer optimizer([&rom](int ticks, byte tempo) {
+      return rom.can_encode_duration(ticks, tempo);
+    });
+    for (auto pass : passes_) optimizer.add_pass(pass);
+    rom.optimize(optimizer);
+  }
+
+  // A project can parse and still not fit, which only this build should fail
+  std::vector<std::string> errors;
+  if (!rom.commit(errors)) {
+    for (const auto& e : errors) diagnostics << "error: " << e << std::endl;
+    return {false, "", diagnostics.str()};
+  }
+
+  std::string image = rom.image();
+  if (output == Output::Ips) image = make_ips(image_, image);
+  return {true, std::move(image), diagnostics.str()};
+}
+
+}  // namespace z2music
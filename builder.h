@@ -0,0 +1,41 @@
+#ifndef Z2MUSIC_BUILDER_H_
+#define Z2MUSIC_BUILDER_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "optimizer.h"
+#include "rom.h"
+
+namespace z2music {
+
+// Applies projects to a base ROM which is loaded and decoded once.  Every
+// build works on its own copy of the base, so any number of builds can run at
+// the same time from different threads.
+class Builder {
+ public:
+  enum class Output { Rom, Ips };
+
+  struct Result {
+    bool ok;
+    // The ROM image or an IPS patch against the base, if ok
+    std::string data;
+    // Every warning and error, one per line
+    std::string diagnostics;
+  };
+
+  explicit Builder(const Rom& base, std::vector<Optimizer::Pass> passes = {});
+
+  // Takes a project in either the text or binary format.
+  Result build(std::string_view project, Output output) const;
+
+ private:
+  const Rom base_;
+  const std::string image_;
+  const std::vector<Optimizer::Pass> passes_;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_BUILDER_H_
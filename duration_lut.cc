@@ -3,84 +3,80 @@
 #include <sstream>
 
 #include "absl/log/log.h"
+#include "metrics.h"
+#include "trace.h"
 
 namespace z2music {
 
-byte DurationLUT::encode(int ticks, byte offset) {
-  Row* row = get_row(offset);
-  return row ? row->encode(ticks) : byte{0};
-}
-
 int DurationLUT::decode(byte b, byte offset) const {
   const Row* row = get_row(offset);
   return row ? row->decode(b) : 0;
 }
 
-void DurationLUT::reset() {
-  for (auto& row : rows_) row.reset();
+bool DurationLUT::exact(int ticks, byte offset) const {
+  const Row* row = get_row(offset);
+  return row ? row->exact(ticks) : false;
+}
+
+byte DurationLUT::Encoder::encode(int ticks, byte offset) {
+  Metrics::count(Metrics::Counter::DurationLookups);
+  const size_t index = lut_.row_index(offset);
+  if (index == errors_.size()) return 0;
+  return lut_.rows_[index].encode(ticks, errors_[index]);
 }
 
-bool DurationLUT::has_error() const {
-  for (const auto& row : rows_) {
-    if (row.error() > kEpsilon) return true;
+bool DurationLUT::Encoder::has_error() const {
+  for (float error : errors_) {
+    if (error > kEpsilon) return true;
   }
   return false;
 }
 
-float DurationLUT::error() const {
-  float error = 0;
-  for (const auto& row : rows_) {
-    error += row.error();
-  }
-  return error;
+float DurationLUT::Encoder::error() const {
+  float total = 0;
+  for (float error : errors_) total += error;
+  return total;
 }
 
-DurationLUT::Row* DurationLUT::get_row(byte offset) {
+size_t DurationLUT::row_index(byte offset) const {
   size_t index = 0;
-  while (true) {
-    if (offset == 0) return &rows_[index];
-    if (index >= rows_.size()) {
-      LOG(ERROR) << "No row in duration LUT at offset " << offset;
-      return nullptr;
-    }
+  while (index < rows_.size()) {
+    if (offset == 0) return index;
     offset -= rows_[index++].size();
   }
+  LOG(ERROR) << "No row in duration LUT at offset " << offset;
+  return rows_.size();
 }
 
-// TODO deduplicate this from above
 const DurationLUT::Row* DurationLUT::get_row(byte offset) const {
-  size_t index = 0;
-  while (true) {
-    if (offset == 0) return &rows_[index];
-    if (index >= rows_.size()) {
-      LOG(ERROR) << "No row in duration LUT at offset " << offset;
-      return nullptr;
-    }
-    offset -= rows_[index++].size();
-  }
+  const size_t index = row_index(offset);
+  return index < rows_.size() ? &rows_[index] : nullptr;
 }
 
-byte DurationLUT::Row::encode(int ticks) {
+byte DurationLUT::Row::encode(int ticks, float& error) const {
   float target = ticks * ratio();
   byte value = static_cast<byte>(std::round(target));
 
   if (target != value) {
-    LOG(INFO) << "Rounding " << target << " to " << static_cast<int>(value);
+    TRACE << "Rounding " << target << " to " << static_cast<int>(value);
+    Metrics::count(Metrics::Counter::DurationsRounded);
   }
 
-  error_ += (target - value);
+  error += (target - value);
 
-  if (error_ >= 1 - kEpsilon) {
-    LOG(INFO) << "Adjusting value up one";
+  if (error >= 1 - kEpsilon) {
+    TRACE << "Adjusting value up one";
+    Metrics::count(Metrics::Counter::DurationsAdjusted);
     ++value;
-    error_ -= 1.f;
-  } else if (error_ <= -1 + kEpsilon) {
-    LOG(INFO) << "Adjusting value down one";
+    error -= 1.f;
+  } else if (error <= -1 + kEpsilon) {
+    TRACE << "Adjusting value down one";
+    Metrics::count(Metrics::Counter::DurationsAdjusted);
     --value;
-    error_ += 1.f;
+    error += 1.f;
   }
 
-  if (std::abs(error_) > kEpsilon) LOG(INFO) << "Accumulated error: " << error_;
+  if (std::abs(error) > kEpsilon) TRACE << "Accumulated error: " << error;
 
   return index_for(value);
 }
@@ -98,6 +94,17 @@ byte DurationLUT::Row::index_for(int value) const {
   return 0;
 }
 
+bool DurationLUT::Row::exact(int ticks) const {
+  const float target = ticks * ratio();
+  const float value = std::round(target);
+  if (std::abs(target - value) > kEpsilon) return false;
+
+  for (auto v : values_) {
+    if (v == value) return true;
+  }
+  return false;
+}
+
 std::string DurationLUT::Row::to_string() const {
   std::ostringstream out;
   for (auto v : values_) {
@@ -14,35 +14,51 @@ class DurationLUT {
  public:
   class Row {
    public:
-    Row(std::vector<byte> data) : values_(std::move(data)), error_(0.f) {}
+    Row(std::vector<byte> data) : values_(std::move(data)) {}
 
-    byte encode(int ticks);
+    // Adds the rounding error of this note to error, which carries it over
+    // to the next note.
+    byte encode(int ticks, float& error) const;
     int decode(byte b) const;
     byte base() const { return values_[2]; }
     float ratio() const {
       return base() / static_cast<float>(Note::Duration::Eighth);
     }
     byte index_for(int ticks) const;
+    bool exact(int ticks) const;
     size_t size() const { return values_.size(); }
+    const std::vector<byte>& values() const { return values_; }
     std::string to_string() const;
 
-    void reset() { error_ = 0.f; }
     void add_value(byte value) { values_.push_back(value); }
-    float error() const { return error_; }
 
    private:
     std::vector<byte> values_;
-    float error_;
+  };
+
+  // Encodes the durations of one channel, keeping the rounding error from
+  // one note to the next.  The LUT isn't changed, so any number of channels
+  // can be encoded with it at once.
+  class Encoder {
+   public:
+    explicit Encoder(const DurationLUT& lut)
+        : lut_(lut), errors_(lut.rows().size(), 0.f) {}
+
+    byte encode(int ticks, byte offset);
+    bool has_error() const;
+    float error() const;
+
+   private:
+    const DurationLUT& lut_;
+    std::vector<float> errors_;
   };
 
   DurationLUT() {}
-  byte encode(int ticks, byte offset);
   int decode(byte b, byte offset) const;
+  bool exact(int ticks, byte offset) const;
   void add_row(Row row) { rows_.push_back(std::move(row)); }
   void add_row(std::vector<byte> data) { rows_.emplace_back(std::move(data)); }
-  void reset();
-  bool has_error() const;
-  float error() const;
+  const std::vector<Row>& rows() const { return rows_; }
 
   static byte shift(byte b) {
     return ((b & 0b11000000) >> 6) | ((b & 0b1) << 2);
@@ -54,7 +70,8 @@ class DurationLUT {
 
   static constexpr float kEpsilon = 1 / 96.f;
 
-  Row* get_row(byte offset);
+  // Index of the row starting at offset, or rows_.size() if there isn't one
+  size_t row_index(byte offset) const;
   const Row* get_row(byte offset) const;
 };
 
@@ -0,0 +1,147 @@
+#include "encode_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <system_error>
+
+#include "absl/log/log.h"
+#include "binary_io.h"
+
+namespace z2music {
+
+size_t EncodeCache::KeyHash::operator()(std::string_view key) const {
+  return fingerprint(key);
+}
+
+std::string_view EncodeCache::key(const Pattern& pattern, uint64_t luts) {
+  thread_local std::string buffer;
+  buffer.clear();
+
+  // Like BinaryWriter::pattern, but with room for ticks of any length
+  BinaryWriter w(buffer);
+  w.u64(luts);
+  w.u8(pattern.tempo());
+  for (auto ch : {Pattern::Channel::Pulse1, Pattern::Channel::Pulse2,
+                  Pattern::Channel::Triangle, Pattern::Channel::Noise}) {
+    const auto& notes = pattern.notes(ch);
+    w.u32(notes.size());
+    for (const auto& note : notes) {
+      w.u16(note.pitch().timer());
+      w.u32(note.ticks());
+    }
+  }
+  return buffer;
+}
+
+const EncodeCache::Entry* EncodeCache::find(std::string_view key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+
+  ++hits_;
+  it->second.used = ++clock_;
+  return &it->second.entry;
+}
+
+void EncodeCache::insert(std::string_view key, Entry entry) {
+  entries_.insert_or_assign(std::string(key), Slot{std::move(entry), ++clock_});
+}
+
+bool EncodeCache::load(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) return false;
+  std::ostringstream contents;
+  contents << file.rdbuf();
+
+  const std::string data = contents.str();
+  BinaryReader r(data);
+
+  const bool valid =
+      r.bytes(kMagic.size()) == kMagic && r.u16() == kVersion && r.u16() == 0;
+  const uint32_t count = r.u32();
+  const uint64_t payload_hash = r.u64();
+  const size_t start = r.position();
+
+  if (!valid || r.failed() ||
+      fingerprint(std::string_view(data).substr(start)) != payload_hash) {
+    LOG(WARNING) << "Ignoring invalid encode cache " << filename;
+    return false;
+  }
+
+  decltype(entries_) entries;
+  for (size_t i = 0; i < count && !r.failed(); ++i) {
+    const std::string_view key = r.bytes(r.u32());
+    Entry entry;
+    for (auto& length : entry.lengths) length = r.u16();
+
+    const std::string_view bytes = r.bytes(
+        std::accumulate(entry.lengths.begin(), entry.lengths.end(), size_t(0)));
+    entry.data.assign(bytes.begin(), bytes.end());
+    entries.insert_or_assign(std::string(key), Slot{std::move(entry), 0});
+  }
+
+  if (r.failed() || !r.done()) {
+    LOG(WARNING) << "Ignoring invalid encode cache " << filename;
+    return false;
+  }
+
+  // Entries already in memory are newer than the ones from the file, so only
+  // keys which aren't in memory yet are taken from it
+  entries_.merge(entries);
+  return true;
+}
+
+bool EncodeCache::save(const std::string& filename) const {
+  std::vector<std::pair<uint64_t, const std::string*>> order;
+  order.reserve(entries_.size());
+  for (const auto& [key, slot] : entries_) order.emplace_back(slot.used, &key);
+  std::sort(order.rbegin(), order.rend());
+  if (order.size() > kMaxSavedEntries) order.resize(kMaxSavedEntries);
+
+  std::string payload;
+  BinaryWriter p(payload);
+  for (const auto& [used, key] : order) {
+    const Entry& entry = entries_.find(*key)->second.entry;
+    p.u32(key->size());
+    p.bytes(*key);
+    for (auto length : entry.lengths) p.u16(length);
+    for (byte b : entry.data) p.u8(b);
+  }
+
+  std::string data;
+  BinaryWriter w(data);
+  w.bytes(kMagic);
+  w.u16(kVersion);
+  w.u16(0);
+  w.u32(order.size());
+  w.u64(fingerprint(payload));
+  w.bytes(payload);
+
+  // Write to a temporary file first so a reader never sees a partial file
+  const std::string temp =
+      filename + ".tmp" +
+      std::to_string(
+          std::chrono::steady_clock::now().time_since_epoch().count());
+
+  std::ofstream file(temp, std::ios::binary);
+  file.write(data.data(), data.size());
+  file.close();
+
+  std::error_code ec;
+  if (file) std::filesystem::rename(temp, filename, ec);
+  if (!file || ec) {
+    LOG(ERROR) << "Unable to write encode cache " << filename;
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace z2music
@@ -0,0 +1,71 @@
+#ifndef Z2MUSIC_ENCODE_CACHE_H_
+#define Z2MUSIC_ENCODE_CACHE_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "pattern.h"
+#include "util.h"
+
+namespace z2music {
+
+// Remembers the note data encoded for patterns, so committing a ROM only
+// encodes the patterns which changed since the last commit.  Entries are
+// keyed by the pattern's tempo and notes and a hash of the LUTs it was
+// encoded with, and can be saved to a file to carry them over to the next
+// run.
+class EncodeCache {
+ public:
+  struct Entry {
+    std::vector<byte> data;
+    // Bytes of data for Pulse1, Pulse2, Triangle and Noise, in that order
+    std::array<uint16_t, 4> lengths;
+  };
+
+  // Most entries kept when saving, least recently used are dropped first
+  static constexpr size_t kMaxSavedEntries = 4096;
+
+  // Hashes keys for maps which are looked up by string_view
+  struct KeyHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const;
+  };
+
+  // The key is only valid until the next call on the same thread.
+  static std::string_view key(const Pattern& pattern, uint64_t luts);
+
+  // Returns nullptr on a miss.
+  const Entry* find(std::string_view key);
+  void insert(std::string_view key, Entry entry);
+
+  bool load(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  void clear() { entries_.clear(); }
+  size_t size() const { return entries_.size(); }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  static constexpr std::string_view kMagic = "Z2EC";
+  static constexpr uint16_t kVersion = 2;
+
+  struct Slot {
+    Entry entry;
+    uint64_t used;
+  };
+
+  std::unordered_map<std::string, Slot, KeyHash, std::equal_to<>> entries_;
+  uint64_t clock_ = 0;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_ENCODE_CACHE_H_
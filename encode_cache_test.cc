@@ -0,0 +1,141 @@
+#include "encode_cache.h"
+
+#include <fstream>
+#include <string>
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "rom.h"
+
+namespace z2music {
+namespace {
+
+void add_songs(Rom& rom) {
+  Song& town = rom.song(Rom::SongTitle::TownTheme);
+  town.add_pattern({0x18, Pattern::parse_notes("A4.4 C5 E5 A5"),
+                    Pattern::parse_notes("r.4 r r r"), {}, {}});
+  town.add_pattern({0x18, Pattern::parse_notes("E5.8 r"), {}, {}, {}});
+  town.set_sequence({0, 1, 0});
+
+  Song& palace = rom.song(Rom::SongTitle::PalaceTheme);
+  palace.add_pattern({0x20, Pattern::parse_notes("A4.8 r"), {},
+                      Pattern::parse_notes("A3.4"), {}});
+  palace.set_sequence({0, 0});
+}
+
+std::vector<byte> tables(const Rom& rom) {
+  std::vector<byte> data;
+  for (auto t : {SongTable::Town, SongTable::Palace}) {
+    const auto table = rom.read(rom.song_table_address(t), 0x100);
+    data.insert(data.end(), table.begin(), table.end());
+  }
+  return data;
+}
+
+TEST(EncodeCacheTest, ReusesUnchangedPatterns) {
+  FakeRom rom;
+  add_songs(rom);
+
+  rom.commit();
+  EXPECT_EQ(rom.encode_cache().misses(), 3);
+  EXPECT_EQ(rom.encode_cache().hits(), 0);
+  const auto first = tables(rom);
+
+  rom.commit();
+  EXPECT_EQ(rom.encode_cache().misses(), 3);
+  EXPECT_EQ(rom.encode_cache().hits(), 3);
+  EXPECT_EQ(tables(rom), first);
+
+  rom.song(Rom::SongTitle::TownTheme).pattern(1) = {
+      0x18, Pattern::parse_notes("E5.8 A4"), {}, {}, {}};
+  rom.commit();
+  EXPECT_EQ(rom.encode_cache().misses(), 4);
+  EXPECT_EQ(rom.encode_cache().hits(), 5);
+
+  // Same result as encoding everything from scratch
+  FakeRom fresh;
+  add_songs(fresh);
+  fresh.song(Rom::SongTitle::TownTheme).pattern(1) = {
+      0x18, Pattern::parse_notes("E5.8 A4"), {}, {}, {}};
+  fresh.commit();
+  EXPECT_EQ(tables(rom), tables(fresh));
+}
+
+TEST(EncodeCacheTest, ParallelEncodingMatches) {
+  auto build = [](size_t threads) {
+    FakeRom rom;
+    rom.set_encode_threads(threads);
+    Song& town = rom.song(Rom::SongTitle::TownTheme);
+    std::vector<byte> sequence;
+    for (int i = 0; i < 40; ++i) {
+      const std::string notes = i % 2 ? "A4.4 C5 E5.8 r" : "E5.8 A4 r.4 C5";
+      town.add_pattern({0x18, Pattern::parse_notes(notes, i / 2), {}, {}, {}});
+      sequence.push_back(i);
+    }
+    town.set_sequence(sequence);
+    rom.commit();
+    EXPECT_EQ(rom.encode_cache().misses(), 40);
+    return tables(rom);
+  };
+
+  EXPECT_EQ(build(4), build(1));
+}
+
+TEST(EncodeCacheTest, SaveAndLoad) {
+  const std::string filename = ::testing::TempDir() + "/patterns.z2ec";
+
+  FakeRom rom;
+  add_songs(rom);
+  rom.commit();
+  ASSERT_TRUE(rom.encode_cache().save(filename));
+
+  FakeRom other;
+  add_songs(other);
+  ASSERT_TRUE(other.encode_cache().load(filename));
+  EXPECT_EQ(other.encode_cache().size(), 3);
+
+  other.commit();
+  EXPECT_EQ(other.encode_cache().hits(), 3);
+  EXPECT_EQ(other.encode_cache().misses(), 0);
+  EXPECT_EQ(tables(other), tables(rom));
+
+  std::string data;
+  {
+    std::ifstream file(filename, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), {});
+  }
+  data.back() ^= 0x55;
+  {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file << data;
+  }
+
+  EncodeCache cache;
+  EXPECT_FALSE(cache.load(filename));
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(EncodeCacheTest, LoadKeepsEntriesInMemory) {
+  const std::string filename = ::testing::TempDir() + "/newer.z2ec";
+
+  EncodeCache saved;
+  saved.insert("a", {{0x01}, {1, 0, 0, 0}});
+  saved.insert("b", {{0x02}, {1, 0, 0, 0}});
+  ASSERT_TRUE(saved.save(filename));
+
+  EncodeCache cache;
+  cache.insert("a", {{0x03}, {1, 0, 0, 0}});
+  ASSERT_TRUE(cache.load(filename));
+  EXPECT_EQ(cache.size(), 2);
+
+  const auto* a = cache.find("a");
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(a->data, std::vector<byte>{0x03});
+  const auto* b = cache.find("b");
+  ASSERT_NE(b, nullptr);
+  EXPECT_EQ(b->data, std::vector<byte>{0x02});
+}
+
+}  // namespace
+}  // namespace z2music
@@ -1,6 +1,9 @@
 #include "fake_rom.h"
 
+#include <algorithm>
+
 #include "pitch.h"
+#include "rom_layout.h"
 #include "util.h"
 
 namespace z2music {
@@ -53,4 +56,27 @@ void FakeRom::add_pattern(Address address, byte tempo,
   write(0x10000 + offset, data);
 }
 
+void FakeRom::make_decodable() {
+  const RomLayout& layout = this->layout();
+  for (const auto& table : layout.tables) {
+    putc(table.loader, 0xb9);
+    putw(table.loader + 1, table.address - layout.bank_offset);
+  }
+
+  Address address = layout.duration_lut.address;
+  for (const auto& row : duration_lut().rows()) {
+    for (byte b : row.values()) putc(address++, b);
+  }
+  address = layout.title_duration_lut.address;
+  for (const auto& row : title_duration_lut().rows()) {
+    for (byte b : row.values()) putc(address++, b);
+  }
+
+  const PitchLUT& lut = title_pitch_lut();
+  for (byte i = 0; i < std::min(lut.size(), layout.title_pitch_lut.entries);
+       ++i) {
+    putwr(layout.title_pitch_lut.address + i * 2, lut.at(i * 2).timer());
+  }
+}
+
 }  // namespace z2music
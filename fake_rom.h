@@ -11,6 +11,10 @@ class FakeRom : public Rom {
   FakeRom();
 
   void add_pattern(Address address, byte tempo, const std::vector<byte>& data);
+
+  // Writes the song table loaders, both duration LUTs and the title pitch
+  // LUT, which committing leaves alone, so that the image can be decoded.
+  void make_decodable();
   Pattern read_pattern(Address address) {
     return Rom::read_pattern(0x10000 + address);
   }
@@ -0,0 +1,52 @@
+#include "incremental_parser.h"
+
+#include <utility>
+#include <vector>
+
+namespace z2music {
+
+const Project& IncrementalParser::parse(std::string_view text) {
+  const auto blocks = Project::split_blocks(text);
+  blocks_ = blocks.size();
+  parsed_ = 0;
+
+  // Only blocks still in the file are kept, so the cache doesn't grow with
+  // every edit.
+  std::unordered_map<std::string, Project> cache;
+
+  project_ = Project();
+  size_t line = 1;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    const std::string key(blocks[i]);
+    const Project* block;
+
+    if (i + 1 == blocks.size()) {
+      // The last block ends the file, which has warnings of its own
+      if (!last_ || key != last_text_) {
+        last_text_ = key;
+        last_ = Project::parse_block(key, true, layout_);
+        ++parsed_;
+      }
+      block = &*last_;
+
+    } else if (auto it = cache.find(key); it != cache.end()) {
+      block = &it->second;
+
+    } else if (auto old = cache_.find(key); old != cache_.end()) {
+      block = &cache.emplace(key, std::move(old->second)).first->second;
+
+    } else {
+      block = &cache.emplace(key, Project::parse_block(key, false, layout_))
+                   .first->second;
+      ++parsed_;
+    }
+
+    project_.append(*block, line);
+    line += block->lines();
+  }
+
+  cache_ = std::move(cache);
+  return project_;
+}
+
+}  // namespace z2music
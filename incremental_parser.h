@@ -0,0 +1,42 @@
+#ifndef Z2MUSIC_INCREMENTAL_PARSER_H_
+#define Z2MUSIC_INCREMENTAL_PARSER_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "project.h"
+
+namespace z2music {
+
+// Parses a project file one song block at a time, keeping the results so that
+// parsing the file again after an edit only parses the songs which changed.
+// A block runs from one song line to the next, and the result is the same as
+// Project::parse on the whole file.
+class IncrementalParser {
+ public:
+  explicit IncrementalParser(
+      const RomLayout& layout = RevisionLayout<Revision::US>::kLayout)
+      : layout_(layout) {}
+
+  const Project& parse(std::string_view text);
+
+  // Blocks in the last file parsed, and how many of them had to be parsed
+  size_t blocks() const { return blocks_; }
+  size_t parsed() const { return parsed_; }
+
+ private:
+  const RomLayout& layout_;
+  Project project_;
+  std::unordered_map<std::string, Project> cache_;
+  std::string last_text_;
+  std::optional<Project> last_;
+
+  size_t blocks_ = 0;
+  size_t parsed_ = 0;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_INCREMENTAL_PARSER_H_
@@ -0,0 +1,76 @@
+#include "incremental_parser.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "project.h"
+
+namespace z2music {
+namespace {
+
+const std::string kProject =
+    "loader Town 0x1a400\n"
+    "song TownTheme\n"
+    "pattern 0x18\n"
+    "a4.4 c5 e5 a5\n"
+    "song BattleTheme\n"  // a channel line, not a new song
+    "\n"
+    "x.8 x\n"
+    "song HouseTheme\n"
+    "pattern 0x18\n"
+    "a4.4\n\n\n\n"
+    "song PalaceTheme\n"
+    "pattern 0x20\n"
+    "e5.8 q\n\n\n\n"
+    "sequence 1 2\n"
+    "song BossTheme\n"
+    "pattern 0x18\n"
+    "a4.4\n\n\n\n";
+
+void expect_same(const Project& a, const Project& b) {
+  EXPECT_EQ(a.to_binary(), b.to_binary());
+  EXPECT_EQ(a.lines(), b.lines());
+  ASSERT_EQ(a.diagnostics().size(), b.diagnostics().size());
+  for (size_t i = 0; i < a.diagnostics().size(); ++i) {
+    const auto& x = a.diagnostics()[i];
+    const auto& y = b.diagnostics()[i];
+    EXPECT_EQ(x.level, y.level);
+    EXPECT_EQ(x.line, y.line);
+    EXPECT_EQ(x.column, y.column);
+    EXPECT_EQ(x.message, y.message);
+  }
+}
+
+TEST(IncrementalParserTest, MatchesFullParse) {
+  IncrementalParser parser;
+  const Project& project = parser.parse(kProject);
+
+  EXPECT_EQ(parser.blocks(), 5);
+  EXPECT_EQ(parser.parsed(), 5);
+
+  const Project full = Project::parse(kProject);
+  EXPECT_FALSE(full.ok());
+  expect_same(project, full);
+}
+
+TEST(IncrementalParserTest, ReparsesChangedSongs) {
+  IncrementalParser parser;
+  parser.parse(kProject);
+
+  std::string edited = kProject;
+  edited.replace(edited.find("e5.8 q"), 6, "e5.8 r.4 a5");
+  edited.replace(edited.find("sequence 1 2"), 12, "sequence 1 1");
+  const Project& project = parser.parse(edited);
+
+  EXPECT_EQ(parser.parsed(), 1);
+  EXPECT_TRUE(project.ok());
+  expect_same(project, Project::parse(edited));
+
+  // Adding a line moves the diagnostics of every later song
+  edited.insert(0, "\n");
+  expect_same(parser.parse(edited), Project::parse(edited));
+  EXPECT_EQ(parser.parsed(), 1);
+}
+
+}  // namespace
+}  // namespace z2music
@@ -0,0 +1,104 @@
+#include "ips.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace z2music {
+
+namespace {
+
+constexpr std::string_view kHeader = "PATCH";
+constexpr std::string_view kFooter = "EOF";
+constexpr size_t kMaxOffset = 0xffffff;
+constexpr size_t kMaxRecord = 0xffff;
+// An offset which reads as the footer
+constexpr size_t kFooterOffset = 0x454f46;
+// Bytes it costs to start another record
+constexpr size_t kRecordHeader = 5;
+
+void put(std::string& out, uint32_t value, size_t bytes) {
+  while (bytes-- > 0) out += static_cast<char>((value >> (8 * bytes)) & 0xff);
+}
+
+uint32_t get(std::string_view data, size_t& pos, size_t bytes) {
+  uint32_t value = 0;
+  while (bytes-- > 0) value = (value << 8) | static_cast<uint8_t>(data[pos++]);
+  return value;
+}
+
+}  // namespace
+
+std::string make_ips(std::string_view original, std::string_view modified) {
+  const size_t size = std::min(modified.size(), kMaxOffset);
+  auto differs = [&](size_t i) {
+    return i >= original.size() || original[i] != modified[i];
+  };
+
+  std::string patch(kHeader);
+  size_t i = 0;
+  while (i < size) {
+    if (!differs(i)) {
+      ++i;
+      continue;
+    }
+
+    // Back up a byte rather than write an offset which looks like the end
+    size_t start = i == kFooterOffset ? i - 1 : i;
+    size_t end = i;
+    while (end < size && end - start < kMaxRecord) {
+      if (differs(end)) {
+        ++end;
+        continue;
+      }
+
+      // Carry a short run of unchanged bytes if it's cheaper than a new record
+      size_t next = end;
+      while (next < size && next - end < kRecordHeader && !differs(next)) {
+        ++next;
+      }
+      if (next == size || !differs(next) || next - start >= kMaxRecord) break;
+      end = next;
+    }
+
+    put(patch, start, 3);
+    put(patch, end - start, 2);
+    patch.append(modified.substr(start, end - start));
+    i = end;
+  }
+
+  patch.append(kFooter);
+  return patch;
+}
+
+std::optional<std::string> apply_ips(std::string_view original,
+                                     std::string_view patch) {
+  if (patch.substr(0, kHeader.size()) != kHeader) return std::nullopt;
+
+  std::string image(original);
+  size_t pos = kHeader.size();
+  while (true) {
+    if (patch.size() - pos < kFooter.size()) return std::nullopt;
+    if (patch.substr(pos, kFooter.size()) == kFooter) break;
+    if (patch.size() - pos < kRecordHeader) return std::nullopt;
+
+    const size_t offset = get(patch, pos, 3);
+    size_t length = get(patch, pos, 2);
+    std::string data;
+    if (length > 0) {
+      if (patch.size() - pos < length) return std::nullopt;
+      data = patch.substr(pos, length);
+      pos += length;
+    } else {
+      if (patch.size() - pos < 3) return std::nullopt;
+      length = get(patch, pos, 2);
+      data.assign(length, patch[pos++]);
+    }
+
+    if (image.size() < offset + length) image.resize(offset + length);
+    image.replace(offset, length, data);
+  }
+
+  return image;
+}
+
+}  // namespace z2music
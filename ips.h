@@ -0,0 +1,24 @@
+#ifndef Z2MUSIC_IPS_H_
+#define Z2MUSIC_IPS_H_
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace z2music {
+
+// IPS patches, the usual way to hand out ROM hacks.  A patch is "PATCH", then
+// records of a 24 bit offset, a 16 bit size and that many bytes, then "EOF".
+// A record with a size of 0 is instead a 16 bit count and one byte to repeat.
+// Everything is big endian.
+
+// Makes a patch which turns the original into the modified image.
+std::string make_ips(std::string_view original, std::string_view modified);
+
+// Returns nullopt if the patch isn't valid.
+std::optional<std::string> apply_ips(std::string_view original,
+                                     std::string_view patch);
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_IPS_H_
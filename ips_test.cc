@@ -0,0 +1,49 @@
+#include "ips.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace z2music {
+namespace {
+
+TEST(IpsTest, RoundTrip) {
+  const std::string original(0x1000, '\x11');
+  std::string modified = original;
+  modified[0] = 'a';
+  modified.replace(0x100, 4, "abcd");
+  // Close enough to share a record with the change before it
+  modified[0x106] = 'e';
+  modified.back() = 'z';
+  modified += "tail";
+
+  const std::string patch = make_ips(original, modified);
+  EXPECT_EQ(patch.substr(0, 5), "PATCH");
+  EXPECT_EQ(patch.substr(patch.size() - 3), "EOF");
+  EXPECT_EQ(patch.size(), 5 + (5 + 1) + (5 + 7) + (5 + 5) + 3);
+
+  const auto patched = apply_ips(original, patch);
+  ASSERT_TRUE(patched.has_value());
+  EXPECT_EQ(*patched, modified);
+
+  EXPECT_EQ(make_ips(original, original), "PATCHEOF");
+}
+
+TEST(IpsTest, RunLengthRecords) {
+  // 0x000010, size 0, 3 copies of 'x'
+  const std::string patch("PATCH\0\0\x10\0\0\0\x03xEOF", 16);
+  const auto patched = apply_ips(std::string(0x14, '.'), patch);
+  ASSERT_TRUE(patched.has_value());
+  EXPECT_EQ(*patched, std::string(0x10, '.') + "xxx.");
+}
+
+TEST(IpsTest, RejectsBadPatches) {
+  EXPECT_FALSE(apply_ips("abc", "PATCX").has_value());
+  // Shorter than the record says
+  EXPECT_FALSE(
+      apply_ips("abc", std::string("PATCH\0\0\0\0\x05xy", 12)).has_value());
+  EXPECT_FALSE(apply_ips("abc", "PATCH").has_value());
+}
+
+}  // namespace
+}  // namespace z2music
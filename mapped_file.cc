@@ -0,0 +1,70 @@
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <sstream>
+#endif
+
+#include "absl/log/log.h"
+
+namespace z2music {
+
+#ifndef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) {
+  const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOG(ERROR) << "Unable to open " << filename;
+    return;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) == 0) {
+    length_ = info.st_size;
+    // Mapping an empty file fails, but there's nothing to read anyway
+    if (length_ == 0) {
+      ok_ = true;
+    } else {
+      void* mapping = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+        mapping_ = mapping;
+        data_ = std::string_view(static_cast<const char*>(mapping), length_);
+        ok_ = true;
+      }
+    }
+  }
+
+  close(fd);
+  if (!ok_) LOG(ERROR) << "Unable to map " << filename;
+}
+
+MappedFile::~MappedFile() {
+  if (mapping_) munmap(mapping_, length_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    LOG(ERROR) << "Unable to open " << filename;
+    return;
+  }
+
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  buffer_ = contents.str();
+  data_ = buffer_;
+  ok_ = true;
+}
+
+MappedFile::~MappedFile() {}
+
+#endif
+
+}  // namespace z2music
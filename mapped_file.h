@@ -0,0 +1,33 @@
+#ifndef Z2MUSIC_MAPPED_FILE_H_
+#define Z2MUSIC_MAPPED_FILE_H_
+
+#include <string>
+#include <string_view>
+
+namespace z2music {
+
+// A read only view of a whole file, mapped into memory where the platform
+// supports it and read into a buffer where it doesn't.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool ok() const { return ok_; }
+  std::string_view data() const { return data_; }
+
+ private:
+  bool ok_ = false;
+  std::string_view data_;
+  // Only used where files can't be mapped
+  std::string buffer_;
+  void* mapping_ = nullptr;
+  size_t length_ = 0;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_MAPPED_FILE_H_
@@ -0,0 +1,33 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace z2music {
+namespace {
+
+TEST(MappedFileTest, MapsWholeFile) {
+  const std::string filename = ::testing::TempDir() + "/mapped_file_test";
+  const std::string contents("some\0bytes", 10);
+  {
+    std::ofstream file(filename, std::ios::binary);
+    file << contents;
+  }
+
+  const MappedFile mapped(filename);
+  ASSERT_TRUE(mapped.ok());
+  EXPECT_EQ(mapped.data(), contents);
+
+  {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  }
+  EXPECT_TRUE(MappedFile(filename).ok());
+  EXPECT_TRUE(MappedFile(filename).data().empty());
+
+  EXPECT_FALSE(MappedFile(filename + ".missing").ok());
+}
+
+}  // namespace
+}  // namespace z2music
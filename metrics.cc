@@ -0,0 +1,121 @@
+#include "metrics.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+
+#include "registry.h"
+
+namespace z2music {
+
+namespace {
+
+constexpr std::array<std::string_view, 7> kStageNames = {
+    "load", "decode", "parse", "pitch_lut", "encode", "commit", "save",
+};
+
+constexpr std::array<std::string_view, 7> kCounterNames = {
+    "notes_encoded",    "durations_rounded", "durations_adjusted",
+    "duration_lookups", "pitch_lookups",     "patterns_cached",
+    "patterns_encoded",
+};
+
+double millis(int64_t nanos) { return nanos / 1e6; }
+
+}  // namespace
+
+std::atomic<bool> Metrics::enabled_{false};
+std::array<Metrics::Totals, Metrics::kStages> Metrics::stages_;
+std::array<Metrics::Totals, kSongTables> Metrics::tables_;
+std::array<std::atomic<int64_t>, Metrics::kCounters> Metrics::counters_;
+
+Metrics::Timer::Timer(Stage stage) {
+  if (enabled()) start(stages_[index(stage)]);
+}
+
+Metrics::Timer::Timer(SongTable table) {
+  if (enabled()) start(tables_[index(table)]);
+}
+
+void Metrics::Timer::start(Totals& totals) {
+  totals_ = &totals;
+  if (AllocTracker::enabled()) heap_.emplace();
+  start_ = std::chrono::steady_clock::now();
+}
+
+Metrics::Timer::~Timer() {
+  if (!totals_) return;
+  const auto elapsed = std::chrono::steady_clock::now() - start_;
+  add(totals_->nanos,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  add(totals_->calls, 1);
+
+  if (!heap_) return;
+  const AllocTracker::Stats heap = heap_->stats();
+  add(totals_->allocs, heap.allocs);
+  add(totals_->alloc_bytes, heap.bytes);
+  int64_t peak = totals_->peak_bytes.load(std::memory_order_relaxed);
+  while (heap.peak > peak &&
+         !totals_->peak_bytes.compare_exchange_weak(peak, heap.peak)) {
+  }
+}
+
+void Metrics::reset() {
+  for (auto& totals : stages_) {
+    totals.calls = 0;
+    totals.nanos = 0;
+    totals.allocs = 0;
+    totals.alloc_bytes = 0;
+    totals.peak_bytes = 0;
+  }
+  for (auto& totals : tables_) {
+    totals.calls = 0;
+    totals.nanos = 0;
+    totals.bytes = 0;
+  }
+  for (auto& counter : counters_) counter = 0;
+}
+
+std::string Metrics::json() {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+
+  out << "{\n  \"stages\": {";
+  for (size_t i = 0; i < kStages; ++i) {
+    out << (i > 0 ? "," : "") << "\n    \"" << kStageNames[i]
+        << "\": {\"calls\": " << stages_[i].calls
+        << ", \"ms\": " << millis(stages_[i].nanos);
+    if (AllocTracker::installed() && AllocTracker::enabled()) {
+      out << ", \"allocs\": " << stages_[i].allocs
+          << ", \"alloc_bytes\": " << stages_[i].alloc_bytes
+          << ", \"peak_bytes\": " << stages_[i].peak_bytes;
+    }
+    out << "}";
+  }
+
+  out << "\n  },\n  \"counters\": {";
+  for (size_t i = 0; i < kCounters; ++i) {
+    out << (i > 0 ? "," : "") << "\n    \"" << kCounterNames[i]
+        << "\": " << counters_[i];
+  }
+
+  out << "\n  },\n  \"tables\": {";
+  for (size_t i = 0; i < kSongTables; ++i) {
+    out << (i > 0 ? "," : "") << "\n    \"" << kLoaders[i].name
+        << "\": {\"commits\": " << tables_[i].calls
+        << ", \"ms\": " << millis(tables_[i].nanos)
+        << ", \"bytes\": " << tables_[i].bytes << "}";
+  }
+  out << "\n  }\n}\n";
+
+  return out.str();
+}
+
+bool Metrics::write(const std::string& filename) {
+  std::ofstream file(filename, std::ios::binary);
+  file << json();
+  return static_cast<bool>(file);
+}
+
+}  // namespace z2music
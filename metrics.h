@@ -0,0 +1,111 @@
+#ifndef Z2MUSIC_METRICS_H_
+#define Z2MUSIC_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "alloc_tracker.h"
+#include "rom_layout.h"
+
+namespace z2music {
+
+// Counters and wall timers for where the tools spend their time.  Everything
+// is always compiled in, but collection is off until enable() is called, and
+// until then each counter or timer costs a single relaxed load.  The totals
+// are shared by every thread, so parallel encoding adds up too.  If the
+// AllocTracker is enabled as well, each stage also counts its heap use.
+class Metrics {
+  struct Totals;
+
+ public:
+  enum class Stage {
+    Load,
+    Decode,
+    Parse,
+    PitchLUT,
+    Encode,
+    Commit,
+    Save,
+  };
+
+  enum class Counter {
+    NotesEncoded,
+    DurationsRounded,
+    DurationsAdjusted,
+    DurationLookups,
+    PitchLookups,
+    PatternsCached,
+    PatternsEncoded,
+  };
+
+  // Times a stage, or a song table if one is given, until destroyed.
+  class Timer {
+   public:
+    explicit Timer(Stage stage);
+    explicit Timer(SongTable table);
+    ~Timer();
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+   private:
+    void start(Totals& totals);
+
+    Totals* totals_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+    std::optional<AllocTracker::Scope> heap_;
+  };
+
+  static void enable() { enabled_.store(true, std::memory_order_relaxed); }
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static void reset();
+
+  static void count(Counter counter, int64_t n = 1) {
+    if (enabled()) add(counters_[index(counter)], n);
+  }
+  static void table_bytes(SongTable table, int64_t n) {
+    if (enabled()) add(tables_[index(table)].bytes, n);
+  }
+
+  static int64_t get(Counter counter) {
+    return counters_[index(counter)].load(std::memory_order_relaxed);
+  }
+
+  // Everything collected so far, as a JSON object
+  static std::string json();
+  static bool write(const std::string& filename);
+
+ private:
+  static constexpr size_t kStages = 7;
+  static constexpr size_t kCounters = 7;
+
+  struct Totals {
+    std::atomic<int64_t> calls{0};
+    std::atomic<int64_t> nanos{0};
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> allocs{0};
+    std::atomic<int64_t> alloc_bytes{0};
+    std::atomic<int64_t> peak_bytes{0};
+  };
+
+  static std::atomic<bool> enabled_;
+  static std::array<Totals, kStages> stages_;
+  static std::array<Totals, kSongTables> tables_;
+  static std::array<std::atomic<int64_t>, kCounters> counters_;
+
+  template <typename T>
+  static size_t index(T t) {
+    return static_cast<size_t>(t);
+  }
+  static void add(std::atomic<int64_t>& total, int64_t n) {
+    total.fetch_add(n, std::memory_order_relaxed);
+  }
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_METRICS_H_
@@ -0,0 +1,51 @@
+#include "metrics.h"
+
+#include <string>
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "rom.h"
+
+namespace z2music {
+namespace {
+
+void commit_town(FakeRom& rom) {
+  Song& song = rom.song(Rom::SongTitle::TownTheme);
+  song.add_pattern({0x18, Pattern::parse_notes("A4.4 C5 E5 A5"), {}, {}, {}});
+  song.set_sequence({0});
+  rom.commit();
+}
+
+TEST(MetricsTest, OffUntilEnabled) {
+  Metrics::reset();
+  FakeRom rom;
+  commit_town(rom);
+  EXPECT_EQ(Metrics::get(Metrics::Counter::NotesEncoded), 0);
+  EXPECT_EQ(Metrics::get(Metrics::Counter::PitchLookups), 0);
+}
+
+TEST(MetricsTest, CountsCommits) {
+  Metrics::reset();
+  Metrics::enable();
+  FakeRom rom;
+  commit_town(rom);
+
+  EXPECT_EQ(Metrics::get(Metrics::Counter::NotesEncoded), 4);
+  EXPECT_EQ(Metrics::get(Metrics::Counter::DurationLookups), 4);
+  EXPECT_GE(Metrics::get(Metrics::Counter::PitchLookups), 4);
+  EXPECT_EQ(Metrics::get(Metrics::Counter::PatternsEncoded), 1);
+
+  // Committing again finds the pattern in the encode cache
+  rom.commit();
+  EXPECT_EQ(Metrics::get(Metrics::Counter::PatternsCached), 1);
+  EXPECT_EQ(Metrics::get(Metrics::Counter::NotesEncoded), 4);
+
+  const std::string json = Metrics::json();
+  EXPECT_NE(json.find("\"commit\": {\"calls\": 2,"), std::string::npos);
+  EXPECT_NE(json.find("\"Town\": {\"commits\": 2,"), std::string::npos);
+  EXPECT_NE(json.find("\"notes_encoded\": 4"), std::string::npos);
+}
+
+}  // namespace
+}  // namespace z2music
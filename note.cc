@@ -1,16 +1,26 @@
 #include "note.h"
 
+#include <charconv>
+
 #include "absl/log/log.h"
 
 namespace z2music {
 
 std::string Note::duration_string() const {
+  char buffer[kMaxDurationLength];
+  return std::string(buffer, format_duration(buffer));
+}
+
+size_t Note::format_duration(char* out) const {
+  char* const end = out + kMaxDurationLength;
   if (ticks_ % Duration::Sixteenth == 0) {
-    return std::to_string(ticks_ / Duration::Sixteenth);
+    return std::to_chars(out, end, ticks_ / Duration::Sixteenth).ptr - out;
   } else {
     int length =
         std::round(ticks_ * 2 / static_cast<float>(Duration::EighthTriplet));
-    return std::to_string(length) + "t";
+    char* p = std::to_chars(out, end, length).ptr;
+    *p++ = 't';
+    return p - out;
   }
 }
 
@@ -1,6 +1,7 @@
 #ifndef Z2MUSIC_NOTE_H_
 #define Z2MUSIC_NOTE_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <string>
@@ -31,27 +32,41 @@ class Note {
     Unknown = -1,
   };
 
-  Note(Pitch pitch, int ticks) : pitch_(pitch), ticks_(ticks) {}
-  static Note rest(int ticks) { return Note{Pitch::none(), ticks}; }
+  // Longer than any note the game or a binary project can store.  Notes are
+  // packed into 32 bits, so anything longer is cut short.
+  static constexpr int kMaxTicks = 0xffff;
 
-  int ticks() const { return ticks_; }
-  Pitch pitch() const { return pitch_; }
+  constexpr Note(Pitch pitch, int ticks)
+      : timer_(pitch.timer()), ticks_(std::clamp(ticks, 0, kMaxTicks)) {}
+  static constexpr Note rest(int ticks) { return Note{Pitch::none(), ticks}; }
+
+  constexpr int ticks() const { return ticks_; }
+  constexpr Pitch pitch() const { return Pitch(WordBE(timer_)); }
 
   std::string duration_string() const;
+  // Writes the same text as duration_string() without allocating and returns
+  // its length.  The buffer needs room for kMaxDurationLength chars.
+  size_t format_duration(char* out) const;
+  static constexpr size_t kMaxDurationLength = 16;
 
   std::string to_string() const {
-    return pitch_.to_string() + "." + duration_string();
+    return pitch().to_string() + "." + duration_string();
   }
 
-  bool operator==(Note other) const {
-    return pitch_ == other.pitch_ && ticks_ == other.ticks_;
-  }
+  // The same timer for the same time, without going through Pitch::midi()
+  bool operator==(Note other) const { return packed() == other.packed(); }
 
  private:
-  Pitch pitch_;
-  int ticks_;
+  uint16_t timer_;
+  uint16_t ticks_;
+
+  constexpr uint32_t packed() const {
+    return static_cast<uint32_t>(timer_) << 16 | ticks_;
+  }
 };
 
+static_assert(sizeof(Note) == 4);
+
 std::ostream& operator<<(std::ostream& os, Note n);
 
 }  // namespace z2music
@@ -0,0 +1,83 @@
+#ifndef Z2MUSIC_NOTE_LITERAL_H_
+#define Z2MUSIC_NOTE_LITERAL_H_
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "note.h"
+#include "note_parser.h"
+#include "pitch.h"
+
+namespace z2music {
+
+// A string literal usable as a template argument.
+template <size_t N>
+struct NoteString {
+  char data[N];
+
+  consteval NoteString(const char (&s)[N]) {
+    for (size_t i = 0; i < N; ++i) data[i] = s[i];
+  }
+
+  constexpr std::string_view view() const { return {data, N - 1}; }
+};
+
+// Notes parsed at compile time.  They convert to the vectors Pattern takes,
+// so embedded songs don't parse anything or touch floats at startup.
+template <size_t N>
+struct NoteArray : std::array<Note, N> {
+  operator std::vector<Note>() const { return {this->begin(), this->end()}; }
+};
+
+// Not constexpr, so reaching it while parsing a literal is a compile error
+// which names the problem.
+inline void note_string_has_unparseable_characters() {}
+
+template <NoteString S, int Transpose = 0>
+consteval auto parse_notes() {
+  constexpr size_t kCount = [] {
+    size_t count = 0;
+    NoteParser::parse(
+        S.view(), Transpose, [&count](Note) { ++count; },
+        [](size_t, NoteParser::Problem, char) {
+          note_string_has_unparseable_characters();
+        });
+    return count;
+  }();
+
+  struct Packed {
+    WordBE timer;
+    int ticks;
+  };
+  std::array<Packed, kCount> packed{};
+
+  size_t i = 0;
+  NoteParser::parse(
+      S.view(), Transpose,
+      [&packed, &i](Note note) {
+        packed[i++] = {note.pitch().timer(), note.ticks()};
+      },
+      [](size_t, NoteParser::Problem, char) {});
+
+  return [&packed]<size_t... I>(std::index_sequence<I...>) {
+    return NoteArray<kCount>{
+        {Note(Pitch(packed[I].timer), packed[I].ticks)...}};
+  }(std::make_index_sequence<kCount>());
+}
+
+namespace literals {
+
+// "a4.4 c5 e5"_notes is the same as Pattern::parse_notes("a4.4 c5 e5").
+template <NoteString S>
+consteval auto operator""_notes() {
+  return parse_notes<S>();
+}
+
+}  // namespace literals
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_NOTE_LITERAL_H_
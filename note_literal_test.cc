@@ -0,0 +1,36 @@
+#include "note_literal.h"
+
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "pitch.h"
+
+namespace z2music {
+
+using namespace literals;
+
+constexpr auto kMelody = "a4.4 c5 e5.2t r.1 x"_notes;
+
+static_assert(kMelody.size() == 5);
+static_assert(kMelody[0].pitch().timer() == Pitch(Pitch::A4).timer());
+static_assert(kMelody[0].ticks() == Note::Duration::Quarter);
+static_assert(kMelody[2].ticks() == Note::Duration::EighthTriplet);
+static_assert(kMelody[3].pitch().timer() == 0);
+static_assert(""_notes.size() == 0);
+
+TEST(NoteLiteralTest, MatchesRuntimeParser) {
+  const std::vector<Note> parsed = Pattern::parse_notes("a4.4 c5 e5.2t r.1 x");
+  const std::vector<Note> literal = kMelody;
+  EXPECT_EQ(literal, parsed);
+
+  constexpr auto transposed = parse_notes<"c4.8 d4 bb3", 2>();
+  EXPECT_EQ(std::vector<Note>(transposed),
+            Pattern::parse_notes("c4.8 d4 bb3", 2));
+}
+
+TEST(NoteLiteralTest, BuildsPatterns) {
+  const Pattern pattern{0x18, "a4.4 c5"_notes, "r.8"_notes, {}, {}};
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse1), "A4.4 C5");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse2), "r.8");
+}
+
+}  // namespace z2music
@@ -0,0 +1,195 @@
+#ifndef Z2MUSIC_NOTE_PARSER_H_
+#define Z2MUSIC_NOTE_PARSER_H_
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "note.h"
+#include "pitch.h"
+
+namespace z2music {
+
+// The text format for notes, e.g. "a4.4 c#5 r.8t".  Everything here is
+// constexpr so the same rules can be used both at runtime and on literals.
+class NoteParser {
+ public:
+  enum class Problem { UnsupportedOctave, UnknownChar };
+
+  // Calls emit(Note) for every note in data, and warn(offset, problem, char)
+  // for anything that can't be parsed.
+  template <typename Emit, typename Warn>
+  static constexpr void parse(std::string_view data, int transpose,
+                              Emit&& emit, Warn&& warn);
+
+  static constexpr Note build_note(int pitch, int octave, int duration,
+                                   bool triplet, int transpose) {
+    const int note = pitch > 0 ? pitch + 12 * octave + 11 + transpose : 0;
+    const int ticks = (triplet ? 4 : 6) * 4 * duration;
+    return Note(
+        note == 0 ? Pitch::none() : Pitch(static_cast<Pitch::Midi>(note)),
+        ticks);
+  }
+
+ private:
+  enum class Kind : uint8_t {
+    Other,
+    Step,
+    Flat,
+    Sharp,
+    Digit,
+    Dot,
+    Triplet,
+    Drum,
+    Rest,
+    Space,
+  };
+
+  struct CharClass {
+    Kind kind;
+    uint8_t value;
+  };
+
+  static constexpr CharClass classify(char c);
+  static const std::array<CharClass, 256> kCharClasses;
+};
+
+constexpr NoteParser::CharClass NoteParser::classify(char c) {
+  switch (c) {
+    case 'C':
+    case 'c':
+      return {Kind::Step, 1};
+    case 'D':
+    case 'd':
+      return {Kind::Step, 3};
+    case 'E':
+    case 'e':
+      return {Kind::Step, 5};
+    case 'F':
+    case 'f':
+      return {Kind::Step, 6};
+    case 'G':
+    case 'g':
+      return {Kind::Step, 8};
+    case 'A':
+    case 'a':
+      return {Kind::Step, 10};
+    case 'B':
+      return {Kind::Step, 12};
+
+    case 'b':
+      // flat if pitch is already set, otherwise b note
+      return {Kind::Flat, 0};
+
+    case '#':
+    case 's':
+      return {Kind::Sharp, 0};
+
+    case '.':
+      return {Kind::Dot, 0};
+    case 't':
+      return {Kind::Triplet, 0};
+
+    case 'x':
+      // snare drum (G#3)
+      return {Kind::Drum, 0};
+
+    case 'r':
+    case '-':
+      return {Kind::Rest, 0};
+
+    case ' ':
+      return {Kind::Space, 0};
+
+    default:
+      if (c >= '0' && c <= '9') return {Kind::Digit, uint8_t(c - '0')};
+      return {Kind::Other, 0};
+  }
+}
+
+inline constexpr std::array<NoteParser::CharClass, 256>
+    NoteParser::kCharClasses = [] {
+      std::array<CharClass, 256> classes{};
+      for (size_t i = 0; i < classes.size(); ++i) {
+        classes[i] = classify(static_cast<char>(i));
+      }
+      return classes;
+    }();
+
+template <typename Emit, typename Warn>
+constexpr void NoteParser::parse(std::string_view data, int transpose,
+                                 Emit&& emit, Warn&& warn) {
+  int duration = 0;
+  int pitch = 0;
+  int octave = 0;
+  bool triplet = false;
+
+  for (size_t i = 0; i < data.size(); ++i) {
+    const CharClass c = kCharClasses[static_cast<uint8_t>(data[i])];
+
+    switch (c.kind) {
+      case Kind::Step:
+        pitch = c.value;
+        break;
+
+      case Kind::Flat:
+        pitch = pitch == 0 ? 12 : pitch - 1;
+        break;
+
+      case Kind::Sharp:
+        ++pitch;
+        break;
+
+      case Kind::Digit:
+        if (octave != 0) {
+          duration = duration * 10 + c.value;
+        } else if (c.value >= 1 && c.value <= 8) {
+          octave = c.value;
+        } else {
+          warn(i, Problem::UnsupportedOctave, data[i]);
+        }
+        break;
+
+      case Kind::Dot:
+        duration = 0;
+        triplet = false;
+        break;
+
+      case Kind::Triplet:
+        triplet = true;
+        break;
+
+      case Kind::Drum:
+        pitch = 9;
+        octave = 3;
+        break;
+
+      case Kind::Rest:
+        pitch = -1;
+        octave = -1;
+        break;
+
+      case Kind::Space:
+        if (pitch && octave && duration) {
+          emit(build_note(pitch, octave, duration, triplet, transpose));
+          // Keep duration for later notes, but reset pitch and octave
+          pitch = 0;
+          octave = 0;
+        }
+        break;
+
+      case Kind::Other:
+        warn(i, Problem::UnknownChar, data[i]);
+        break;
+    }
+  }
+
+  // Add final note
+  if (pitch && octave && duration) {
+    emit(build_note(pitch, octave, duration, triplet, transpose));
+  }
+}
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_NOTE_PARSER_H_
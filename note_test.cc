@@ -0,0 +1,33 @@
+#include "note.h"
+
+#include "gtest/gtest.h"
+#include "pitch.h"
+
+namespace z2music {
+namespace {
+
+TEST(NoteTest, Packed) {
+  const Note note(Pitch(Pitch::A4), Note::Duration::DottedQuarter);
+  EXPECT_EQ(note.pitch().timer(), 0x00fd);
+  EXPECT_EQ(note.ticks(), Note::Duration::DottedQuarter);
+  EXPECT_EQ(note.to_string(), "A4.6");
+
+  EXPECT_EQ(Note::rest(Note::kMaxTicks + 1).ticks(), Note::kMaxTicks);
+  EXPECT_EQ(Note::rest(-1).ticks(), 0);
+}
+
+TEST(NoteTest, Equality) {
+  const Note a4(Pitch(Pitch::A4), Note::Duration::Quarter);
+  EXPECT_EQ(a4, Note(Pitch(440.f), Note::Duration::Quarter));
+  EXPECT_NE(a4, Note(Pitch(Pitch::A4), Note::Duration::Eighth));
+  EXPECT_NE(a4, Note::rest(Note::Duration::Quarter));
+
+  // A detuned timer is still an A4, but it is a different note
+  const Note detuned(Pitch(static_cast<WordBE>(0x00fe)),
+                     Note::Duration::Quarter);
+  EXPECT_EQ(detuned.pitch(), a4.pitch());
+  EXPECT_NE(detuned, a4);
+}
+
+}  // namespace
+}  // namespace z2music
@@ -0,0 +1,265 @@
+#include "optimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <tuple>
+
+#include "absl/log/log.h"
+
+namespace z2music {
+
+namespace {
+
+const std::array<Pattern::Channel, 4> kChannels = {
+    Pattern::Channel::Pulse1,
+    Pattern::Channel::Pulse2,
+    Pattern::Channel::Triangle,
+    Pattern::Channel::Noise,
+};
+
+bool is_rest(const Note& note) { return note.pitch() == Pitch::none(); }
+
+// Only keep the new notes if they actually take fewer bytes.
+void replace_if_smaller(Pattern& pattern, Pattern::Channel ch,
+                        std::vector<Note> notes) {
+  Pattern candidate = pattern;
+  candidate.set_notes(ch, std::move(notes));
+  if (candidate.note_data_length(ch) < pattern.note_data_length(ch)) {
+    pattern = std::move(candidate);
+  }
+}
+
+typedef std::tuple<int, int, int> Event;
+
+// List every sounding note as start, end and pitch.  The game loops a noise
+// channel that is shorter than the pattern, so that is unrolled here.
+std::vector<Event> timeline(const Pattern& pattern, Pattern::Channel ch) {
+  const std::span<const Note> notes = pattern.notes(ch);
+  const int length = pattern.length();
+  const bool loop = ch == Pattern::Channel::Noise && pattern.pad_note_data(ch);
+
+  std::vector<Event> events;
+  int t = 0;
+  do {
+    for (const auto& n : notes) {
+      if (loop && t >= length) break;
+      if (!is_rest(n)) {
+        events.emplace_back(t, std::min(t + n.ticks(), length),
+                            n.pitch().midi());
+      }
+      t += n.ticks();
+    }
+  } while (loop && t < length);
+
+  return events;
+}
+
+}  // namespace
+
+std::vector<Optimizer::Report> Optimizer::run(Pattern& pattern) const {
+  std::vector<Report> reports;
+  reports.reserve(passes_.size());
+
+  for (auto pass : passes_) {
+    Pattern candidate = pattern;
+    apply(pass, candidate);
+
+    const int delta = static_cast<int>(candidate.note_data_length()) -
+                      static_cast<int>(pattern.note_data_length());
+
+    if (equivalent(pattern, candidate)) {
+      pattern = std::move(candidate);
+      reports.push_back({pass, delta, true});
+    } else {
+      LOG(WARNING) << "Discarding result of " << pass_name(pass)
+                   << ", pattern no longer matches";
+      reports.push_back({pass, 0, false});
+    }
+  }
+
+  return reports;
+}
+
+std::vector<Optimizer::Report> Optimizer::run(Song& song) const {
+  std::vector<Report> totals;
+  for (size_t i = 0; i < song.pattern_count(); ++i) {
+    accumulate(totals, run(song.pattern(i)));
+  }
+  return totals;
+}
+
+void Optimizer::accumulate(std::vector<Report>& totals,
+                           const std::vector<Report>& reports) {
+  if (totals.empty()) {
+    totals = reports;
+    return;
+  }
+
+  for (size_t i = 0; i < totals.size() && i < reports.size(); ++i) {
+    totals[i].byte_delta += reports[i].byte_delta;
+    totals[i].equivalent = totals[i].equivalent && reports[i].equivalent;
+  }
+}
+
+bool Optimizer::equivalent(const Pattern& a, const Pattern& b) {
+  if (a.tempo() != b.tempo()) return false;
+  if (a.voiced() && (a.voice1() != b.voice1() || a.voice2() != b.voice2())) {
+    return false;
+  }
+  if (a.length() != b.length()) return false;
+
+  for (auto ch : kChannels) {
+    if (timeline(a, ch) != timeline(b, ch)) return false;
+  }
+
+  return true;
+}
+
+Optimizer::Pass Optimizer::pass_by_name(const std::string& name) {
+  if (name == "merge_rests") return Pass::MergeRests;
+  if (name == "elide_silent_channels") return Pass::ElideSilentChannels;
+  if (name == "fold_noise_loops") return Pass::FoldNoiseLoops;
+  if (name == "reorder_rest_runs") return Pass::ReorderRestRuns;
+  return Pass::Unknown;
+}
+
+std::string Optimizer::pass_name(Optimizer::Pass pass) {
+  switch (pass) {
+    case Pass::MergeRests:
+      return "merge_rests";
+    case Pass::ElideSilentChannels:
+      return "elide_silent_channels";
+    case Pass::FoldNoiseLoops:
+      return "fold_noise_loops";
+    case Pass::ReorderRestRuns:
+      return "reorder_rest_runs";
+    default:
+      return "unknown";
+  }
+}
+
+void Optimizer::apply(Optimizer::Pass pass, Pattern& pattern) const {
+  switch (pass) {
+    case Pass::MergeRests:
+      merge_rests(pattern);
+      break;
+
+    case Pass::ElideSilentChannels:
+      elide_silent_channels(pattern);
+      break;
+
+    case Pass::FoldNoiseLoops:
+      fold_noise_loops(pattern);
+      break;
+
+    case Pass::ReorderRestRuns:
+      reorder_rest_runs(pattern);
+      break;
+
+    default:
+      LOG(ERROR) << "Unknown optimizer pass";
+      break;
+  }
+}
+
+void Optimizer::merge_rests(Pattern& pattern) const {
+  const byte tempo = pattern.tempo();
+
+  for (auto ch : kChannels) {
+    std::vector<Note> notes;
+    for (const auto& n : pattern.notes(ch)) {
+      if (!notes.empty() && is_rest(n) && is_rest(notes.back())) {
+        // Inexact durations carry rounding error into later notes, so only
+        // merge rests that can be stored exactly before and after.
+        const int ticks = notes.back().ticks() + n.ticks();
+        if (check_(notes.back().ticks(), tempo) && check_(n.ticks(), tempo) &&
+            check_(ticks, tempo)) {
+          notes.back() = Note::rest(ticks);
+          continue;
+        }
+      }
+      notes.push_back(n);
+    }
+    replace_if_smaller(pattern, ch, std::move(notes));
+  }
+}
+
+void Optimizer::elide_silent_channels(Pattern& pattern) const {
+  // Pulse1 sets the length of the pattern so it always has to stay.
+  for (auto ch : {Pattern::Channel::Pulse2, Pattern::Channel::Triangle,
+                  Pattern::Channel::Noise}) {
+    const std::span<const Note> notes = pattern.notes(ch);
+    if (std::all_of(notes.begin(), notes.end(), is_rest)) {
+      replace_if_smaller(pattern, ch, {});
+    }
+  }
+}
+
+void Optimizer::fold_noise_loops(Pattern& pattern) const {
+  const std::span<const Note> notes = pattern.notes(Pattern::Channel::Noise);
+  const size_t n = notes.size();
+
+  for (size_t period = 1; period <= n / 2; ++period) {
+    if (n % period != 0) continue;
+
+    bool repeats = true;
+    for (size_t i = period; i < n && repeats; ++i) {
+      repeats = notes[i] == notes[i % period];
+    }
+
+    if (repeats) {
+      replace_if_smaller(pattern, Pattern::Channel::Noise,
+                         {notes.begin(), notes.begin() + period});
+      return;
+    }
+  }
+}
+
+void Optimizer::reorder_rest_runs(Pattern& pattern) const {
+  // Only voiced patterns pay for changing durations.
+  if (!pattern.voiced()) return;
+
+  for (auto ch : kChannels) {
+    const std::span<const Note> original = pattern.notes(ch);
+    std::vector<Note> notes(original.begin(), original.end());
+
+    size_t i = 0;
+    while (i < notes.size()) {
+      if (!is_rest(notes[i])) {
+        ++i;
+        continue;
+      }
+
+      size_t j = i;
+      bool exact = true;
+      while (j < notes.size() && is_rest(notes[j])) {
+        exact = exact && check_(notes[j].ticks(), pattern.tempo());
+        ++j;
+      }
+
+      if (exact && j - i > 1) {
+        const int prev = i > 0 ? notes[i - 1].ticks() : -1;
+        const int next = j < notes.size() ? notes[j].ticks() : -1;
+
+        // Put rests matching the previous duration first and the ones
+        // matching the next duration last, grouping the rest together.
+        auto rank = [prev, next](const Note& n) {
+          if (n.ticks() == prev) return std::make_pair(0, 0);
+          if (n.ticks() == next) return std::make_pair(2, 0);
+          return std::make_pair(1, n.ticks());
+        };
+
+        std::stable_sort(
+            notes.begin() + i, notes.begin() + j,
+            [&rank](const Note& a, const Note& b) { return rank(a) < rank(b); });
+      }
+
+      i = j;
+    }
+
+    replace_if_smaller(pattern, ch, std::move(notes));
+  }
+}
+
+}  // namespace z2music
@@ -0,0 +1,73 @@
+#ifndef Z2MUSIC_OPTIMIZER_H_
+#define Z2MUSIC_OPTIMIZER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "pattern.h"
+#include "song.h"
+#include "util.h"
+
+namespace z2music {
+
+// Runs a list of size reducing passes over note data before it is encoded.
+// Every pass must leave the music sounding the same, so the result of each
+// pass is compared against its input and discarded if they differ.
+class Optimizer {
+ public:
+  enum class Pass {
+    Unknown,
+
+    // Combine consecutive rests into a single longer rest.
+    MergeRests,
+
+    // Drop channels that never play a note so they take no space.
+    ElideSilentChannels,
+
+    // Cut a repeating noise channel down to a single loop.
+    FoldNoiseLoops,
+
+    // Reorder runs of rests in voiced patterns to save duration changes.
+    ReorderRestRuns,
+  };
+
+  struct Report {
+    Pass pass;
+    int byte_delta;
+    bool equivalent;
+  };
+
+  // Returns true if the ticks can be stored exactly for the given tempo.
+  typedef std::function<bool(int ticks, byte tempo)> DurationCheck;
+
+  explicit Optimizer(DurationCheck check) : check_(std::move(check)) {}
+
+  void add_pass(Pass pass) { passes_.push_back(pass); }
+  bool empty() const { return passes_.empty(); }
+
+  std::vector<Report> run(Pattern& pattern) const;
+  std::vector<Report> run(Song& song) const;
+
+  static void accumulate(std::vector<Report>& totals,
+                         const std::vector<Report>& reports);
+  static bool equivalent(const Pattern& a, const Pattern& b);
+
+  static Pass pass_by_name(const std::string& name);
+  static std::string pass_name(Pass pass);
+
+ private:
+  DurationCheck check_;
+  std::vector<Pass> passes_;
+
+  void apply(Pass pass, Pattern& pattern) const;
+
+  void merge_rests(Pattern& pattern) const;
+  void elide_silent_channels(Pattern& pattern) const;
+  void fold_noise_loops(Pattern& pattern) const;
+  void reorder_rest_runs(Pattern& pattern) const;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_OPTIMIZER_H_
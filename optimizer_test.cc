@@ -0,0 +1,93 @@
+#include "optimizer.h"
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "pitch.h"
+
+namespace z2music {
+
+class OptimizerTest : public ::testing::Test {
+ protected:
+  FakeRom rom;
+  Optimizer optimizer{[this](int ticks, byte tempo) {
+    return rom.can_encode_duration(ticks, tempo);
+  }};
+
+  void EXPECT_REPORT(const std::vector<Optimizer::Report>& reports,
+                     int byte_delta) {
+    ASSERT_EQ(reports.size(), 1);
+    EXPECT_EQ(reports[0].byte_delta, byte_delta);
+    EXPECT_TRUE(reports[0].equivalent);
+  }
+};
+
+TEST_F(OptimizerTest, MergeRests) {
+  Pattern pattern{0x18, Pattern::parse_notes("a4.2 r.2 r.4 a4.8"),
+                  Pattern::parse_notes("r.4 r r r"), {}, {}};
+  const Pattern original = pattern;
+
+  optimizer.add_pass(Optimizer::Pass::MergeRests);
+  EXPECT_REPORT(optimizer.run(pattern), -3);
+
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse1), "A4.2 r.6 A4.8");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse2), "r.8 r");
+  EXPECT_TRUE(Optimizer::equivalent(original, pattern));
+}
+
+TEST_F(OptimizerTest, MergeRestsNeedsExactDuration) {
+  // There is no entry for a rest of 5 sixteenths at this tempo
+  Pattern pattern{0x18, Pattern::parse_notes("a4.2 r.1 r.4 a4.1"), {}, {}, {}};
+
+  optimizer.add_pass(Optimizer::Pass::MergeRests);
+  EXPECT_REPORT(optimizer.run(pattern), 0);
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse1), "A4.2 r.1 r.4 A4.1");
+}
+
+TEST_F(OptimizerTest, ElideSilentChannels) {
+  Pattern pattern{0x18, Pattern::parse_notes("r.8 a4"),
+                  Pattern::parse_notes("r.8 r"),
+                  Pattern::parse_notes("a3.8 r"), {}};
+
+  optimizer.add_pass(Optimizer::Pass::ElideSilentChannels);
+  EXPECT_REPORT(optimizer.run(pattern), -2);
+
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse1), "r.8 A4");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse2), "");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Triangle), "A3.8 r");
+}
+
+TEST_F(OptimizerTest, FoldNoiseLoops) {
+  Pattern pattern{0x18, Pattern::parse_notes("a4.8 a4"), {}, {},
+                  Pattern::parse_notes("x.2 x x.4 x.2 x x.4")};
+
+  optimizer.add_pass(Optimizer::Pass::FoldNoiseLoops);
+  EXPECT_REPORT(optimizer.run(pattern), -2);
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Noise), "G#3.2 G#3 G#3.4");
+
+  Pattern uneven{0x18, Pattern::parse_notes("a4.8 a4"), {}, {},
+                 Pattern::parse_notes("x.4 x x.2 x x.4")};
+  EXPECT_REPORT(optimizer.run(uneven), 0);
+}
+
+TEST_F(OptimizerTest, ReorderRestRuns) {
+  Pattern pattern{0x20, 0x30, Pattern::parse_notes("c5.4 r.2 r.4 d5.2"), {},
+                  {}, {}};
+
+  optimizer.add_pass(Optimizer::Pass::ReorderRestRuns);
+  EXPECT_REPORT(optimizer.run(pattern), -2);
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse1), "C5.4 r r.2 D5");
+}
+
+TEST_F(OptimizerTest, Equivalence) {
+  const Pattern a{0x18, Pattern::parse_notes("a4.4 r r.8"), {}, {}, {}};
+  const Pattern b{0x18, Pattern::parse_notes("a4.4 r.12"), {}, {}, {}};
+  const Pattern c{0x18, Pattern::parse_notes("a4.8 r.8"), {}, {}, {}};
+  const Pattern d{0x20, Pattern::parse_notes("a4.4 r.12"), {}, {}, {}};
+
+  EXPECT_TRUE(Optimizer::equivalent(a, b));
+  EXPECT_FALSE(Optimizer::equivalent(a, c));
+  EXPECT_FALSE(Optimizer::equivalent(b, d));
+}
+
+}  // namespace z2music
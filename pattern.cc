@@ -1,8 +1,10 @@
 #include "pattern.h"
 
+#include <cstring>
 #include <sstream>
 
 #include "absl/log/log.h"
+#include "note_parser.h"
 
 namespace z2music {
 
@@ -11,7 +13,7 @@ Pattern::Pattern() : tempo_(0x18) { clear(); }
 Pattern::Pattern(byte tempo, std::vector<Note> pw1, std::vector<Note> pw2,
                  std::vector<Note> triangle, std::vector<Note> noise)
     : tempo_(tempo) {
-  clear();
+  notes_.reserve(pw1.size() + pw2.size() + triangle.size() + noise.size());
   add_notes(Channel::Pulse1, pw1);
   add_notes(Channel::Pulse2, pw2);
   add_notes(Channel::Triangle, triangle);
@@ -21,7 +23,7 @@ Pattern::Pattern(byte tempo, std::vector<Note> pw1, std::vector<Note> pw2,
 Pattern::Pattern(byte v1, byte v2, std::vector<Note> pw1, std::vector<Note> pw2,
                  std::vector<Note> triangle, std::vector<Note> noise)
     : tempo_(0x00), voice1_(v1), voice2_(v2) {
-  clear();
+  notes_.reserve(pw1.size() + pw2.size() + triangle.size() + noise.size());
   add_notes(Channel::Pulse1, pw1);
   add_notes(Channel::Pulse2, pw2);
   add_notes(Channel::Triangle, triangle);
@@ -29,20 +31,44 @@ Pattern::Pattern(byte v1, byte v2, std::vector<Note> pw1, std::vector<Note> pw2,
 }
 
 void Pattern::add_notes(Pattern::Channel ch, std::vector<Note> notes) {
-  for (auto n : notes) {
-    notes_[ch].push_back(n);
+  const size_t i = index(ch);
+  replace(ch, starts_[i + 1] - starts_[i], notes);
+}
+
+void Pattern::set_notes(Pattern::Channel ch, std::vector<Note> notes) {
+  replace(ch, 0, notes);
+}
+
+void Pattern::set_notes(std::vector<Note> notes,
+                        const std::array<size_t, 4>& counts) {
+  notes_ = std::move(notes);
+  for (size_t i = 0; i < counts.size(); ++i) {
+    starts_[i + 1] = starts_[i] + counts[i];
   }
 }
 
+// Keeps the first few notes of a channel and puts the given ones after them,
+// moving the channels after it along.
+void Pattern::replace(Pattern::Channel ch, size_t keep,
+                      const std::vector<Note>& notes) {
+  const size_t i = index(ch);
+  const auto first = notes_.begin() + starts_[i] + keep;
+  const auto last = notes_.begin() + starts_[i + 1];
+  notes_.insert(notes_.erase(first, last), notes.begin(), notes.end());
+
+  const int64_t shift =
+      static_cast<int64_t>(keep + notes.size()) - (starts_[i + 1] - starts_[i]);
+  for (size_t j = i + 1; j < starts_.size(); ++j) starts_[j] += shift;
+}
+
 void Pattern::clear() {
-  notes_[Channel::Pulse1].clear();
-  notes_[Channel::Pulse2].clear();
-  notes_[Channel::Triangle].clear();
-  notes_[Channel::Noise].clear();
+  notes_.clear();
+  starts_ = {};
 }
 
-std::vector<Note> Pattern::notes(Pattern::Channel ch) const {
-  return notes_.at(ch);
+std::span<const Note> Pattern::notes(Pattern::Channel ch) const {
+  const size_t i = index(ch);
+  return {notes_.data() + starts_[i], notes_.data() + starts_[i + 1]};
 }
 
 bool Pattern::validate() const {
@@ -89,7 +115,7 @@ std::vector<byte> Pattern::meta_data(Address pw1_address) const {
 
 size_t Pattern::length(Pattern::Channel ch) const {
   size_t length = 0;
-  for (auto n : notes_.at(ch)) {
+  for (auto n : notes(ch)) {
     length += n.ticks();
   }
   return length;
@@ -112,7 +138,7 @@ size_t Pattern::note_data_length(Pattern::Channel ch) const {
   if (voiced()) {
     int dur = 0;
     size_t length = 0;
-    for (const auto& n : notes_.at(ch)) {
+    for (const auto& n : notes(ch)) {
       if (dur != n.ticks()) {
         ++length;
         dur = n.ticks();
@@ -121,174 +147,79 @@ size_t Pattern::note_data_length(Pattern::Channel ch) const {
     }
     return length + (pad_note_data(ch) ? 1 : 0);
   } else {
-    return notes_.at(ch).size() + (pad_note_data(ch) ? 1 : 0);
+    return notes(ch).size() + (pad_note_data(ch) ? 1 : 0);
   }
 }
 
-namespace {
-Note build_note(int pitch, int octave, int duration, bool triplet,
-                int transpose) {
-  const int note = pitch > 0 ? pitch + 12 * octave + 11 + transpose : 0;
-  const int ticks = (triplet ? 4 : 6) * 4 * duration;
-  return Note(note == 0 ? Pitch::none() : Pitch(static_cast<Pitch::Midi>(note)),
-              ticks);
-}
-}  // namespace
-
-std::vector<Note> Pattern::parse_notes(const std::string& data, int transpose) {
+std::vector<Note> Pattern::parse_notes(std::string_view data, int transpose,
+                                       const ParseError& error) {
   std::vector<Note> notes;
+  parse_notes(data, notes, transpose, error);
+  return notes;
+}
 
-  int duration = 0;
-  int pitch = 0;
-  int octave = 0;
-  bool triplet = false;
-
-  size_t i = 0;
-
-  while (i < data.length()) {
-    const char c = data[i++];
-
-    switch (c) {
-      case 'C':
-      case 'c':
-        pitch = 1;
-        break;
-
-      case 'D':
-      case 'd':
-        pitch = 3;
-        break;
-
-      case 'E':
-      case 'e':
-        pitch = 5;
-        break;
-
-      case 'F':
-      case 'f':
-        pitch = 6;
-        break;
-
-      case 'G':
-      case 'g':
-        pitch = 8;
-        break;
-
-      case 'A':
-      case 'a':
-        pitch = 10;
-        break;
-
-      case 'B':
-        pitch = 12;
-        break;
-
-      case 'b':
-        // flat if pitch is already set, otherwise b note
-        pitch = pitch == 0 ? 12 : pitch - 1;
-        break;
-
-      case '#':
-      case 's':
-        ++pitch;
-        break;
-
-      case '1':
-      case '2':
-      case '3':
-      case '4':
-      case '5':
-      case '6':
-      case '7':
-      case '8':
-        if (octave == 0) {
-          octave = c - '0';
-        } else {
-          duration = duration * 10 + (c - '0');
+void Pattern::parse_notes(std::string_view data, std::vector<Note>& notes,
+                          int transpose, const ParseError& error) {
+  NoteParser::parse(
+      data, transpose, [&notes](Note note) { notes.push_back(note); },
+      [&error](size_t offset, NoteParser::Problem problem, char c) {
+        std::string message;
+        switch (problem) {
+          case NoteParser::Problem::UnsupportedOctave:
+            message = std::string("Octave ") + c + " is not supported";
+            break;
+          case NoteParser::Problem::UnknownChar:
+            message = std::string("Unknown char '") + c +
+                      "' when parsing notes";
+            break;
         }
-        break;
 
-      case '9':
-      case '0':
-        if (octave == 0) {
-          LOG(WARNING) << "Octave " << c << " is not supported";
+        if (error) {
+          error(offset, message);
         } else {
-          duration = duration * 10 + (c - '0');
-        }
-        break;
-
-      case '.':
-        duration = 0;
-        triplet = false;
-        break;
-
-      case 't':
-        triplet = true;
-        break;
-
-      case 'x':
-        // snare drum (G#3)
-        pitch = 9;
-        octave = 3;
-        break;
-
-      case 'r':
-      case '-':
-        // rest
-        pitch = -1;
-        octave = -1;
-        break;
-
-      case ' ':
-        if (pitch && octave && duration) {
-          notes.push_back(
-              build_note(pitch, octave, duration, triplet, transpose));
-          // Keep duration for later notes, but reset pitch and octave
-          pitch = 0;
-          octave = 0;
+          LOG(WARNING) << message;
         }
-        break;
+      });
+}
 
-      default:
-        LOG(WARNING) << "Unknown char '" << c << "' when parsing notes";
-        break;
-    }
-  }
+std::string Pattern::dump_notes(Channel ch) const {
+  std::string output;
+  dump_notes(ch, output);
+  return output;
+}
 
-  // Add final note
-  if (pitch && octave && duration) {
-    notes.push_back(build_note(pitch, octave, duration, triplet, transpose));
-  }
+void Pattern::dump_notes(Channel ch, std::string& output) const {
+  char prev[Note::kMaxDurationLength];
+  size_t prev_length = 0;
 
-  return notes;
-}
+  bool first = true;
+  for (const auto& note : notes(ch)) {
+    if (!first) output += ' ';
+    first = false;
 
-std::string Pattern::dump_notes(Channel ch) const {
-  std::string prev = "";
-
-  std::ostringstream output;
-  for (const auto note : notes(ch)) {
-    if (output.tellp() > 0) output << " ";
-    output << note.pitch();
-    const std::string dur = note.duration_string();
-    if (dur != prev) {
-      output << "." << dur;
-      prev = dur;
+    note.pitch().append_string(output);
+
+    char dur[Note::kMaxDurationLength];
+    const size_t length = note.format_duration(dur);
+    if (length != prev_length || std::memcmp(dur, prev, length) != 0) {
+      output += '.';
+      output.append(dur, length);
+      std::memcpy(prev, dur, length);
+      prev_length = length;
     }
   }
-  return output.str();
 }
 
 PitchSet Pattern::pitches_used() const {
   PitchSet pitches;
+  pitches_used(pitches);
+  return pitches;
+}
 
-  for (const auto& v : notes_) {
-    for (const auto& n : v.second) {
-      pitches.insert(n.pitch());
-    }
+void Pattern::pitches_used(PitchSet& pitches) const {
+  for (const auto& n : notes_) {
+    pitches.insert(n.pitch());
   }
-
-  return pitches;
 }
 
 }  // namespace z2music
@@ -1,8 +1,12 @@
 #ifndef Z2MUSIC_PATTERN_H_
 #define Z2MUSIC_PATTERN_H_
 
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "note.h"
@@ -24,8 +28,16 @@ class Pattern {
   size_t length() const { return length(Channel::Pulse1); }
 
   void add_notes(Channel ch, std::vector<Note> notes);
+  void set_notes(Channel ch, std::vector<Note> notes);
+  // Every channel's notes in one buffer, in channel order, with how many
+  // belong to each.  This is how they are stored, so nothing is copied.
+  void set_notes(std::vector<Note> notes, const std::array<size_t, 4>& counts);
   void clear();
-  std::vector<Note> notes(Channel ch) const;
+  // Only valid until the pattern's notes are next changed
+  std::span<const Note> notes(Channel ch) const;
+  // Every channel's notes in channel order, to be changed in place
+  std::span<Note> all_notes() { return notes_; }
+  std::span<const Note> all_notes() const { return notes_; }
 
   // TODO figure out if the tempo values are meaningful
   void tempo(byte tempo) { tempo_ = tempo; }
@@ -43,20 +55,41 @@ class Pattern {
 
   std::vector<byte> meta_data(Address pw1_address) const;
 
-  static std::vector<Note> parse_notes(const std::string& data,
-                                       int transpose = 0);
+  // Called with the offset into the data and a description of anything
+  // that could not be parsed.  Without one, problems are logged instead.
+  typedef std::function<void(size_t offset, const std::string& message)>
+      ParseError;
+
+  static std::vector<Note> parse_notes(std::string_view data,
+                                       int transpose = 0,
+                                       const ParseError& error = nullptr);
+  // Appends the parsed notes instead, so a buffer can be reused.
+  static void parse_notes(std::string_view data, std::vector<Note>& notes,
+                          int transpose = 0,
+                          const ParseError& error = nullptr);
   std::string dump_notes(Channel ch) const;
+  // Appends to output, which avoids a string per channel when dumping a lot.
+  void dump_notes(Channel ch, std::string& output) const;
 
   bool pad_note_data(Channel ch) const;
   size_t note_data_length() const;
   size_t note_data_length(Channel ch) const;
 
   PitchSet pitches_used() const;
+  // Adds to pitches, which avoids a set per pattern when collecting a lot.
+  void pitches_used(PitchSet& pitches) const;
 
  private:
   byte tempo_, voice1_, voice2_;
-  std::unordered_map<Channel, std::vector<Note>> notes_;
 
+  // All four channels one after the other, so that a pattern is a single
+  // allocation and can be walked in order.  Channel ch is the range from
+  // starts_[ch] to starts_[ch + 1].
+  std::vector<Note> notes_;
+  std::array<uint32_t, 5> starts_ = {};
+
+  static size_t index(Channel ch) { return static_cast<size_t>(ch); }
+  void replace(Channel ch, size_t keep, const std::vector<Note>& notes);
   size_t length(Channel ch) const;
 };
 
@@ -1,6 +1,8 @@
 #include "pattern.h"
 
+#include <algorithm>
 #include <array>
+#include <ranges>
 
 #include "fake_rom.h"
 #include "gtest/gtest.h"
@@ -207,6 +209,31 @@ TEST(PatternTest, RoundTrip2) {
   EXPECT_EQ(input_noise, pattern.dump_notes(z2music::Pattern::Channel::Noise));
 }
 
+TEST(PatternTest, EditChannels) {
+  Pattern pattern{0x18, Pattern::parse_notes("A4.4 C5"),
+                  Pattern::parse_notes("E4.8"), {},
+                  Pattern::parse_notes("G#3.2 G#3 G#3 G#3")};
+
+  // Every channel shares a buffer, so changing one moves the ones after it
+  pattern.set_notes(Pattern::Channel::Pulse1, Pattern::parse_notes("A4.8"));
+  pattern.add_notes(Pattern::Channel::Triangle, Pattern::parse_notes("A3.8"));
+  pattern.add_notes(Pattern::Channel::Pulse2, Pattern::parse_notes("r.8"));
+
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse1), "A4.8");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse2), "E4.8 r");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Triangle), "A3.8");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Noise), "G#3.2 G#3 G#3 G#3");
+
+  pattern.set_notes(Pattern::Channel::Pulse2, {});
+  EXPECT_TRUE(pattern.notes(Pattern::Channel::Pulse2).empty());
+  EXPECT_EQ(pattern.notes(Pattern::Channel::Triangle).size(), 1);
+  EXPECT_EQ(pattern.notes(Pattern::Channel::Noise).size(), 4);
+
+  pattern.clear();
+  EXPECT_TRUE(pattern.notes(Pattern::Channel::Noise).empty());
+  EXPECT_EQ(pattern.length(), 0);
+}
+
 TEST_F(TestWithFakeRom, TownTheme06) {
   rom.add_pattern(0x1234, 0x20,
                   {0xe4, 0xa0, 0xe4, 0x21, 0x9f, 0xa7, 0xed, 0x77, 0x00});
@@ -217,4 +244,25 @@ TEST_F(TestWithFakeRom, TownTheme06) {
             "A#4.4 G#4.2 A#4.4 G#4.6 G4.4t B4 D5 G5.8");
 }
 
+TEST_F(TestWithFakeRom, StreamNotes) {
+  static_assert(std::ranges::forward_range<Rom::NoteRange>);
+  rom.add_pattern(0x1234, 0x20,
+                  {0xe4, 0xa0, 0xe4, 0x21, 0x9f, 0xa7, 0xed, 0x77, 0x00});
+
+  const Pattern pattern = rom.read_pattern(0x1234);
+  const auto expected = pattern.notes(Pattern::Channel::Pulse1);
+  const Rom::NoteRange notes = rom.notes(0x11234, Pattern::Channel::Pulse1);
+  EXPECT_TRUE(std::ranges::equal(notes, expected));
+  EXPECT_EQ(std::ranges::distance(notes), 8);
+
+  // Pulse 2 has no offset in the header, so it has no notes
+  const Rom::NoteRange pulse2 = rom.notes(0x11234, Pattern::Channel::Pulse2);
+  EXPECT_TRUE(pulse2.begin() == pulse2.end());
+
+  // Stops once the length is reached, after the note that reaches it
+  const Address data = 0x11234 + 6;
+  EXPECT_EQ(std::ranges::distance(rom.notes(data, 0x20, Note::Duration::Whole)),
+            4);
+}
+
 }  // namespace z2music
@@ -1,9 +1,40 @@
 #include "pitch.h"
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 namespace z2music {
 
+int Pitch::midi() const {
+  // Notes only go down as the timer goes up, so the table has the first timer
+  // for each note from the highest down, found once with exact_midi().  The
+  // note for a timer is then the last one starting at or before it.
+  static const auto [highest, starts] = [] {
+    const int highest = Pitch(WordBE(0)).exact_midi();
+    const int lowest = Pitch(WordBE(0xffff)).exact_midi();
+
+    std::vector<uint16_t> starts;
+    for (int note = highest; note >= lowest; --note) {
+      uint32_t low = starts.empty() ? 0 : starts.back();
+      uint32_t high = 0xffff;
+      while (low < high) {
+        const uint32_t mid = (low + high) / 2;
+        if (Pitch(WordBE(mid)).exact_midi() <= note) {
+          high = mid;
+        } else {
+          low = mid + 1;
+        }
+      }
+      starts.push_back(low);
+    }
+    return std::pair{highest, starts};
+  }();
+
+  const auto next = std::upper_bound(starts.begin(), starts.end(), timer_);
+  return highest - static_cast<int>(next - starts.begin() - 1);
+}
+
 std::string Pitch::to_string() const {
   if (timer_ == 0) return "r";
   const int note = midi();
@@ -11,6 +42,47 @@ std::string Pitch::to_string() const {
   return kStepNames[note % 12] + std::to_string(octave);
 }
 
+namespace {
+
+struct NoteName {
+  char text[4];
+  size_t length;
+};
+
+// Names of every MIDI note, as to_string() would print them
+constexpr std::array<NoteName, 128> kNoteNames = [] {
+  constexpr const char* kSteps[12] = {"C",  "C#", "D",  "D#", "E",  "F",
+                                      "F#", "G",  "G#", "A",  "A#", "B"};
+
+  std::array<NoteName, 128> names{};
+  for (int note = 12; note < 128; ++note) {
+    NoteName& name = names[note];
+    for (const char* c = kSteps[note % 12]; *c; ++c) {
+      name.text[name.length++] = *c;
+    }
+    name.text[name.length++] = '0' + (note / 12) - 1;
+  }
+  return names;
+}();
+
+}  // namespace
+
+void Pitch::append_string(std::string& out) const {
+  if (timer_ == 0) {
+    out += 'r';
+    return;
+  }
+
+  const int note = midi();
+  if (note < 12 || note >= 128) {
+    // Octave -1 and notes outside MIDI range are rare, so use to_string()
+    out += to_string();
+    return;
+  }
+
+  out.append(kNoteNames[note].text, kNoteNames[note].length);
+}
+
 std::ostream& operator<<(std::ostream& os, Pitch p) {
   return os << p.to_string();
 }
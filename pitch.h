@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <map>
 #include <set>
 #include <string>
@@ -36,15 +37,16 @@ class Pitch {
     OCTAVE(8),
   };
 
-  Pitch() : timer_(0) {}
+  constexpr Pitch() : timer_(0) {}
 
-  explicit Pitch(WordBE timer) : timer_(timer) {}
+  constexpr explicit Pitch(WordBE timer) : timer_(timer) {}
   explicit Pitch(float freq)
       : timer_(static_cast<WordBE>(std::round(kCPURate / (16 * freq) - 1))) {}
-  explicit Pitch(Midi note)
-      : Pitch(pow(2.f, (note - Midi::A4) / 12.f) * kFreqA4) {}
+  constexpr explicit Pitch(Midi note) : timer_(timer_for(note)) {}
 
   std::string to_string() const;
+  // Appends the same text as to_string()
+  void append_string(std::string& out) const;
 
   bool operator==(Pitch other) const { return midi() == other.midi(); }
   bool operator<(Pitch other) const { return midi() < other.midi(); }
@@ -52,14 +54,19 @@ class Pitch {
   bool operator<=(Pitch other) const { return midi() <= other.midi(); }
   bool operator>=(Pitch other) const { return midi() >= other.midi(); }
 
-  WordBE timer() const { return timer_; }
+  constexpr WordBE timer() const { return timer_; }
   float freq() const { return kCPURate / (16.0f * (timer_ + 1)); }
-  int midi() const {
-    return Midi::A4 +
-           static_cast<int>(std::round(12 * log(freq() / kFreqA4) / kLog2));
-  }
+  // The nearest MIDI note to freq(), looked up rather than computed, since
+  // every comparison between pitches needs it.
+  int midi() const;
 
-  static Pitch none() { return Pitch(0); }
+  static constexpr Pitch none() { return Pitch(WordBE(0)); }
+
+  // Computes the timer for a note from its frequency.  This is what the
+  // lookup table was generated from; it is only used outside MIDI range.
+  static Pitch from_midi(int note) {
+    return Pitch(pow(2.f, (note - Midi::A4) / 12.f) * kFreqA4);
+  }
 
  private:
   static constexpr float kLog2 = std::log(2.f);
@@ -68,6 +75,37 @@ class Pitch {
   static constexpr int kCPURate = 1789773;
   static const std::array<std::string, 12> kStepNames;
 
+  // Timer values for every MIDI note, exactly as the float formula in
+  // from_midi() rounds them, so parsing notes never needs pow().
+  static constexpr std::array<uint16_t, 128> kMidiTimers = {
+      13681, 12913, 12188, 11504, 10858, 10249, 9674, 9131, 8618, 8134,
+      7678,  7247,  6840,  6456,  6094,  5752,  5429, 5124, 4836, 4565,
+      4309,  4067,  3838,  3623,  3419,  3228,  3046, 2875, 2714, 2561,
+      2418,  2282,  2154,  2033,  1919,  1811,  1709, 1613, 1523, 1437,
+      1356,  1280,  1208,  1140,  1076,  1016,  959,  905,  854,  806,
+      761,   718,   678,   640,   604,   570,   538,  507,  479,  452,
+      427,   403,   380,   359,   338,   319,   301,  284,  268,  253,
+      239,   225,   213,   201,   189,   179,   169,  159,  150,  142,
+      134,   126,   119,   112,   106,   100,   94,   89,   84,   79,
+      75,    70,    66,    63,    59,    56,    52,   49,   47,   44,
+      41,    39,    37,    35,    33,    31,    29,   27,   26,   24,
+      23,    21,    20,    19,    18,    17,    16,   15,   14,   13,
+      12,    12,    11,    10,    10,    9,     8,    8,
+  };
+
+  // What midi() looks up, from the frequency
+  int exact_midi() const {
+    return Midi::A4 +
+           static_cast<int>(std::round(12 * log(freq() / kFreqA4) / kLog2));
+  }
+
+  static constexpr WordBE timer_for(int note) {
+    if (note >= 0 && static_cast<size_t>(note) < kMidiTimers.size()) {
+      return kMidiTimers[note];
+    }
+    return from_midi(note).timer();
+  }
+
   WordBE timer_;
 };
 
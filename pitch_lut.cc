@@ -1,6 +1,7 @@
 #include "pitch_lut.h"
 
 #include "absl/log/log.h"
+#include "metrics.h"
 
 namespace z2music {
 
@@ -22,6 +23,7 @@ Pitch PitchLUT::at(byte index) const {
 }
 
 byte PitchLUT::index_for(const Pitch& pitch) const {
+  Metrics::count(Metrics::Counter::PitchLookups);
   if (pitch == Pitch::none()) return 2;
   for (size_t i = 0; i < table_.size(); ++i) {
     if (table_[i] == pitch) return offset(i);
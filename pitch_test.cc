@@ -1,5 +1,7 @@
 #include "pitch.h"
 
+#include <cmath>
+
 #include "absl/log/log.h"
 #include "gtest/gtest.h"
 
@@ -25,6 +27,26 @@ TEST(PitchTest, Conversions) {
   EXPECT_EQ(e7.timer(), 0x0029);
 }
 
+TEST(PitchTest, MidiTableMatchesFormula) {
+  for (int note = 0; note < 128; ++note) {
+    EXPECT_EQ(Pitch(static_cast<Pitch::Midi>(note)).timer(),
+              Pitch::from_midi(note).timer())
+        << "MIDI note " << note;
+  }
+
+  static_assert(Pitch(Pitch::A4).timer() == 0x00fd);
+}
+
+TEST(PitchTest, MidiForEveryTimer) {
+  for (int timer = 0; timer <= 0xffff; ++timer) {
+    const Pitch pitch(static_cast<WordBE>(timer));
+    const int expected =
+        static_cast<int>(Pitch::A4) +
+        static_cast<int>(std::round(12 * std::log2(pitch.freq() / 440.f)));
+    ASSERT_EQ(pitch.midi(), expected) << "timer " << timer;
+  }
+}
+
 TEST(PitchTest, Comparisons) {
   Pitch a4 = Pitch(Pitch::A4);
   Pitch a4f = Pitch(440.f);
@@ -0,0 +1,703 @@
+#include "project.h"
+
+#include <algorithm>
+#include <charconv>
+#include <optional>
+
+#include "absl/log/log.h"
+#include "binary_io.h"
+#include "metrics.h"
+#include "project_writer.h"
+
+namespace z2music {
+
+namespace {
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+std::string_view rtrim(std::string_view s) {
+  while (!s.empty() && is_space(s.back())) s.remove_suffix(1);
+  return s;
+}
+
+// Accepts the same forms as the stream operators in util.cc: a 0x prefix for
+// hex, a leading 0 for octal and decimal otherwise.
+std::optional<uint32_t> parse_unsigned(std::string_view token) {
+  int base = 10;
+  if (token.size() > 2 && token[0] == '0' &&
+      (token[1] == 'x' || token[1] == 'X')) {
+    base = 16;
+    token.remove_prefix(2);
+  } else if (token.size() > 1 && token[0] == '0') {
+    base = 8;
+    token.remove_prefix(1);
+  }
+
+  uint32_t value;
+  const char* end = token.data() + token.size();
+  const auto result = std::from_chars(token.data(), end, value, base);
+  if (result.ec != std::errc() || result.ptr != end) return std::nullopt;
+  return value;
+}
+
+std::optional<int> parse_int(std::string_view token) {
+  if (token.size() > 1 && token[0] == '+') token.remove_prefix(1);
+
+  int value;
+  const char* end = token.data() + token.size();
+  const auto result = std::from_chars(token.data(), end, value);
+  if (result.ec != std::errc() || result.ptr != end) return std::nullopt;
+  return value;
+}
+
+}  // namespace
+
+class Project::Parser {
+ public:
+  static constexpr size_t kChannels = 4;
+
+  Parser(Project& project, const RomLayout& layout)
+      : project_(project), layout_(layout) {}
+
+  void parse_line(std::string_view line);
+  void finish();
+  void end_block();
+
+ private:
+  Project& project_;
+  const RomLayout& layout_;
+  size_t line_number_ = 0;
+  std::string_view line_;
+  size_t pos_ = 0;
+
+  std::optional<size_t> song_;
+  bool skip_song_ = false;
+  bool sequenced_ = false;
+  int transpose_ = 0;
+
+  size_t channels_left_ = 0;
+  bool voiced_ = false;
+  byte tempo_ = 0, voice2_ = 0;
+  std::vector<Note> channels_[kChannels];
+
+  bool next(std::string_view& token, size_t& column);
+  void expect_end();
+
+  void diagnose(Diagnostic::Level level, size_t column, std::string message);
+  void warning(size_t column, std::string message) {
+    diagnose(Diagnostic::Level::Warning, column, std::move(message));
+  }
+  void error(size_t column, std::string message) {
+    diagnose(Diagnostic::Level::Error, column, std::move(message));
+  }
+  size_t end_column() const { return line_.size() + 1; }
+
+  SongChange* song() {
+    return song_ ? &std::get<SongChange>(project_.changes_[*song_]) : nullptr;
+  }
+  bool has_song(size_t column, const std::string& command);
+  const SongEntry* find_song(std::string_view name, size_t column);
+  std::optional<byte> parse_byte(std::string_view token, size_t column);
+  void leave_song();
+
+  void parse_song();
+  void parse_loader();
+  void parse_share();
+  void parse_transpose();
+  void parse_pattern();
+  void parse_sequence();
+  void parse_channel();
+};
+
+bool Project::Parser::next(std::string_view& token, size_t& column) {
+  while (pos_ < line_.size() && is_space(line_[pos_])) ++pos_;
+  if (pos_ == line_.size()) return false;
+
+  const size_t start = pos_;
+  while (pos_ < line_.size() && !is_space(line_[pos_])) ++pos_;
+
+  token = line_.substr(start, pos_ - start);
+  column = start + 1;
+  return true;
+}
+
+void Project::Parser::expect_end() {
+  std::string_view token;
+  size_t column;
+  if (next(token, column)) {
+    warning(column, "Ignoring extra text '" + std::string(token) + "'");
+  }
+}
+
+void Project::Parser::diagnose(Diagnostic::Level level, size_t column,
+                               std::string message) {
+  project_.diagnostics_.push_back(
+      {level, line_number_, column, std::move(message)});
+}
+
+bool Project::Parser::has_song(size_t column, const std::string& command) {
+  if (song_) return true;
+  // Don't pile more errors onto a song whose name was already reported
+  if (!skip_song_) error(column, command + " set with no song");
+  return false;
+}
+
+const SongEntry* Project::Parser::find_song(std::string_view name,
+                                            size_t column) {
+  const SongEntry* entry = song_by_name(name);
+  if (!entry) {
+    error(column, "Unknown song name " + std::string(name));
+  } else if (!layout_.song(entry->title)) {
+    error(column, "No slot for " + std::string(name) + " in this ROM");
+    return nullptr;
+  }
+  return entry;
+}
+
+std::optional<byte> Project::Parser::parse_byte(std::string_view token,
+                                                size_t column) {
+  const auto value = parse_unsigned(token);
+  if (!value || *value > 0xff) {
+    error(column, "Expected a byte but found '" + std::string(token) + "'");
+    return std::nullopt;
+  }
+  return byte(*value);
+}
+
+void Project::Parser::leave_song() {
+  const SongChange* s = song();
+  if (s && !sequenced_ && !s->patterns.empty()) {
+    warning(1, "Song changed without setting sequence");
+  }
+  song_.reset();
+  skip_song_ = false;
+}
+
+void Project::Parser::parse_line(std::string_view line) {
+  ++line_number_;
+  line_ = rtrim(line);
+  pos_ = 0;
+
+  if (channels_left_ > 0) {
+    parse_channel();
+    return;
+  }
+
+  std::string_view command;
+  size_t column;
+  if (!next(command, column)) return;
+
+  if (command == "song") {
+    parse_song();
+  } else if (command == "loader") {
+    parse_loader();
+  } else if (command == "share") {
+    parse_share();
+  } else if (command == "transpose") {
+    parse_transpose();
+  } else if (command == "pattern") {
+    parse_pattern();
+  } else if (command == "sequence") {
+    parse_sequence();
+  } else {
+    warning(column, "Unknown keyword '" + std::string(command) + "'");
+  }
+}
+
+void Project::Parser::parse_song() {
+  std::string_view name;
+  size_t column;
+  if (!next(name, column)) {
+    error(end_column(), "Song requires name");
+    return;
+  }
+
+  leave_song();
+  transpose_ = 0;
+  sequenced_ = false;
+
+  const SongEntry* entry = find_song(name, column);
+  if (entry) {
+    song_ = project_.changes_.size();
+    project_.changes_.push_back(SongChange{entry->title, {}, {}});
+  } else {
+    skip_song_ = true;
+  }
+
+  expect_end();
+}
+
+void Project::Parser::parse_loader() {
+  std::string_view name, address;
+  size_t name_column, address_column;
+  if (!next(name, name_column) || !next(address, address_column)) {
+    error(end_column(), "Loader requires name and address");
+    return;
+  }
+
+  const LoaderEntry* entry = loader_by_name(name);
+  if (!entry) error(name_column, "Unknown loader name: " + std::string(name));
+
+  const auto value = parse_unsigned(address);
+  if (!value) {
+    error(address_column, "Invalid address '" + std::string(address) + "'");
+  }
+
+  if (entry && value) {
+    project_.changes_.push_back(LoaderChange{entry->table, Address(*value)});
+  }
+
+  expect_end();
+}
+
+void Project::Parser::parse_share() {
+  std::string_view name, source;
+  size_t name_column, source_column;
+  if (!next(name, name_column) || !next(source, source_column)) {
+    error(end_column(), "Share requires two song names");
+    return;
+  }
+
+  leave_song();
+
+  const SongEntry* to = find_song(name, name_column);
+  const SongEntry* from = find_song(source, source_column);
+  if (to && from) {
+    if (layout_.song(to->title)->table != layout_.song(from->title)->table) {
+      error(name_column, "Songs can only be shared within the same table");
+    } else {
+      project_.changes_.push_back(ShareChange{to->title, from->title});
+    }
+  }
+
+  expect_end();
+}
+
+void Project::Parser::parse_transpose() {
+  std::string_view offset;
+  size_t column;
+  if (!next(offset, column)) {
+    error(end_column(), "Transpose requires offset");
+    return;
+  }
+
+  const auto value = parse_int(offset);
+  if (value) {
+    transpose_ = *value;
+  } else {
+    error(column, "Invalid transpose '" + std::string(offset) + "'");
+  }
+
+  expect_end();
+}
+
+void Project::Parser::parse_pattern() {
+  // The four channel lines always follow, so consume them even if the
+  // pattern itself is bad to keep them from being read as commands.
+  channels_left_ = kChannels;
+  for (auto& notes : channels_) notes.clear();
+
+  if (has_song(1, "Pattern") && sequenced_) {
+    warning(1, "Song already sequenced");
+  }
+
+  std::string_view token;
+  size_t column;
+  if (!next(token, column)) {
+    error(end_column(), "Pattern requires tempo");
+    return;
+  }
+  const auto tempo = parse_byte(token, column);
+  if (tempo) tempo_ = *tempo;
+
+  voiced_ = next(token, column);
+  if (voiced_) {
+    // two bytes means a voiced pattern (i.e. title music)
+    const auto voice2 = parse_byte(token, column);
+    if (voice2) voice2_ = *voice2;
+  }
+
+  expect_end();
+}
+
+void Project::Parser::parse_channel() {
+  const size_t channel = kChannels - channels_left_;
+  Pattern::parse_notes(
+      line_, channels_[channel], transpose_,
+      [this](size_t offset, const std::string& message) {
+        warning(offset + 1, message);
+      });
+
+  if (--channels_left_ > 0) return;
+
+  SongChange* s = song();
+  if (!s) return;
+
+  if (voiced_) {
+    s->patterns.emplace_back(tempo_, voice2_, std::move(channels_[0]),
+                             std::move(channels_[1]), std::move(channels_[2]),
+                             std::move(channels_[3]));
+  } else {
+    s->patterns.emplace_back(tempo_, std::move(channels_[0]),
+                             std::move(channels_[1]), std::move(channels_[2]),
+                             std::move(channels_[3]));
+  }
+}
+
+void Project::Parser::parse_sequence() {
+  if (!has_song(1, "Sequence")) return;
+  if (sequenced_) warning(1, "Song already sequenced");
+
+  SongChange* s = song();
+  const size_t patterns = s->patterns.size();
+  s->sequence.clear();
+
+  std::string_view token;
+  size_t column;
+  while (next(token, column)) {
+    const auto n = parse_unsigned(token);
+    if (!n) {
+      error(column, "Invalid pattern number '" + std::string(token) + "'");
+    } else if (*n > patterns || *n == 0) {
+      error(column, "No such pattern: " + std::string(token) + " (" +
+                        std::to_string(patterns) + ")");
+    } else {
+      s->sequence.push_back(*n - 1);
+    }
+    sequenced_ = true;
+  }
+}
+
+void Project::Parser::finish() {
+  if (channels_left_ > 0) {
+    warning(end_column(), "Reached end of file in the middle of a pattern");
+    while (channels_left_ > 0) {
+      line_ = {};
+      parse_channel();
+    }
+  }
+
+  if (song_ && !sequenced_) {
+    warning(end_column(), "Reached end of file with unsequenced song");
+  }
+}
+
+// Ends a block which is followed by another song, warning as parse_song
+// would on the first line of that song.
+void Project::Parser::end_block() {
+  ++line_number_;
+  leave_song();
+}
+
+Project Project::parse(std::string_view text, const RomLayout& layout) {
+  const Metrics::Timer timer(Metrics::Stage::Parse);
+  return parse_block(text, true, layout);
+}
+
+Project Project::parse_block(std::string_view text, bool last,
+                             const RomLayout& layout) {
+  Project project;
+  Parser parser(project, layout);
+
+  while (!text.empty()) {
+    const size_t eol = text.find('\n');
+    parser.parse_line(text.substr(0, eol));
+    ++project.lines_;
+    if (eol == std::string_view::npos) break;
+    text.remove_prefix(eol + 1);
+  }
+
+  if (last) {
+    parser.finish();
+  } else {
+    parser.end_block();
+  }
+  return project;
+}
+
+std::vector<std::string_view> Project::split_blocks(std::string_view text) {
+  std::vector<std::string_view> blocks;
+  size_t start = 0, pos = 0, channels_left = 0;
+
+  while (pos < text.size()) {
+    const size_t eol = std::min(text.find('\n', pos), text.size());
+    const std::string_view line = text.substr(pos, eol - pos);
+
+    if (channels_left > 0) {
+      // Channel lines are never commands, whatever they start with
+      --channels_left;
+    } else {
+      // Only the first two words matter, the same way Parser splits them
+      std::string_view words[2];
+      size_t i = 0;
+      for (auto& word : words) {
+        while (i < line.size() && is_space(line[i])) ++i;
+        const size_t begin = i;
+        while (i < line.size() && !is_space(line[i])) ++i;
+        word = line.substr(begin, i - begin);
+      }
+
+      if (words[0] == "pattern") {
+        channels_left = Parser::kChannels;
+      } else if (words[0] == "song" && !words[1].empty() && pos > start) {
+        blocks.push_back(text.substr(start, pos - start));
+        start = pos;
+      }
+    }
+
+    pos = eol + 1;
+  }
+
+  if (start < text.size() || blocks.empty()) {
+    blocks.push_back(text.substr(start));
+  }
+  return blocks;
+}
+
+void Project::append(const Project& block, size_t first_line) {
+  changes_.insert(changes_.end(), block.changes_.begin(), block.changes_.end());
+  for (auto d : block.diagnostics_) {
+    d.line += first_line - 1;
+    diagnostics_.push_back(std::move(d));
+  }
+  lines_ += block.lines_;
+}
+
+bool Project::ok() const {
+  for (const auto& d : diagnostics_) {
+    if (d.level == Diagnostic::Level::Error) return false;
+  }
+  return true;
+}
+
+bool Project::apply(Rom& rom) const {
+  if (!ok()) {
+    LOG(ERROR) << "Not applying project with errors";
+    return false;
+  }
+
+  for (const auto& change : changes_) {
+    if (const auto* s = std::get_if<SongChange>(&change)) {
+      Song& song = rom.song(s->title);
+      song.clear();
+      for (const auto& pattern : s->patterns) song.add_pattern(pattern);
+      song.set_sequence(s->sequence);
+      LOG(INFO) << "Replaced song " << song_name(s->title) << " with "
+                << s->patterns.size() << " patterns";
+
+    } else if (const auto* l = std::get_if<LoaderChange>(&change)) {
+      rom.move_song_table(l->table, l->address);
+      LOG(INFO) << "Moving loader "
+                << kLoaders[static_cast<size_t>(l->table)].name << " to "
+                << l->address;
+
+    } else if (const auto* sh = std::get_if<ShareChange>(&change)) {
+      rom.share_song(sh->title, sh->source);
+      LOG(INFO) << "Song " << song_name(sh->title) << " now plays "
+                << song_name(sh->source);
+    }
+  }
+
+  return true;
+}
+
+namespace {
+enum class ChangeKind : uint8_t { Song, Loader, Share };
+}  // namespace
+
+class Project::BinaryParser {
+ public:
+  BinaryParser(Project& project, std::string_view data,
+               const RomLayout& layout)
+      : project_(project), layout_(layout), data_(data), in_(data) {}
+
+  void read();
+
+ private:
+  Project& project_;
+  const RomLayout& layout_;
+  std::string_view data_;
+  BinaryReader in_;
+
+  SongTitle title() {
+    const SongTitle t = static_cast<SongTitle>(in_.u8());
+    if (!song_entry(t) || !layout_.song(t)) in_.fail("Invalid song title");
+    return t;
+  }
+
+  void read_changes();
+  void read_song();
+};
+
+void Project::BinaryParser::read() {
+  read_changes();
+
+  if (in_.failed()) {
+    const size_t pos = in_.error_position();
+    project_.diagnostics_.push_back({Diagnostic::Level::Error, 0, pos + 1,
+                                     "Byte " + std::to_string(pos) + ": " +
+                                         in_.error()});
+  }
+}
+
+void Project::BinaryParser::read_changes() {
+  if (!is_binary(data_)) {
+    in_.fail("Not a binary project");
+    return;
+  }
+  in_.bytes(kBinaryMagic.size());
+
+  const uint16_t version = in_.u16();
+  if (version != kBinaryVersion) {
+    in_.fail("Unsupported version " + std::to_string(version));
+    return;
+  }
+
+  const uint16_t changes = in_.u16();
+  project_.changes_.reserve(changes);
+
+  for (size_t i = 0; i < changes && !in_.failed(); ++i) {
+    const size_t start = in_.position();
+    switch (static_cast<ChangeKind>(in_.u8())) {
+      case ChangeKind::Song:
+        read_song();
+        break;
+
+      case ChangeKind::Loader: {
+        const uint8_t table = in_.u8();
+        in_.u16();
+        const Address address = in_.u32();
+        if (table >= kSongTables) in_.fail("Invalid song table");
+        project_.changes_.push_back(
+            LoaderChange{static_cast<SongTable>(table), address});
+        break;
+      }
+
+      case ChangeKind::Share: {
+        const SongTitle to = title();
+        const SongTitle from = title();
+        in_.u8();
+        if (!in_.failed() &&
+            layout_.song(to)->table != layout_.song(from)->table) {
+          in_.fail_at(start, "Songs can only be shared within the same table");
+        }
+        project_.changes_.push_back(ShareChange{to, from});
+        break;
+      }
+
+      default:
+        in_.fail_at(start, "Unknown change kind");
+        break;
+    }
+  }
+
+  if (!in_.failed() && !in_.done()) in_.fail("Trailing data");
+}
+
+void Project::BinaryParser::read_song() {
+  SongChange song{title(), {}, {}};
+  const uint16_t patterns = in_.u16();
+  const uint16_t length = in_.u16();
+
+  const std::string_view sequence = in_.bytes(length);
+  song.sequence.reserve(sequence.size());
+  for (char c : sequence) {
+    const uint8_t n = static_cast<uint8_t>(c);
+    if (n >= patterns) in_.fail("Sequence refers to missing pattern");
+    song.sequence.push_back(n);
+  }
+  in_.align();
+
+  song.patterns.reserve(patterns);
+  for (size_t i = 0; i < patterns && !in_.failed(); ++i) {
+    song.patterns.push_back(in_.pattern());
+  }
+
+  project_.changes_.push_back(std::move(song));
+}
+
+bool Project::is_binary(std::string_view data) {
+  return data.substr(0, kBinaryMagic.size()) == kBinaryMagic;
+}
+
+Project Project::read_binary(std::string_view data, const RomLayout& layout) {
+  Project project;
+  BinaryParser(project, data, layout).read();
+  return project;
+}
+
+Project Project::load(std::string_view data, const RomLayout& layout) {
+  if (!is_binary(data)) return parse(data, layout);
+  const Metrics::Timer timer(Metrics::Stage::Parse);
+  return read_binary(data, layout);
+}
+
+std::optional<std::string> Project::to_binary() const {
+  std::string out;
+  BinaryWriter w(out);
+
+  w.bytes(kBinaryMagic);
+  w.u16(kBinaryVersion);
+  w.count(changes_.size());
+
+  for (const auto& change : changes_) {
+    if (const auto* s = std::get_if<SongChange>(&change)) {
+      w.u8(static_cast<uint8_t>(ChangeKind::Song));
+      w.u8(static_cast<uint8_t>(s->title));
+      w.count(s->patterns.size());
+      w.count(s->sequence.size());
+      for (byte n : s->sequence) w.u8(n);
+      w.align();
+
+      for (const auto& pattern : s->patterns) w.pattern(pattern);
+
+    } else if (const auto* l = std::get_if<LoaderChange>(&change)) {
+      w.u8(static_cast<uint8_t>(ChangeKind::Loader));
+      w.u8(static_cast<uint8_t>(l->table));
+      w.u16(0);
+      w.u32(l->address);
+
+    } else if (const auto* sh = std::get_if<ShareChange>(&change)) {
+      w.u8(static_cast<uint8_t>(ChangeKind::Share));
+      w.u8(static_cast<uint8_t>(sh->title));
+      w.u8(static_cast<uint8_t>(sh->source));
+      w.u8(0);
+    }
+  }
+
+  if (!w.ok()) return std::nullopt;
+  return out;
+}
+
+std::string Project::to_text() const {
+  ProjectWriter writer;
+
+  for (const auto& change : changes_) {
+    if (const auto* s = std::get_if<SongChange>(&change)) {
+      Song song;
+      for (const auto& pattern : s->patterns) song.add_pattern(pattern);
+      song.set_sequence(s->sequence);
+      writer.add_song(song_name(s->title), song);
+
+    } else if (const auto* l = std::get_if<LoaderChange>(&change)) {
+      writer.add_loader(kLoaders[static_cast<size_t>(l->table)].name,
+                        l->address);
+
+    } else if (const auto* sh = std::get_if<ShareChange>(&change)) {
+      writer.add_share(song_name(sh->title), song_name(sh->source));
+    }
+  }
+
+  return writer.str();
+}
+
+std::ostream& operator<<(std::ostream& os, const Project::Diagnostic& d) {
+  os << d.line << ":" << d.column << ": "
+     << (d.level == Project::Diagnostic::Level::Error ? "error" : "warning")
+     << ": " << d.message;
+  return os;
+}
+
+}  // namespace z2music
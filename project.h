@@ -0,0 +1,114 @@
+#ifndef Z2MUSIC_PROJECT_H_
+#define Z2MUSIC_PROJECT_H_
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "pattern.h"
+#include "registry.h"
+#include "rom.h"
+#include "util.h"
+
+namespace z2music {
+
+// A parsed modder project file.  Parsing never stops at the first problem;
+// every warning and error is collected with its position so they can all be
+// reported at once, and nothing touches the Rom until apply().
+class Project {
+ public:
+  struct Diagnostic {
+    enum class Level { Warning, Error };
+
+    Level level;
+    size_t line;
+    size_t column;
+    std::string message;
+  };
+
+  // Songs are checked against where they are in layout.
+  static Project parse(
+      std::string_view text,
+      const RomLayout& layout = RevisionLayout<Revision::US>::kLayout);
+
+  // The binary format holds the same changes as the text, already parsed.
+  // Everything is little endian and every record is padded to four bytes:
+  //
+  //   header   "Z2MB", u16 version, u16 change count
+  //   song     u8 kind (0), u8 title, u16 patterns, u16 sequence length,
+  //            sequence bytes, then each pattern
+  //   pattern  u8 tempo, u8 voice1, u8 voice2, u8 0, u16 notes per channel,
+  //            then each note as u16 timer, u16 ticks
+  //   loader   u8 kind (1), u8 table, u16 0, u32 address
+  //   share    u8 kind (2), u8 title, u8 source, u8 0
+  static constexpr std::string_view kBinaryMagic = "Z2MB";
+  static constexpr uint16_t kBinaryVersion = 1;
+
+  static bool is_binary(std::string_view data);
+  static Project read_binary(
+      std::string_view data,
+      const RomLayout& layout = RevisionLayout<Revision::US>::kLayout);
+  // Reads either format, whichever the data is in.
+  static Project load(
+      std::string_view data,
+      const RomLayout& layout = RevisionLayout<Revision::US>::kLayout);
+
+  // Empty if the project has more of anything than its field can count, or
+  // notes too long for the format.
+  std::optional<std::string> to_binary() const;
+  std::string to_text() const;
+
+  bool ok() const;
+  const std::vector<Diagnostic>& diagnostics() const { return diagnostics_; }
+  size_t lines() const { return lines_; }
+
+  // Makes every change to the Rom, or none if there were any errors.
+  bool apply(Rom& rom) const;
+
+ private:
+  struct SongChange {
+    SongTitle title;
+    std::vector<Pattern> patterns;
+    std::vector<byte> sequence;
+  };
+
+  struct LoaderChange {
+    SongTable table;
+    Address address;
+  };
+
+  struct ShareChange {
+    SongTitle title;
+    SongTitle source;
+  };
+
+  typedef std::variant<SongChange, LoaderChange, ShareChange> Change;
+
+  std::vector<Change> changes_;
+  std::vector<Diagnostic> diagnostics_;
+  size_t lines_ = 0;
+
+  // Splits text before each line which starts a song, except where that line
+  // is one of the channels of a pattern.
+  static std::vector<std::string_view> split_blocks(std::string_view text);
+  // Parses part of a file.  Unless it is the last part, the file goes on
+  // with another song.
+  static Project parse_block(std::string_view text, bool last,
+                             const RomLayout& layout);
+  // Adds the changes of a block parsed separately, which starts at first_line.
+  void append(const Project& block, size_t first_line);
+
+  class Parser;
+  class BinaryParser;
+  friend class IncrementalParser;
+};
+
+std::ostream& operator<<(std::ostream& os, const Project::Diagnostic& d);
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_PROJECT_H_
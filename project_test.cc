@@ -0,0 +1,202 @@
+#include "project.h"
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "pattern.h"
+
+namespace z2music {
+
+TEST(ProjectTest, ApplySongs) {
+  const auto project = Project::parse(
+      "song TownTheme\n"
+      "pattern 0x18\n"
+      "a4.4 c5 e5 a5\n"
+      "r.4 r r r\n"
+      "\n"
+      "x.8 x\n"
+      "sequence 1 1\n"
+      "\n"
+      "share HouseTheme TownTheme\n");
+
+  EXPECT_TRUE(project.ok());
+  EXPECT_TRUE(project.diagnostics().empty());
+  EXPECT_EQ(project.lines(), 9);
+
+  FakeRom rom;
+  ASSERT_TRUE(project.apply(rom));
+
+  const Song& song = rom.song(Rom::SongTitle::TownTheme);
+  ASSERT_EQ(song.pattern_count(), 1);
+  EXPECT_EQ(song.sequence(), std::vector<byte>({0, 0}));
+
+  const Pattern& pattern = song.pattern(0);
+  EXPECT_EQ(pattern.tempo(), 0x18);
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Pulse1), "A4.4 C5 E5 A5");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Triangle), "");
+  EXPECT_EQ(pattern.dump_notes(Pattern::Channel::Noise), "G#3.8 G#3");
+
+  EXPECT_EQ(&rom.song(Rom::SongTitle::HouseTheme), &song);
+}
+
+TEST(ProjectTest, VoicedPattern) {
+  const auto project = Project::parse(
+      "song TitleIntro\n"
+      "pattern 0x00 0x84\n"
+      "a4.4\n\n\n\n"
+      "sequence 1\n");
+  ASSERT_TRUE(project.ok());
+
+  FakeRom rom;
+  project.apply(rom);
+
+  const Pattern& pattern = rom.song(Rom::SongTitle::TitleIntro).pattern(0);
+  EXPECT_TRUE(pattern.voiced());
+  EXPECT_EQ(pattern.voice2(), 0x84);
+}
+
+TEST(ProjectTest, ReportsEveryError) {
+  const auto project = Project::parse(
+      "song NoSuchSong\n"
+      "pattern 0x18\n"
+      "a4.4\n\n\n\n"
+      "loader Town 0x1zz\n"
+      "song BattleTheme\n"
+      "pattern 0x100\n"
+      "a4.4 q4\n\n\n\n"
+      "sequence 1 2\n"
+      "share TownTheme BattleTheme\n"
+      "frobnicate\n");
+
+  EXPECT_FALSE(project.ok());
+
+  const auto& d = project.diagnostics();
+  ASSERT_EQ(d.size(), 7);
+
+  EXPECT_EQ(d[0].level, Project::Diagnostic::Level::Error);
+  EXPECT_EQ(d[0].line, 1);
+  EXPECT_EQ(d[0].column, 6);
+
+  // Invalid address
+  EXPECT_EQ(d[1].line, 7);
+  EXPECT_EQ(d[1].column, 13);
+
+  // Tempo out of range
+  EXPECT_EQ(d[2].line, 9);
+  EXPECT_EQ(d[2].column, 9);
+
+  // Unknown note character
+  EXPECT_EQ(d[3].level, Project::Diagnostic::Level::Warning);
+  EXPECT_EQ(d[3].line, 10);
+  EXPECT_EQ(d[3].column, 6);
+
+  // No pattern 2
+  EXPECT_EQ(d[4].line, 14);
+  EXPECT_EQ(d[4].column, 12);
+
+  // Shared across tables
+  EXPECT_EQ(d[5].line, 15);
+  EXPECT_EQ(d[5].column, 7);
+
+  EXPECT_EQ(d[6].level, Project::Diagnostic::Level::Warning);
+  EXPECT_EQ(d[6].line, 16);
+
+  FakeRom rom;
+  const Song before = rom.song(Rom::SongTitle::BattleTheme);
+  EXPECT_FALSE(project.apply(rom));
+  EXPECT_EQ(rom.song(Rom::SongTitle::BattleTheme).pattern_count(),
+            before.pattern_count());
+}
+
+TEST(ProjectTest, SongsFromLayout) {
+  // A layout which stops before the town songs
+  RomLayout layout = RevisionLayout<Revision::US>::kLayout;
+  layout.songs =
+      layout.songs.first(static_cast<size_t>(SongTitle::TownIntro));
+
+  const auto project = Project::parse(
+      "song TownTheme\n"
+      "pattern 0x18\n"
+      "a4.4\n\n\n\n"
+      "sequence 1\n",
+      layout);
+  EXPECT_FALSE(project.ok());
+  ASSERT_EQ(project.diagnostics().size(), 1);
+  EXPECT_EQ(project.diagnostics()[0].column, 6);
+}
+
+TEST(ProjectTest, BinaryRoundTrip) {
+  const auto text = Project::parse(
+      "loader Town 0x1a400\n"
+      "song TitleIntro\n"
+      "pattern 0x00 0x84\n"
+      "a4.4 c#5.2t\n\n\n\n"
+      "sequence 1\n"
+      "song TownTheme\n"
+      "pattern 0x18\n"
+      "a4.4 r.8\nr.12\n\nx.2 x\n"
+      "pattern 0x20\n"
+      "e5.16\n\n\n\n"
+      "sequence 1 2 1\n"
+      "share HouseTheme TownTheme\n");
+  ASSERT_TRUE(text.ok());
+
+  const auto binary = text.to_binary();
+  ASSERT_TRUE(binary);
+  EXPECT_TRUE(Project::is_binary(*binary));
+  EXPECT_EQ(binary->size() % 4, 0);
+
+  const auto loaded = Project::load(*binary);
+  ASSERT_TRUE(loaded.ok());
+  EXPECT_EQ(loaded.to_text(), text.to_text());
+  EXPECT_EQ(loaded.to_binary(), binary);
+
+  // The text form parses back to the same project too
+  const auto reparsed = Project::parse(loaded.to_text());
+  ASSERT_TRUE(reparsed.ok());
+  EXPECT_EQ(reparsed.to_binary(), binary);
+
+  FakeRom a, b;
+  text.apply(a);
+  loaded.apply(b);
+  EXPECT_EQ(b.song_table_address(SongTable::Town),
+            a.song_table_address(SongTable::Town));
+
+  const Song& song = b.song(Rom::SongTitle::TownTheme);
+  ASSERT_EQ(song.pattern_count(), 2);
+  EXPECT_EQ(song.pattern(0).dump_notes(Pattern::Channel::Noise), "G#3.2 G#3");
+  EXPECT_EQ(&b.song(Rom::SongTitle::HouseTheme), &song);
+  EXPECT_EQ(b.song(Rom::SongTitle::TitleIntro).pattern(0).voice2(), 0x84);
+}
+
+TEST(ProjectTest, BadBinary) {
+  const auto project = Project::parse(
+      "song TownTheme\n"
+      "pattern 0x18\n"
+      "a4.4\n\n\n\n"
+      "sequence 1\n");
+  const std::string binary = project.to_binary().value();
+
+  EXPECT_FALSE(Project::read_binary(binary.substr(0, binary.size() - 2)).ok());
+  EXPECT_FALSE(Project::read_binary(binary + "xxxx").ok());
+
+  std::string version = binary;
+  version[4] = 2;
+  EXPECT_FALSE(Project::read_binary(version).ok());
+
+  std::string title = binary;
+  title[9] = 99;
+  const auto bad = Project::read_binary(title);
+  ASSERT_EQ(bad.diagnostics().size(), 1);
+  EXPECT_EQ(bad.diagnostics()[0].column, 11);
+}
+
+TEST(ProjectTest, TooBigForBinary) {
+  // The change count is a u16
+  std::string text;
+  for (size_t i = 0; i <= 0xffff; ++i) text += "loader Town 0xa800\n";
+  const auto project = Project::parse(text);
+  ASSERT_TRUE(project.ok());
+  EXPECT_FALSE(project.to_binary());
+}
+
+}  // namespace z2music
@@ -0,0 +1,80 @@
+#include "project_writer.h"
+
+#include <charconv>
+#include <cstdio>
+#include <iterator>
+
+#include "pattern.h"
+
+namespace z2music {
+
+void ProjectWriter::add_song(std::string_view name, const Song& song) {
+  buffer_ += "song ";
+  buffer_ += name;
+  buffer_ += '\n';
+
+  for (size_t i = 0; i < song.pattern_count(); ++i) {
+    const Pattern& pattern = song.pattern(i);
+
+    buffer_ += "pattern ";
+    if (pattern.voiced()) {
+      add_byte(pattern.voice1());
+      buffer_ += ' ';
+      add_byte(pattern.voice2());
+    } else {
+      add_byte(pattern.tempo());
+    }
+    buffer_ += '\n';
+
+    for (auto ch : {Pattern::Channel::Pulse1, Pattern::Channel::Pulse2,
+                    Pattern::Channel::Triangle, Pattern::Channel::Noise}) {
+      pattern.dump_notes(ch, buffer_);
+      buffer_ += '\n';
+    }
+  }
+
+  if (!song.empty()) {
+    buffer_ += "sequence";
+    for (size_t n : song.sequence()) {
+      char number[8];
+      const char* end = std::to_chars(number, std::end(number), n + 1).ptr;
+      buffer_ += ' ';
+      buffer_.append(number, end - number);
+    }
+    buffer_ += "\n\n";
+  }
+}
+
+void ProjectWriter::add_loader(std::string_view name, Address address) {
+  // Same as the stream operator in util.cc
+  char text[16];
+  const int length = std::snprintf(text, sizeof(text), "0x%06x",
+                                   static_cast<unsigned int>(address));
+
+  buffer_ += "loader ";
+  buffer_ += name;
+  buffer_ += ' ';
+  buffer_.append(text, length);
+  buffer_ += "\n\n";
+}
+
+void ProjectWriter::add_share(std::string_view name, std::string_view source) {
+  buffer_ += "share ";
+  buffer_ += name;
+  buffer_ += ' ';
+  buffer_ += source;
+  buffer_ += "\n\n";
+}
+
+void ProjectWriter::write(std::ostream& os) const {
+  os.write(buffer_.data(), buffer_.size());
+}
+
+void ProjectWriter::add_byte(byte b) {
+  // Same as the stream operator in util.cc
+  static constexpr char kHex[] = "0123456789abcdef";
+  const char text[4] = {'0', 'x', kHex[b >> 4], kHex[b & 0x0f]};
+  buffer_.append(text, sizeof(text));
+}
+
+}  // namespace z2music
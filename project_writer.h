@@ -0,0 +1,32 @@
+#ifndef Z2MUSIC_PROJECT_WRITER_H_
+#define Z2MUSIC_PROJECT_WRITER_H_
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "song.h"
+#include "util.h"
+
+namespace z2music {
+
+// Formats songs as project file text, the inverse of Project::parse.  All
+// the text goes into one buffer which is written out in a single call.
+class ProjectWriter {
+ public:
+  void add_song(std::string_view name, const Song& song);
+  void add_loader(std::string_view name, Address address);
+  void add_share(std::string_view name, std::string_view source);
+
+  const std::string& str() const { return buffer_; }
+  void write(std::ostream& os) const;
+
+ private:
+  std::string buffer_;
+
+  void add_byte(byte b);
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_PROJECT_WRITER_H_
@@ -0,0 +1,63 @@
+#include "project_writer.h"
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "project.h"
+
+namespace z2music {
+
+TEST(ProjectWriterTest, Format) {
+  Song song;
+  song.add_pattern({0x18, Pattern::parse_notes("a4.4 c#5 r.2t x.2t"),
+                    Pattern::parse_notes("r.8"),
+                    {},
+                    Pattern::parse_notes("x.1 x")});
+  song.add_pattern({0x00, 0x84, Pattern::parse_notes("bb3.16"), {}, {}, {}});
+  song.set_sequence({0, 1, 0});
+
+  ProjectWriter writer;
+  writer.add_song("TownTheme", song);
+  writer.add_song("HouseTheme", Song());
+
+  EXPECT_EQ(writer.str(),
+            "song TownTheme\n"
+            "pattern 0x18\n"
+            "A4.4 C#5 r.2t G#3\n"
+            "r.8\n"
+            "\n"
+            "G#3.1 G#3\n"
+            "pattern 0x00 0x84\n"
+            "A#3.16\n"
+            "\n"
+            "\n"
+            "\n"
+            "sequence 1 2 1\n"
+            "\n"
+            "song HouseTheme\n");
+}
+
+TEST(ProjectWriterTest, RoundTrip) {
+  FakeRom rom;
+  Song& song = rom.song(Rom::SongTitle::BattleTheme);
+  song.clear();
+  song.add_pattern({0x20, Pattern::parse_notes("c5.4 d5 e5.8 r"),
+                    Pattern::parse_notes("c4.16"), Pattern::parse_notes("r.16"),
+                    {}});
+  song.set_sequence({0, 0});
+
+  ProjectWriter writer;
+  writer.add_song("BattleTheme", song);
+
+  const auto project = Project::parse(writer.str());
+  ASSERT_TRUE(project.ok());
+
+  FakeRom other;
+  project.apply(other);
+
+  ProjectWriter again;
+  again.add_song("BattleTheme", other.song(Rom::SongTitle::BattleTheme));
+  EXPECT_EQ(again.str(), writer.str());
+}
+
+}  // namespace z2music
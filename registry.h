@@ -0,0 +1,177 @@
+#ifndef Z2MUSIC_REGISTRY_H_
+#define Z2MUSIC_REGISTRY_H_
+
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+#include "rom_layout.h"
+#include "util.h"
+
+namespace z2music {
+
+struct SongEntry {
+  std::string_view name;
+  SongTitle title;
+};
+
+struct LoaderEntry {
+  std::string_view name;
+  SongTable table;
+};
+
+// The name of every song, in the same order as SongTitle.  Where each song
+// is in a ROM comes from RomLayout::songs.
+constexpr std::array<SongEntry, 25> kSongs = {{
+    {"TitleIntro", SongTitle::TitleIntro},
+    {"TitleThemeStart", SongTitle::TitleThemeStart},
+    {"TitleThemeBuildup", SongTitle::TitleThemeBuildup},
+    {"TitleThemeMain", SongTitle::TitleThemeMain},
+    {"TitleThemeBreakdown", SongTitle::TitleThemeBreakdown},
+
+    {"OverworldIntro", SongTitle::OverworldIntro},
+    {"OverworldTheme", SongTitle::OverworldTheme},
+    {"BattleTheme", SongTitle::BattleTheme},
+    {"CaveItemFanfare", SongTitle::CaveItemFanfare},
+
+    {"TownIntro", SongTitle::TownIntro},
+    {"TownTheme", SongTitle::TownTheme},
+    {"HouseTheme", SongTitle::HouseTheme},
+    {"TownItemFanfare", SongTitle::TownItemFanfare},
+
+    {"PalaceIntro", SongTitle::PalaceIntro},
+    {"PalaceTheme", SongTitle::PalaceTheme},
+    {"BossTheme", SongTitle::BossTheme},
+    {"PalaceItemFanfare", SongTitle::PalaceItemFanfare},
+    {"CrystalFanfare", SongTitle::CrystalFanfare},
+
+    {"GreatPalaceIntro", SongTitle::GreatPalaceIntro},
+    {"GreatPalaceTheme", SongTitle::GreatPalaceTheme},
+    {"ZeldaTheme", SongTitle::ZeldaTheme},
+    {"CreditsTheme", SongTitle::CreditsTheme},
+    {"GreatPalaceItemFanfare", SongTitle::GreatPalaceItemFanfare},
+    {"TriforceFanfare", SongTitle::TriforceFanfare},
+    {"FinalBossTheme", SongTitle::FinalBossTheme},
+}};
+
+// Names used by the loader command, in the same order as SongTable.
+constexpr std::array<LoaderEntry, kSongTables> kLoaders = {{
+    {"Title", SongTable::Title},
+    {"Overworld", SongTable::Overworld},
+    {"Town", SongTable::Town},
+    {"Palace", SongTable::Palace},
+    {"GreatPalace", SongTable::GreatPalace},
+}};
+
+// A hash table of fixed keys with no collisions, found at compile time by
+// trying seeds until every key lands in its own bucket.
+template <size_t N, size_t M>
+class PerfectHash {
+ public:
+  static_assert((M & (M - 1)) == 0, "Bucket count must be a power of two");
+  static_assert(N < M, "Need more buckets than keys");
+
+  static constexpr size_t kNotFound = N;
+
+  template <typename T>
+  consteval explicit PerfectHash(const std::array<T, N>& entries)
+      : seed_(0), keys_(), buckets_() {
+    for (size_t i = 0; i < N; ++i) keys_[i] = entries[i].name;
+
+    for (; seed_ < kMaxSeed; ++seed_) {
+      if (fill()) return;
+    }
+    throw "No perfect hash seed found";
+  }
+
+  constexpr size_t find(std::string_view key) const {
+    const uint8_t i = buckets_[hash(key, seed_) & (M - 1)];
+    return i < N && keys_[i] == key ? i : kNotFound;
+  }
+
+  static constexpr uint32_t hash(std::string_view key, uint32_t seed) {
+    // FNV-1a with the seed mixed into the basis
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (char c : key) {
+      h ^= static_cast<uint8_t>(c);
+      h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+  }
+
+ private:
+  static constexpr uint32_t kMaxSeed = 1 << 16;
+  static constexpr uint8_t kEmpty = 0xff;
+
+  uint32_t seed_;
+  std::array<std::string_view, N> keys_;
+  std::array<uint8_t, M> buckets_;
+
+  constexpr bool fill() {
+    buckets_.fill(kEmpty);
+    for (size_t i = 0; i < N; ++i) {
+      uint8_t& bucket = buckets_[hash(keys_[i], seed_) & (M - 1)];
+      if (bucket != kEmpty) return false;
+      bucket = i;
+    }
+    return true;
+  }
+};
+
+constexpr PerfectHash<kSongs.size(), 64> kSongIndex{kSongs};
+constexpr PerfectHash<kLoaders.size(), 8> kLoaderIndex{kLoaders};
+
+constexpr const SongEntry* song_by_name(std::string_view name) {
+  const size_t i = kSongIndex.find(name);
+  return i == kSongIndex.kNotFound ? nullptr : &kSongs[i];
+}
+
+constexpr const LoaderEntry* loader_by_name(std::string_view name) {
+  const size_t i = kLoaderIndex.find(name);
+  return i == kLoaderIndex.kNotFound ? nullptr : &kLoaders[i];
+}
+
+constexpr const SongEntry* song_entry(SongTitle title) {
+  const size_t i = static_cast<size_t>(title);
+  return i == 0 || i > kSongs.size() ? nullptr : &kSongs[i - 1];
+}
+
+constexpr std::string_view song_name(SongTitle title) {
+  const SongEntry* entry = song_entry(title);
+  return entry ? entry->name : "Unknown";
+}
+
+consteval bool registry_in_order() {
+  for (size_t i = 0; i < kSongs.size(); ++i) {
+    if (kSongs[i].title != static_cast<SongTitle>(i + 1)) return false;
+  }
+  for (size_t i = 0; i < kLoaders.size(); ++i) {
+    if (kLoaders[i].table != static_cast<SongTable>(i)) return false;
+  }
+  return true;
+}
+
+static_assert(registry_in_order(), "Registry must match enum order");
+static_assert(static_cast<size_t>(SongTitle::FinalBossTheme) == kSongs.size(),
+              "Every song title needs a registry entry");
+
+// RomLayout::songs is indexed by SongTitle, so it has a slot for Unknown
+// first and then one for each registry entry in the same order.
+template <Revision R>
+consteval bool layout_matches_registry() {
+  const auto& songs = RevisionLayout<R>::kSongs;
+  if (std::size(songs) != kSongs.size() + 1) return false;
+  if (songs[0].slot != RomLayout::kNoSlot) return false;
+  for (size_t i = 1; i < std::size(songs); ++i) {
+    if (songs[i].slot == RomLayout::kNoSlot) return false;
+  }
+  return true;
+}
+
+static_assert(layout_matches_registry<Revision::US>(),
+              "Every registry entry needs a song slot in the US layout");
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_REGISTRY_H_
@@ -0,0 +1,45 @@
+#include "registry.h"
+
+#include "gtest/gtest.h"
+#include "rom.h"
+
+namespace z2music {
+
+static_assert(song_by_name("ZeldaTheme")->title == SongTitle::ZeldaTheme);
+static_assert(song_by_name("Zelda") == nullptr);
+static_assert(loader_by_name("Town")->table == SongTable::Town);
+static_assert(song_name(SongTitle::BattleTheme) == "BattleTheme");
+
+TEST(RegistryTest, SongRoundTrip) {
+  for (const auto& entry : kSongs) {
+    EXPECT_EQ(song_by_name(entry.name), &entry);
+    EXPECT_EQ(song_name(entry.title), entry.name);
+    EXPECT_EQ(Rom::title_by_name(entry.name), entry.title);
+  }
+}
+
+TEST(RegistryTest, EverySongHasSlot) {
+  const RomLayout& layout = RevisionLayout<Revision::US>::kLayout;
+  for (const auto& entry : kSongs) {
+    EXPECT_NE(layout.song(entry.title), nullptr) << entry.name;
+  }
+  EXPECT_EQ(layout.song(SongTitle::Unknown), nullptr);
+  EXPECT_EQ(layout.song(SongTitle::BossTheme)->slot, 3);
+}
+
+TEST(RegistryTest, UnknownNames) {
+  EXPECT_EQ(song_by_name(""), nullptr);
+  EXPECT_EQ(song_by_name("titleintro"), nullptr);
+  EXPECT_EQ(song_by_name("TitleIntro "), nullptr);
+  EXPECT_EQ(loader_by_name("Credits"), nullptr);
+  EXPECT_EQ(song_name(SongTitle::Unknown), "Unknown");
+  EXPECT_EQ(Rom::title_by_name("Overworld"), SongTitle::Unknown);
+}
+
+TEST(RegistryTest, Loaders) {
+  for (const auto& entry : kLoaders) {
+    EXPECT_EQ(loader_by_name(entry.name), &entry);
+  }
+}
+
+}  // namespace z2music
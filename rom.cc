@@ -1,70 +1,112 @@
 #include "rom.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
 
 #include "absl/log/log.h"
+#include "binary_io.h"
+#include "metrics.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 namespace z2music {
 
-Rom::Rom(const std::string& filename) {
-  std::ifstream file(filename, std::ios::binary);
-  if (file.is_open()) {
-    file.read(reinterpret_cast<char*>(&header_[0]), kHeaderSize);
-    file.read(reinterpret_cast<char*>(&data_[0]), kRomSize);
-
-    title_screen_table = get_song_table_address(kTitleScreenLoader);
-    overworld_song_table = get_song_table_address(kOverworldLoader);
-    town_song_table = get_song_table_address(kTownLoader);
-    palace_song_table = get_song_table_address(kPalaceLoader);
-    great_palace_song_table = get_song_table_address(kGreatPalaceLoader);
-
-    credits_ = read_credits(kCreditsTableAddress);
-    pitch_lut_ = read_pitch_lut(kPitchLUTAddress, 62);
-    title_pitch_lut_ = read_pitch_lut(kTitlePitchLUTAddress, 64);
-    duration_lut_ = read_duration_lut(kDurationLUTAddress, 48);
-    title_duration_lut_ = read_duration_lut(kTitleDurationLUTAddress, 11);
-
-    songs_[SongTitle::TitleIntro] = read_song(title_screen_table, 0);
-    songs_[SongTitle::TitleThemeStart] = read_song(title_screen_table, 1);
-    songs_[SongTitle::TitleThemeBuildup] = read_song(title_screen_table, 2);
-    songs_[SongTitle::TitleThemeMain] = read_song(title_screen_table, 3);
-    songs_[SongTitle::TitleThemeBreakdown] = read_song(title_screen_table, 4);
-
-    songs_[SongTitle::OverworldIntro] = read_song(overworld_song_table, 0);
-    songs_[SongTitle::OverworldTheme] = read_song(overworld_song_table, 1);
-    songs_[SongTitle::BattleTheme] = read_song(overworld_song_table, 2);
-    songs_[SongTitle::CaveItemFanfare] = read_song(overworld_song_table, 4);
-
-    songs_[SongTitle::TownIntro] = read_song(town_song_table, 0);
-    songs_[SongTitle::TownTheme] = read_song(town_song_table, 1);
-    songs_[SongTitle::HouseTheme] = read_song(town_song_table, 2);
-    songs_[SongTitle::TownItemFanfare] = read_song(town_song_table, 4);
-
-    songs_[SongTitle::PalaceIntro] = read_song(palace_song_table, 0);
-    songs_[SongTitle::PalaceTheme] = read_song(palace_song_table, 1);
-    songs_[SongTitle::BossTheme] = read_song(palace_song_table, 3);
-    songs_[SongTitle::PalaceItemFanfare] = read_song(palace_song_table, 4);
-    songs_[SongTitle::CrystalFanfare] = read_song(palace_song_table, 6);
-
-    songs_[SongTitle::GreatPalaceIntro] = read_song(great_palace_song_table, 0);
-    songs_[SongTitle::GreatPalaceTheme] = read_song(great_palace_song_table, 1);
-    songs_[SongTitle::ZeldaTheme] = read_song(great_palace_song_table, 2);
-    songs_[SongTitle::CreditsTheme] = read_song(great_palace_song_table, 3);
-    songs_[SongTitle::GreatPalaceItemFanfare] =
-        read_song(great_palace_song_table, 4);
-    songs_[SongTitle::TriforceFanfare] = read_song(great_palace_song_table, 5);
-    songs_[SongTitle::FinalBossTheme] = read_song(great_palace_song_table, 6);
-
-    read_all_sfx_notes();
+Rom::Rom(const RomLayout& layout) : layout_(layout) {
+  for (size_t i = 0; i < kSongTables; ++i) {
+    tables_[i] = layout_.tables[i].address;
+    scores_[i] = Score(layout_.tables[i].slots);
+  }
+}
 
-  } else {
+Rom::Rom(const std::string& filename, const RomLayout& layout) : Rom(layout) {
+  if (load_image(filename)) decode();
+}
+
+Rom Rom::from_image(std::string_view image, const RomLayout& layout) {
+  Rom rom(layout);
+  rom.copy_image(image);
+  rom.decode();
+  return rom;
+}
+
+bool Rom::load_image(const std::string& filename) {
+  const Metrics::Timer timer(Metrics::Stage::Load);
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
     LOG(ERROR) << "Unable to open ROM file: " << filename;
+    return false;
   }
+
+  file.read(reinterpret_cast<char*>(&header_[0]), kHeaderSize);
+  file.read(reinterpret_cast<char*>(&data_[0]), kRomSize);
+  return true;
+}
+
+void Rom::copy_image(std::string_view image) {
+  if (image.size() < kHeaderSize + kRomSize) {
+    LOG(WARNING) << "ROM image is only " << image.size() << " bytes";
+  }
+
+  const size_t header = std::min(image.size(), kHeaderSize);
+  std::copy_n(image.begin(), header, &header_[0]);
+  image.remove_prefix(header);
+  std::copy_n(image.begin(), std::min(image.size(), kRomSize), &data_[0]);
+}
+
+bool Rom::matches_layout() const {
+  auto fits = [](Address address, size_t length) {
+    return address + length <= kRomSize;
+  };
+
+  for (const auto& table : layout_.tables) {
+    if (!fits(table.loader, 3) || getc(table.loader) != 0xb9) return false;
+    const Address address = getw(table.loader + 1) + layout_.bank_offset;
+    if (!fits(address, Score::kSlots)) return false;
+  }
+
+  return fits(layout_.pitch_lut.address, layout_.pitch_lut.entries * 2) &&
+         fits(layout_.title_pitch_lut.address,
+              layout_.title_pitch_lut.entries * 2) &&
+         fits(layout_.duration_lut.address, layout_.duration_lut.entries) &&
+         fits(layout_.title_duration_lut.address,
+              layout_.title_duration_lut.entries) &&
+         fits(layout_.credits_table, Credits::kPages * 4);
+}
+
+void Rom::decode() {
+  const Metrics::Timer timer(Metrics::Stage::Decode);
+  if (!matches_layout()) {
+    LOG(ERROR) << "ROM image doesn't match its layout, not decoding it";
+    return;
+  }
+
+  for (size_t i = 0; i < kSongTables; ++i) {
+    tables_[i] = get_song_table_address(layout_.tables[i].loader);
+  }
+
+  credits_ = read_credits(layout_.credits_table);
+  pitch_lut_ =
+      read_pitch_lut(layout_.pitch_lut.address, layout_.pitch_lut.entries);
+  title_pitch_lut_ = read_pitch_lut(layout_.title_pitch_lut.address,
+                                    layout_.title_pitch_lut.entries);
+  duration_lut_ = read_duration_lut(layout_.duration_lut.address,
+                                    layout_.duration_lut.entries);
+  title_duration_lut_ = read_duration_lut(layout_.title_duration_lut.address,
+                                          layout_.title_duration_lut.entries);
+
+  for (size_t i = 0; i < kSongTables; ++i) {
+    scores_[i] = read_score(tables_[i]);
+  }
+
+  read_all_sfx_notes();
 }
 
 byte Rom::getc(Address address) const {
-  if (address > kRomSize) return byte(0xff);
+  if (address >= kRomSize) return byte(0xff);
   return byte(data_[address]);
 }
 
@@ -86,7 +128,7 @@ std::vector<byte> Rom::read(Address address, size_t length) const {
 }
 
 void Rom::putc(Address address, byte data) {
-  if (address > kRomSize) return;
+  if (address >= kRomSize) return;
   data_[address] = data;
 }
 
@@ -162,7 +204,7 @@ std::string Rom::read_string(Address address) const {
     s.append(1, z2_decode_(getc(address + i + 3)));
   }
 
-  LOG(INFO) << "Found string at " << address << " - [" << s << "]";
+  TRACE << "Found string at " << address << " - [" << s << "]";
 
   return s;
 }
@@ -176,61 +218,72 @@ Address Rom::write_string(Address address, const std::string& s) {
   return address + length + 1;
 }
 
-void Rom::commit() {
-  rebuild_pitch_lut();
+bool Rom::commit(std::vector<std::string>& errors) {
+  const Metrics::Timer timer(Metrics::Stage::Commit);
+  if (!rebuild_pitch_lut(errors)) return false;
 
-  commit(title_screen_table,
-         {SongTitle::TitleIntro, SongTitle::TitleThemeStart,
-          SongTitle::TitleThemeBuildup, SongTitle::TitleThemeMain,
-          SongTitle::TitleThemeBreakdown});
+  const uint64_t luts = lut_fingerprint();
+  const EncodedPatterns encoded = encode_patterns(luts);
 
-  commit(overworld_song_table,
-         {SongTitle::OverworldIntro, SongTitle::OverworldTheme,
-          SongTitle::BattleTheme, SongTitle::CaveItemFanfare});
+  std::array<Address, kSongTables> ends;
+  for (size_t i = 0; i < kSongTables; ++i) {
+    const Metrics::Timer table_timer(static_cast<SongTable>(i));
+    ends[i] = commit(tables_[i], scores_[i], encoded, luts);
+    Metrics::table_bytes(static_cast<SongTable>(i), ends[i] - tables_[i]);
+  }
+  const bool fits = check_song_tables(ends, errors);
 
-  commit(town_song_table, {SongTitle::TownIntro, SongTitle::TownTheme,
-                           SongTitle::HouseTheme, SongTitle::TownItemFanfare});
+  commit_credits(layout_.credits_table);
+  commit_pitch_lut(layout_.pitch_lut.address);
+  commit_sfx_notes();
+  return fits;
+}
 
-  commit(palace_song_table,
-         {SongTitle::PalaceIntro, SongTitle::PalaceTheme, SongTitle::BossTheme,
-          SongTitle::PalaceItemFanfare, SongTitle::CrystalFanfare});
+bool Rom::commit() {
+  std::vector<std::string> errors;
+  const bool ok = commit(errors);
+  for (const auto& error : errors) LOG(ERROR) << error;
+  return ok;
+}
 
-  commit(great_palace_song_table,
-         {SongTitle::GreatPalaceIntro, SongTitle::GreatPalaceTheme,
-          SongTitle::ZeldaTheme, SongTitle::CreditsTheme,
-          SongTitle::GreatPalaceItemFanfare, SongTitle::TriforceFanfare,
-          SongTitle::FinalBossTheme});
+bool Rom::save(const std::string& filename) {
+  if (!commit()) return false;
+  const Metrics::Timer timer(Metrics::Stage::Save);
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) return false;
+  const std::string data = image();
+  file.write(data.data(), data.size());
+  return file.good();
+}
 
-  commit_credits(kCreditsTableAddress);
-  commit_pitch_lut(kPitchLUTAddress);
-  commit_sfx_notes();
+std::string Rom::image() const {
+  std::string data;
+  data.reserve(kHeaderSize + kRomSize);
+  data.append(reinterpret_cast<const char*>(&header_[0]), kHeaderSize);
+  data.append(reinterpret_cast<const char*>(&data_[0]), kRomSize);
+  return data;
 }
 
-void Rom::save(const std::string& filename) {
-  commit();
-  std::ofstream file(filename, std::ios::binary);
-  if (file.is_open()) {
-    file.write(reinterpret_cast<char*>(&header_[0]), kHeaderSize);
-    file.write(reinterpret_cast<char*>(&data_[0]), kRomSize);
-  }
-}
-
-void Rom::move_song_table(Address loader_address, Address base_address) {
-  if (loader_address == kTitleScreenLoader) {
-    title_screen_table = base_address + 0x010000;
-  } else if (loader_address == kOverworldLoader) {
-    overworld_song_table = base_address + 0x010000;
-  } else if (loader_address == kTownLoader) {
-    town_song_table = base_address + 0x010000;
-  } else if (loader_address == kPalaceLoader) {
-    palace_song_table = base_address + 0x010000;
-  } else if (loader_address == kGreatPalaceLoader) {
-    great_palace_song_table = base_address + 0x010000;
-  } else {
-    LOG(ERROR) << "Unsure what loader is at " << loader_address
-               << ", need manual update";
+std::vector<Optimizer::Report> Rom::optimize(const Optimizer& optimizer) {
+  std::vector<Optimizer::Report> totals;
+  for (auto& score : scores_) {
+    for (auto& song : score) {
+      Optimizer::accumulate(totals, optimizer.run(song));
+    }
   }
+  return totals;
+}
+
+bool Rom::can_encode_duration(int ticks, byte tempo) const {
+  if (tempo == 0) return title_duration_lut_.exact(ticks, 0);
+  return duration_lut_.exact(ticks, tempo);
+}
 
+void Rom::move_song_table(SongTable table, Address base_address) {
+  const size_t t = static_cast<size_t>(table);
+  tables_[t] = base_address + layout_.bank_offset;
+
+  Address loader_address = layout_.tables[t].loader;
   const WordLE old_base = getw(loader_address + 1);
 
   // Rewind a bit because there is a load before the main section
@@ -241,13 +294,13 @@ void Rom::move_song_table(Address loader_address, Address base_address) {
     if (op == 0xb9) {
       const WordLE addr = getw(loader_address + 1);
       const WordLE new_addr = base_address + addr - old_base;
-      LOG(INFO) << "Found LDA, replacing " << addr << " with " << new_addr;
+      TRACE << "Found LDA, replacing " << addr << " with " << new_addr;
       putw(loader_address + 1, new_addr);
       loader_address += 3;
     } else if (op == 0x4c) {
       LOG(INFO) << "Found JMP, done moving table";
       break;
-    } else if (loader_address >= 0x19c74) {
+    } else if (loader_address >= layout_.music_reset) {
       LOG(INFO) << "Got to music reset code, done moving table";
       break;
     } else {
@@ -256,6 +309,10 @@ void Rom::move_song_table(Address loader_address, Address base_address) {
   }
 }
 
+Address Rom::song_table_address(SongTable table) const {
+  return tables_[static_cast<size_t>(table)];
+}
+
 namespace {
 std::string data_dump(const std::vector<z2music::byte>& data) {
   std::ostringstream output;
@@ -269,49 +326,35 @@ std::string data_dump(const std::vector<z2music::byte>& data) {
 }
 }  // namespace
 
-void Rom::commit(Address address, std::vector<Rom::SongTitle> songs) {
-  std::array<byte, 8> table;
-
-  // TODO make these changeable.
-  // This will require rearchitecting things so that there is a Score object
-  // which is a list of 8 (possibly duplicate) songs.  For now, it's just
-  // hardcode which songs are where in each table.
-  if (address == title_screen_table) {
-    table = {0, 1, 2, 3, 4, 5, 5, 5};
-  } else if (address == overworld_song_table || address == town_song_table) {
-    table = {0, 1, 2, 2, 3, 4, 4, 4};
-  } else if (address == palace_song_table) {
-    table = {0, 1, 1, 2, 3, 5, 4, 5};
-  } else if (address == great_palace_song_table) {
-    table = {0, 1, 2, 3, 4, 5, 6, 7};
-  } else {
-    return;
-  }
-
+Address Rom::commit(Address address, const Score& score,
+                    const EncodedPatterns& encoded, uint64_t luts) {
   /**************
    * SONG TABLE *
    **************/
 
   byte offset = 8;
   std::vector<byte> offsets;
-  offsets.reserve(8);
+  offsets.reserve(score.song_count());
 
   // Calculate song offset table
-  for (auto s : songs) {
+  for (const auto& song : score) {
     offsets.push_back(offset);
-    LOG(INFO) << "Offset for next song: " << offset;
-    offset += songs_.at(s).sequence_length() + 1;
+    if (song.empty()) continue;
+
+    TRACE << "Offset for next song: " << offset;
+    offset += song.sequence_length() + 1;
   }
 
-  // One extra offset for the "empty" song at the end
-  // We could save a whole byte by pointing this at the end of some other
-  // sequence but it's kind of nice to see the double 00 to mean the end of
-  // the sequence data.
-  offsets.push_back(offset);
+  // Empty songs all share the "empty" sequence at the end.  We could save a
+  // whole byte by pointing them at the end of some other sequence but it's
+  // kind of nice to see the double 00 to mean the end of the sequence data.
+  for (size_t i = 0; i < score.song_count(); ++i) {
+    if (score.at(i).empty()) offsets[i] = offset;
+  }
 
   // Write song table to ROM
-  for (size_t i = 0; i < 8; ++i) {
-    putc(address + i, offsets[table[i]]);
+  for (size_t i = 0; i < Score::kSlots; ++i) {
+    putc(address + i, offsets[score.index(i)]);
   }
 
   /******************
@@ -322,17 +365,16 @@ void Rom::commit(Address address, std::vector<Rom::SongTitle> songs) {
   byte seq_offset = 8;
   byte pat_offset = first_pattern;
 
-  for (auto s : songs) {
-    const auto& song = songs_.at(s);
+  for (const auto& song : score) {
+    if (song.empty()) continue;
 
-    LOG(INFO) << "Writing seq at " << seq_offset << " with pat at "
-              << pat_offset;
+    TRACE << "Writing seq at " << seq_offset << " with pat at " << pat_offset;
     const std::vector<byte> seq = song.sequence_data(pat_offset);
-    LOG(INFO) << "Sequence data: " << data_dump(seq);
+    TRACE << "Sequence data: " << data_dump(seq);
     write(address + seq_offset, seq);
 
     for (size_t i = 0; i < song.pattern_count(); ++i) {
-      pat_offset += song.at(i)->metadata_length();
+      pat_offset += song.pattern(i).metadata_length();
     }
 
     seq_offset += seq.size();
@@ -348,15 +390,16 @@ void Rom::commit(Address address, std::vector<Rom::SongTitle> songs) {
   Address note_address = pat_offset + address;
   pat_offset = first_pattern;
 
-  for (auto s : songs) {
-    for (auto p : songs_.at(s).patterns()) {
-      const std::vector<byte> note_data = encode_pattern(p);
+  for (const auto& song : score) {
+    for (const auto& p : song.patterns()) {
+      const std::vector<byte>& note_data =
+          encoded.find(EncodeCache::key(p, luts))->second;
       const std::vector<byte> meta_data = p.meta_data(note_address);
 
       const z2music::Address meta_address = address + pat_offset;
 
-      LOG(INFO) << "Metadata:  " << meta_address << " " << data_dump(meta_data);
-      LOG(INFO) << "Note data: " << note_address << " " << data_dump(note_data);
+      TRACE << "Metadata:  " << meta_address << " " << data_dump(meta_data);
+      TRACE << "Note data: " << note_address << " " << data_dump(note_data);
 
       write(meta_address, meta_data);
       write(note_address, note_data);
@@ -365,49 +408,103 @@ void Rom::commit(Address address, std::vector<Rom::SongTitle> songs) {
       note_address += note_data.size();
     }
   }
+
+  return note_address;
 }
 
-Rom::SongTitle Rom::title_by_name(const std::string& name) {
-  if (name == "TitleIntro") return Rom::SongTitle::TitleIntro;
-  if (name == "TitleThemeStart") return Rom::SongTitle::TitleThemeStart;
-  if (name == "TitleThemeBuildup") return Rom::SongTitle::TitleThemeBuildup;
-  if (name == "TitleThemeMain") return Rom::SongTitle::TitleThemeMain;
-  if (name == "TitleThemeBreakdown") return Rom::SongTitle::TitleThemeBreakdown;
+bool Rom::check_song_tables(const std::array<Address, kSongTables>& ends,
+                            std::vector<std::string>& errors) const {
+  std::vector<std::pair<Address, Address>> used;
 
-  if (name == "OverworldIntro") return Rom::SongTitle::OverworldIntro;
-  if (name == "OverworldTheme") return Rom::SongTitle::OverworldTheme;
-  if (name == "BattleTheme") return Rom::SongTitle::BattleTheme;
-  if (name == "CaveItemFanfare") return Rom::SongTitle::CaveItemFanfare;
+  used.emplace_back(layout_.pitch_lut.address,
+                    layout_.pitch_lut.address + layout_.pitch_lut.entries * 2);
+  used.emplace_back(
+      layout_.title_pitch_lut.address,
+      layout_.title_pitch_lut.address + layout_.title_pitch_lut.entries * 2);
+  used.emplace_back(
+      layout_.duration_lut.address,
+      layout_.duration_lut.address + layout_.duration_lut.entries);
+  used.emplace_back(
+      layout_.title_duration_lut.address,
+      layout_.title_duration_lut.address + layout_.title_duration_lut.entries);
 
-  if (name == "TownIntro") return Rom::SongTitle::TownIntro;
-  if (name == "TownTheme") return Rom::SongTitle::TownTheme;
-  if (name == "HouseTheme") return Rom::SongTitle::HouseTheme;
-  if (name == "TownItemFanfare") return Rom::SongTitle::TownItemFanfare;
+  for (const auto& sfx : layout_.sfx) {
+    used.emplace_back(sfx.address, sfx.address + sfx.length);
+  }
+  for (const auto& table : layout_.tables) {
+    used.emplace_back(table.loader, table.loader + 3);
+  }
 
-  if (name == "PalaceIntro") return Rom::SongTitle::PalaceIntro;
-  if (name == "PalaceTheme") return Rom::SongTitle::PalaceTheme;
-  if (name == "BossTheme") return Rom::SongTitle::BossTheme;
-  if (name == "PalaceItemFanfare") return Rom::SongTitle::PalaceItemFanfare;
-  if (name == "CrystalFanfare") return Rom::SongTitle::CrystalFanfare;
+  const size_t before = errors.size();
+  for (size_t i = 0; i < kSongTables; ++i) {
+    const Address start = tables_[i];
+    const Address end = ends[i];
 
-  if (name == "GreatPalaceIntro") return Rom::SongTitle::GreatPalaceIntro;
-  if (name == "GreatPalaceTheme") return Rom::SongTitle::GreatPalaceTheme;
-  if (name == "ZeldaTheme") return Rom::SongTitle::ZeldaTheme;
-  if (name == "CreditsTheme") return Rom::SongTitle::CreditsTheme;
-  if (name == "GreatPalaceItemFanfare")
-    return Rom::SongTitle::GreatPalaceItemFanfare;
-  if (name == "TriforceFanfare") return Rom::SongTitle::TriforceFanfare;
-  if (name == "FinalBossTheme") return Rom::SongTitle::FinalBossTheme;
+    for (size_t j = i + 1; j < kSongTables; ++j) {
+      if (start < ends[j] && tables_[j] < end) {
+        std::ostringstream error;
+        error << "Song table at " << start << " overlaps song table at "
+              << tables_[j];
+        errors.push_back(error.str());
+      }
+    }
 
-  return Rom::SongTitle::Unknown;
+    for (const auto& region : used) {
+      if (start < region.second && region.first < end) {
+        std::ostringstream error;
+        error << "Song table at " << start << " runs over data at "
+              << region.first;
+        errors.push_back(error.str());
+      }
+    }
+  }
+  return errors.size() == before;
 }
 
-Address Rom::get_song_table_address(Address loader_address) const {
-  // Ensure that we are seing an LDA $addr,y instruction
-  assert(getc(loader_address) == 0xb9);
+Song& Rom::song(SongTitle title) {
+  const auto& s = song_slot(title);
+  return score(s.table).song(s.slot);
+}
+
+const Song& Rom::song(SongTitle title) const {
+  const auto& s = song_slot(title);
+  return score(s.table).song(s.slot);
+}
+
+Score& Rom::score(SongTable table) {
+  return scores_[static_cast<size_t>(table)];
+}
+
+const Score& Rom::score(SongTable table) const {
+  return scores_[static_cast<size_t>(table)];
+}
+
+void Rom::share_song(SongTitle title, SongTitle source) {
+  const auto& s = song_slot(title);
+  const auto& from = song_slot(source);
 
+  if (s.table != from.table) {
+    LOG(ERROR) << "Songs can only be shared within the same table";
+    return;
+  }
+
+  score(s.table).share(s.slot, from.slot);
+}
+
+const RomLayout::Slot& Rom::song_slot(SongTitle title) const {
+  const RomLayout::Slot* slot = layout_.song(title);
+  if (!slot) LOG(FATAL) << "No slot for " << song_name(title);
+  return *slot;
+}
+
+Rom::SongTitle Rom::title_by_name(std::string_view name) {
+  const SongEntry* entry = song_by_name(name);
+  return entry ? entry->title : SongTitle::Unknown;
+}
+
+Address Rom::get_song_table_address(Address loader_address) const {
   // Add the bank offset to the address read
-  const Address addr = getw(loader_address + 1) + 0x10000;
+  const Address addr = getw(loader_address + 1) + layout_.bank_offset;
 
   LOG(INFO) << "Got address " << addr << ", from LSA $" << std::hex
             << std::setw(4) << std::setfill('0') << (addr & 0xffff) << ",y at "
@@ -419,9 +516,12 @@ PitchLUT Rom::read_pitch_lut(Address address, size_t entries) const {
   PitchLUT lut;
   LOG(INFO) << "Reading pitch data from " << address;
   for (size_t i = 0; i < entries; ++i) {
+    // Index 2 is always a rest, so whatever is stored there isn't part of the
+    // table.  Reading it in would shift every pitch after it by one.
+    if (i == 1) continue;
     const Pitch pitch{getwr(address + i * 2)};
     lut.add_pitch(pitch);
-    LOG(INFO) << "Value at offset " << (i * 2) << ": " << pitch;
+    TRACE << "Value at offset " << (i * 2) << ": " << pitch;
   }
   return lut;
 }
@@ -451,27 +551,66 @@ DurationLUT::Row Rom::read_duration_lut_row(Address address,
     data.push_back(getc(address + i));
   }
   DurationLUT::Row row{data};
-  LOG(INFO) << "Durations: " << row;
+  TRACE << "Durations: " << row;
   return row;
 }
 
-Song Rom::read_song(Address address, byte entry) const {
-  auto table = read(address, 8);
+namespace {
+
+// Offsets are single bytes, so the songs and patterns already read are kept
+// in arrays indexed by their offset rather than in maps.
+constexpr int kNotRead = -1;
 
-  std::unordered_map<byte, byte> offset_map;
+// Where each channel's offset from pulse 1 is in a pattern header
+constexpr std::array<size_t, 4> kChannelOffsets = {0, 4, 3, 5};
+
+}  // namespace
+
+Score Rom::read_score(Address address) const {
+  std::array<int, 256> song_map;
+  song_map.fill(kNotRead);
+  std::vector<Song> songs;
+  songs.reserve(Score::kSlots);
+  Score::Layout layout;
+
+  for (size_t i = 0; i < Score::kSlots; ++i) {
+    const byte offset = getc(address + i);
+    if (song_map[offset] == kNotRead) {
+      Song song = read_song(address, offset);
+
+      // Slots with nothing to play are kept apart so that giving one of them
+      // a song doesn't affect the others.
+      if (song.empty()) {
+        layout[i] = songs.size();
+        songs.push_back(std::move(song));
+        continue;
+      }
+
+      song_map[offset] = songs.size();
+      songs.push_back(std::move(song));
+    }
+    layout[i] = song_map[offset];
+  }
+
+  return Score(std::move(songs), layout);
+}
+
+Song Rom::read_song(Address address, byte offset) const {
+  std::array<int, 256> offset_map;
+  offset_map.fill(kNotRead);
   byte n = 0;
 
   Song song;
 
   for (byte i = 0; true; ++i) {
-    byte offset = getc(address + table[entry] + i);
+    byte pattern = getc(address + offset + i);
 
-    if (offset == 0) break;
-    if (offset_map.find(offset) == offset_map.end()) {
-      offset_map[offset] = n++;
-      song.add_pattern(read_pattern(address + offset));
+    if (pattern == 0) break;
+    if (offset_map[pattern] == kNotRead) {
+      offset_map[pattern] = n++;
+      song.add_pattern(read_pattern(address + pattern));
     }
-    song.append_sequence(offset_map.at(offset));
+    song.append_sequence(offset_map[pattern]);
   }
 
   return song;
@@ -480,73 +619,113 @@ Song Rom::read_song(Address address, byte entry) const {
 Pattern Rom::read_pattern(Address address) const {
   Pattern pattern;
 
-  auto header = read(address, 8);
+  std::array<byte, 8> header;
+  for (size_t i = 0; i < header.size(); ++i) header[i] = getc(address + i);
   pattern.tempo(header[0]);
   if (pattern.voiced()) {
     pattern.set_voicing(header[6], header[7]);
-    LOG(INFO) << "Title pattern, voicing: " << pattern.voice1() << " "
-              << pattern.voice2();
+    TRACE << "Title pattern, voicing: " << pattern.voice1() << " "
+          << pattern.voice2();
   }
 
-  Address note_base = (header[2] << 8) + header[1] + 0x10000;
+  Address note_base = (header[2] << 8) + header[1] + layout_.bank_offset;
 
-  pattern.add_notes(Pattern::Channel::Pulse1,
-                    read_notes(note_base, pattern.tempo()));
-  size_t max_length = pattern.length();
+  // Count the notes first, so the pattern's buffer is allocated once at its
+  // final size and each channel is decoded straight into it.
+  size_t max_length = 0;
+  size_t total = 0;
+  for (const Note note : notes(note_base, pattern.tempo())) {
+    max_length += note.ticks();
+    ++total;
+  }
+  for (size_t ch = 1; ch < kChannelOffsets.size(); ++ch) {
+    const byte offset = header[kChannelOffsets[ch]];
+    if (offset == 0) continue;
+    total += std::ranges::distance(
+        notes(note_base + offset, pattern.tempo(), max_length));
+  }
+
+  std::vector<Note> buffer;
+  buffer.reserve(total);
+  std::array<size_t, 4> counts = {};
+  read_notes(note_base, pattern.tempo(), buffer);
+  counts[0] = buffer.size();
 
-  if (header[3])
-    pattern.add_notes(
-        Pattern::Channel::Triangle,
-        read_notes(note_base + header[3], pattern.tempo(), max_length));
-  if (header[4])
-    pattern.add_notes(
-        Pattern::Channel::Pulse2,
-        read_notes(note_base + header[4], pattern.tempo(), max_length));
-  if (header[5])
-    pattern.add_notes(
-        Pattern::Channel::Noise,
-        read_notes(note_base + header[5], pattern.tempo(), max_length));
+  for (size_t ch = 1; ch < counts.size(); ++ch) {
+    const byte offset = header[kChannelOffsets[ch]];
+    if (offset == 0) continue;
+    const size_t before = buffer.size();
+    read_notes(note_base + offset, pattern.tempo(), buffer, max_length);
+    counts[ch] = buffer.size() - before;
+  }
 
+  pattern.set_notes(std::move(buffer), counts);
   return pattern;
 }
 
-std::vector<Note> Rom::read_notes(Address address, byte tempo,
-                                  size_t max_length) const {
+size_t Rom::read_notes(Address address, byte tempo, std::vector<Note>& notes,
+                       size_t max_length) const {
   size_t length = 0;
-  int duration = 0;
-  std::vector<Note> notes;
+  for (const Note note : this->notes(address, tempo, max_length)) {
+    notes.push_back(note);
+    length += note.ticks();
+  }
+
+  if (max_length > 0 && length > max_length) {
+    LOG(WARNING) << "Notes longer than max_length given: " << length << " > "
+                 << max_length << " > " << (length - notes.back().ticks());
+  }
+
+  return length;
+}
+
+Rom::NoteRange Rom::notes(Address pattern, Pattern::Channel ch) const {
+  const byte tempo = getc(pattern);
+  const Address pulse1 = getw(pattern + 1) + layout_.bank_offset;
+  if (ch == Pattern::Channel::Pulse1) return notes(pulse1, tempo);
 
-  while (max_length == 0 || length < max_length) {
-    const byte b = getc(address++);
+  const byte offset = getc(pattern + kChannelOffsets[static_cast<size_t>(ch)]);
+  if (offset == 0) return NoteRange();
+
+  size_t max_length = 0;
+  for (const Note note : notes(pulse1, tempo)) max_length += note.ticks();
+  return notes(pulse1 + offset, tempo, max_length);
+}
+
+Rom::NoteRange::iterator::iterator(const Rom& rom, Address address, byte tempo,
+                                   size_t max_length)
+    : rom_(&rom),
+      address_(address),
+      tempo_(tempo),
+      max_length_(max_length),
+      done_(false) {
+  next();
+}
+
+void Rom::NoteRange::iterator::next() {
+  while (max_length_ == 0 || length_ < max_length_) {
+    const byte b = rom_->getc(address_++);
     // FIXME only Pulse1 and Noise channels can be null terminated
     if (b == 0x00) break;
 
-    if (tempo == 0) {
+    if (tempo_ == 0) {
       if (b & 0x80) {
-        duration = title_duration_lut_.decode(b & 0x0f, 0);
+        duration_ = rom_->title_duration_lut_.decode(b & 0x0f, 0);
+        continue;
       } else if (b == 0x02) {
-        notes.emplace_back(Pitch::none(), duration);
-        length += duration;
+        note_ = Note::rest(duration_);
       } else {
         // The title music adds 4 to non-rests before looking them up
-        auto pitch = title_pitch_lut_[b + 4];
-        notes.emplace_back(pitch, duration);
-        length += duration;
+        note_ = Note(rom_->title_pitch_lut_[b + 4], duration_);
       }
     } else {
-      auto pitch = pitch_lut_[PitchLUT::mask(b)];
-      auto ticks = duration_lut_.decode(DurationLUT::shift(b), tempo);
-      length += ticks;
-      notes.emplace_back(pitch, ticks);
+      note_ = Note(rom_->pitch_lut_[PitchLUT::mask(b)],
+                   rom_->duration_lut_.decode(DurationLUT::shift(b), tempo_));
     }
+    length_ += note_.ticks();
+    return;
   }
-
-  if (max_length > 0 && length > max_length) {
-    LOG(WARNING) << "Notes longer than max_length given: " << length << " > "
-                 << max_length << " > " << (length - notes.back().ticks());
-  }
-
-  return notes;
+  done_ = true;
 }
 
 Credits Rom::read_credits(Address address) const {
@@ -555,8 +734,8 @@ Credits Rom::read_credits(Address address) const {
   for (size_t i = 0; i < Credits::kPages; ++i) {
     const Address addr = address + 4 * i;
 
-    const Address title = getw(addr) + kCreditsBankOffset;
-    const Address names = getw(addr + 2) + kCreditsBankOffset;
+    const Address title = getw(addr) + layout_.credits_bank_offset;
+    const Address names = getw(addr + 2) + layout_.credits_bank_offset;
 
     credits[i].title = read_string(title);
     credits[i].name1 = read_string(names);
@@ -566,22 +745,24 @@ Credits Rom::read_credits(Address address) const {
   return credits;
 }
 
-void Rom::rebuild_pitch_lut() {
+bool Rom::rebuild_pitch_lut(std::vector<std::string>& errors) {
+  const Metrics::Timer timer(Metrics::Stage::PitchLUT);
   LOG(INFO) << "Rebuilding pitch LUT";
 
   PitchSet pitches;
 
-  for (const auto& it : songs_) {
-    const auto& song = it.second;
-    if (!song.title()) {
-      pitches.merge(song.pitches_used());
+  for (const auto& score : scores_) {
+    for (const auto& song : score) {
+      if (!song.title()) song.pitches_used(pitches);
     }
   }
   pitches.erase(Pitch::none());
 
   LOG(INFO) << "Found " << pitches.size() << " unique pitches used.";
   if (pitches.size() >= 32) {
-    LOG(FATAL) << "There are only slots for " << 31 << " unique pitches.";
+    errors.push_back("Songs use " + std::to_string(pitches.size()) +
+                     " pitches, but there are only slots for 31");
+    return false;
   }
 
   pitch_lut_.clear();
@@ -589,7 +770,7 @@ void Rom::rebuild_pitch_lut() {
   // FIXME check that the first pitch isn't used improperly
   for (auto const& p : pitches) {
     byte i = pitch_lut_.add_pitch(p);
-    LOG(INFO) << "Saving pitch " << p << " at index " << i;
+    TRACE << "Saving pitch " << p << " at index " << i;
   }
 
   LOG(INFO) << "Adding pitches used for SFX";
@@ -597,10 +778,11 @@ void Rom::rebuild_pitch_lut() {
     for (const Pitch p : sfx) {
       if (!pitch_lut_.has_pitch(p)) {
         byte i = pitch_lut_.add_pitch(p);
-        LOG(INFO) << "Added missing pitch " << p << " at index " << i;
+        TRACE << "Added missing pitch " << p << " at index " << i;
       }
     }
   }
+  return true;
 }
 
 void Rom::commit_pitch_lut(Address address) {
@@ -616,7 +798,7 @@ void Rom::commit_credits(Address address) {
   for (const auto& credit : credits_) {
     // Add entry for title
     if (credit.title.length() > 0) {
-      putw(table, data - kCreditsBankOffset);
+      putw(table, data - layout_.credits_bank_offset);
       write(data, {0x22, 0x47});
       data = write_string(data + 2, credit.title);
       putc(data++, 0xff);
@@ -626,7 +808,7 @@ void Rom::commit_credits(Address address) {
     }
 
     // Add entry for name1
-    putw(table + 2, data - kCreditsBankOffset);
+    putw(table + 2, data - layout_.credits_bank_offset);
     write(data, {0x22, 0x8b});
     data = write_string(data + 2, credit.name1);
 
@@ -650,9 +832,81 @@ void Rom::commit_sfx_notes() {
   }
 }
 
+uint64_t Rom::lut_fingerprint() const {
+  std::string luts;
+  BinaryWriter w(luts);
+  w.pitches(pitch_lut_);
+  w.pitches(title_pitch_lut_);
+  w.durations(duration_lut_);
+  w.durations(title_duration_lut_);
+  return fingerprint(luts);
+}
+
 std::vector<byte> Rom::encode_pattern(const Pattern& pattern) {
-  std::vector<byte> data;
-  data.reserve(pattern.note_data_length());
+  return encode_pattern(pattern, lut_fingerprint());
+}
+
+std::vector<byte> Rom::encode_pattern(const Pattern& pattern, uint64_t luts) {
+  const std::string_view key = EncodeCache::key(pattern, luts);
+  if (const auto* entry = encode_cache_.find(key)) return entry->data;
+
+  EncodeCache::Entry entry = encode_pattern_data(pattern);
+  std::vector<byte> data = entry.data;
+  encode_cache_.insert(key, std::move(entry));
+  return data;
+}
+
+Rom::EncodedPatterns Rom::encode_patterns(uint64_t luts) {
+  const Metrics::Timer timer(Metrics::Stage::Encode);
+  EncodedPatterns encoded;
+  std::vector<std::pair<const std::string*, const Pattern*>> misses;
+
+  for (const auto& score : scores_) {
+    for (const auto& song : score) {
+      for (size_t i = 0; i < song.pattern_count(); ++i) {
+        const Pattern& pattern = song.pattern(i);
+        const std::string_view key = EncodeCache::key(pattern, luts);
+        if (encoded.contains(key)) continue;
+
+        if (const auto* entry = encode_cache_.find(key)) {
+          encoded.emplace(key, entry->data);
+        } else {
+          const auto it = encoded.emplace(key, std::vector<byte>()).first;
+          misses.emplace_back(&it->first, &pattern);
+        }
+      }
+    }
+  }
+
+  // Starting a thread costs about as much as encoding a dozen patterns, so
+  // only use as many as there is work for.
+  constexpr size_t kPatternsPerThread = 16;
+  const size_t threads =
+      std::min(encode_threads_ > 0 ? encode_threads_
+                                   : ThreadPool::default_threads(),
+               (misses.size() + kPatternsPerThread - 1) / kPatternsPerThread);
+
+  Metrics::count(Metrics::Counter::PatternsCached,
+                 encoded.size() - misses.size());
+  Metrics::count(Metrics::Counter::PatternsEncoded, misses.size());
+
+  std::vector<EncodeCache::Entry> entries(misses.size());
+  parallel_for(misses.size(), threads, [&](size_t i) {
+    entries[i] = encode_pattern_data(*misses[i].second);
+  });
+
+  // Back in order, so the cache is the same however the work was split up
+  for (size_t i = 0; i < misses.size(); ++i) {
+    encoded.find(*misses[i].first)->second = entries[i].data;
+    encode_cache_.insert(*misses[i].first, std::move(entries[i]));
+  }
+
+  return encoded;
+}
+
+EncodeCache::Entry Rom::encode_pattern_data(const Pattern& pattern) const {
+  EncodeCache::Entry entry;
+  entry.data.reserve(pattern.note_data_length());
 
   const std::array<Pattern::Channel, 4> channels = {
       Pattern::Channel::Pulse1,
@@ -661,24 +915,25 @@ std::vector<byte> Rom::encode_pattern(const Pattern& pattern) {
       Pattern::Channel::Noise,
   };
 
-  for (auto ch : channels) {
+  for (size_t i = 0; i < channels.size(); ++i) {
+    const auto ch = channels[i];
     auto c = encode_note_data(pattern.notes(ch), pattern.tempo(),
                               pattern.pad_note_data(ch), pattern.voiced());
-    data.insert(data.end(), c.begin(), c.end());
+    entry.lengths[i] = c.size();
+    entry.data.insert(entry.data.end(), c.begin(), c.end());
   }
 
-  return data;
+  return entry;
 }
 
-std::vector<byte> Rom::encode_note_data(const std::vector<Note>& notes,
+std::vector<byte> Rom::encode_note_data(std::span<const Note> notes,
                                         byte offset, bool null_terminated,
-                                        bool title) {
+                                        bool title) const {
   std::vector<byte> data;
-  data.reserve(notes.size() + null_terminated ? 1 : 0);
+  data.reserve(notes.size() + (null_terminated ? 1 : 0));
 
   int prev = -1;
-  auto& lut = (title ? title_duration_lut_ : duration_lut_);
-  lut.reset();
+  DurationLUT::Encoder lut(title ? title_duration_lut_ : duration_lut_);
 
   for (const auto n : notes) {
     if (title) {
@@ -698,6 +953,7 @@ std::vector<byte> Rom::encode_note_data(const std::vector<Note>& notes,
     }
   }
 
+  Metrics::count(Metrics::Counter::NotesEncoded, notes.size());
   if (lut.has_error()) {
     LOG(WARNING) << "Duration LUT has error remaining after encoding: "
                  << lut.error();
@@ -715,31 +971,15 @@ void Rom::read_sfx_notes(Address address, size_t length) {
   pitches.reserve(length);
   for (auto b : read(address, length)) {
     pitches.push_back(pitch_lut_[b]);
-    LOG(INFO) << "Got value " << b << ": " << pitches.back();
+    TRACE << "Got value " << b << ": " << pitches.back();
   }
   sfx_notes_.emplace_back(address, std::move(pitches));
 }
 
 void Rom::read_all_sfx_notes() {
-  read_sfx_notes(0x0192cb, 1);
-  read_sfx_notes(0x0192dc, 1);
-  read_sfx_notes(0x01936f, 1);
-  read_sfx_notes(0x019373, 1);
-  read_sfx_notes(0x0193f5, 1);
-  read_sfx_notes(0x019401, 1);
-  read_sfx_notes(0x0194fa, 1);
-  read_sfx_notes(0x019506, 1);
-  read_sfx_notes(0x01950e, 1);
-  read_sfx_notes(0x019538, 1);
-  read_sfx_notes(0x01955e, 1);
-  read_sfx_notes(0x019562, 1);
-  read_sfx_notes(0x01957a, 1);
-  read_sfx_notes(0x0190fe, 6);
-  read_sfx_notes(0x01963f, 5);
-  read_sfx_notes(0x01964b, 7);
-  read_sfx_notes(0x019658, 6);
-  read_sfx_notes(0x019667, 9);
-  read_sfx_notes(0x0196b6, 31);
+  for (const auto& sfx : layout_.sfx) {
+    read_sfx_notes(sfx.address, sfx.length);
+  }
 }
 
 }  // namespace z2music
@@ -1,65 +1,52 @@
 #ifndef Z2MUSIC_ROM_H_
 #define Z2MUSIC_ROM_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
 #include <string>
+#include <string_view>
+#include <array>
 #include <unordered_map>
 #include <vector>
 
 #include "credits.h"
 #include "duration_lut.h"
+#include "encode_cache.h"
+#include "optimizer.h"
 #include "pattern.h"
 #include "pitch.h"
 #include "pitch_lut.h"
+#include "registry.h"
+#include "rom_layout.h"
+#include "score.h"
 #include "sfx_notes.h"
 #include "song.h"
 #include "util.h"
 
 namespace z2music {
 
+class RomCache;
+
 class Rom {
  public:
-  enum class SongTitle {
-    Unknown,
-
-    TitleIntro,
-    TitleThemeStart,
-    TitleThemeBuildup,
-    TitleThemeMain,
-    TitleThemeBreakdown,
-
-    OverworldIntro,
-    OverworldTheme,
-    BattleTheme,
-    CaveItemFanfare,
-
-    TownIntro,
-    TownTheme,
-    HouseTheme,
-    TownItemFanfare,
-
-    PalaceIntro,
-    PalaceTheme,
-    BossTheme,
-    PalaceItemFanfare,
-    CrystalFanfare,
-
-    GreatPalaceIntro,
-    GreatPalaceTheme,
-    ZeldaTheme,
-    CreditsTheme,
-    GreatPalaceItemFanfare,
-    TriforceFanfare,
-    FinalBossTheme,
-  };
-
-  static constexpr Address kTitleScreenLoader = 0x0182fd;
-  static constexpr Address kOverworldLoader = 0x019b90;
-  static constexpr Address kTownLoader = 0x019bcf;
-  static constexpr Address kPalaceLoader = 0x019c0e;
-  static constexpr Address kGreatPalaceLoader = 0x019c4b;
-
-  Rom() {}
-  Rom(const std::string& filename);
+  typedef z2music::SongTitle SongTitle;
+
+  explicit Rom(
+      const RomLayout& layout = RevisionLayout<Revision::US>::kLayout);
+  Rom(const std::string& filename,
+      const RomLayout& layout = RevisionLayout<Revision::US>::kLayout);
+  // Decodes an image already in memory, laid out like a ROM file.
+  static Rom from_image(
+      std::string_view image,
+      const RomLayout& layout = RevisionLayout<Revision::US>::kLayout);
+
+  // Whether the image has what the layout describes: an LDA $addr,y at each
+  // song table loader which loads from inside the ROM, and LUTs and credits
+  // which fit in it.  Images which don't are left with no songs instead of
+  // being decoded.
+  bool matches_layout() const;
 
   byte getc(Address address) const;
   WordLE getw(Address address) const;
@@ -75,76 +62,191 @@ class Rom {
   std::string read_string(Address address) const;
   Address write_string(Address address, const std::string& s);
 
-  void commit();
-  void save(const std::string& filename);
-  void move_song_table(Address loader_address, Address base_address);
+  // The notes of one encoded channel, decoded with the ROM's LUTs one at a
+  // time as they are iterated.  It ends at the channel's terminator or once
+  // max_length ticks have been read, if that is not 0.  Nothing is
+  // allocated, so a channel can be scanned without building a Pattern.
+  class NoteRange {
+   public:
+    class iterator {
+     public:
+      typedef std::forward_iterator_tag iterator_concept;
+      typedef Note value_type;
+      typedef std::ptrdiff_t difference_type;
+
+      iterator() = default;
+
+      Note operator*() const { return note_; }
+      iterator& operator++() {
+        next();
+        return *this;
+      }
+      iterator operator++(int) {
+        iterator it = *this;
+        next();
+        return it;
+      }
+
+      bool operator==(const iterator& other) const {
+        return done_ == other.done_ && (done_ || address_ == other.address_);
+      }
+      bool operator==(std::default_sentinel_t) const { return done_; }
+
+     private:
+      friend class NoteRange;
+      iterator(const Rom& rom, Address address, byte tempo,
+               size_t max_length);
+
+      void next();
+
+      const Rom* rom_ = nullptr;
+      Address address_ = 0;
+      byte tempo_ = 0;
+      size_t max_length_ = 0;
+      size_t length_ = 0;
+      int duration_ = 0;
+      Note note_ = Note::rest(0);
+      bool done_ = true;
+    };
+
+    // Without a ROM there are no notes
+    NoteRange() = default;
+    NoteRange(const Rom& rom, Address address, byte tempo,
+              size_t max_length = 0)
+        : rom_(&rom),
+          address_(address),
+          tempo_(tempo),
+          max_length_(max_length) {}
+
+    iterator begin() const {
+      return rom_ ? iterator(*rom_, address_, tempo_, max_length_)
+                  : iterator();
+    }
+    std::default_sentinel_t end() const { return {}; }
+
+   private:
+    const Rom* rom_ = nullptr;
+    Address address_ = 0;
+    byte tempo_ = 0;
+    size_t max_length_ = 0;
+  };
 
-  Song& song(SongTitle title) { return songs_[title]; }
-  const Song& song(SongTitle title) const { return songs_.at(title); }
+  NoteRange notes(Address address, byte tempo, size_t max_length = 0) const {
+    return NoteRange(*this, address, tempo, max_length);
+  }
+  // One channel of the pattern whose header is at the given address, which
+  // like the game stops the other channels at the length of pulse 1.
+  NoteRange notes(Address pattern, Pattern::Channel ch) const;
+
+  // Writes every change to the image.  Returns false, with a message in
+  // errors for each problem, if the songs use more pitches than the LUT holds,
+  // in which case nothing is written, or if a song table runs into other data,
+  // which leaves the image corrupt.
+  bool commit(std::vector<std::string>& errors);
+  // The same, logging any errors
+  bool commit();
+  // Commits and writes the file, unless committing fails
+  bool save(const std::string& filename);
+  // The file as it would be saved, without committing any changes first
+  std::string image() const;
+  std::vector<Optimizer::Report> optimize(const Optimizer& optimizer);
+  bool can_encode_duration(int ticks, byte tempo) const;
+  void move_song_table(SongTable table, Address base_address);
+  Address song_table_address(SongTable table) const;
+
+  Song& song(SongTitle title);
+  const Song& song(SongTitle title) const;
+  Score& score(SongTable table);
+  const Score& score(SongTable table) const;
+  void share_song(SongTitle title, SongTitle source);
+  const RomLayout& layout() const { return layout_; }
   Credits& credits() { return credits_; }
   PitchLUT& pitch_lut() { return pitch_lut_; }
   PitchLUT& title_pitch_lut() { return title_pitch_lut_; }
   DurationLUT& duration_lut() { return duration_lut_; }
   DurationLUT& title_duration_lut() { return title_duration_lut_; }
+  EncodeCache& encode_cache() { return encode_cache_; }
+  // Threads used to encode patterns when committing, 0 for one per core
+  void set_encode_threads(size_t threads) { encode_threads_ = threads; }
 
-  static SongTitle title_by_name(const std::string& name);
+  static SongTitle title_by_name(std::string_view name);
 
- protected:
   static constexpr size_t kHeaderSize = 0x10;
   static constexpr size_t kRomSize = 0x040000;
-  static constexpr size_t kTitleDurationLUTAddress = 0x018084;
-  static constexpr size_t kTitlePitchLUTAddress = 0x01808f;
-  static constexpr size_t kDurationLUTAddress = 0x01914d;
-  static constexpr size_t kPitchLUTAddress = 0x01918f;
-
-  static constexpr Address kCreditsTableAddress = 0x015259;
-  static constexpr Address kCreditsBankOffset = 0xc000;
+  // Bump whenever decoding the same image gives a different model, so cached
+  // models from older decoders are never used.
+  static constexpr uint16_t kDecoderVersion = 1;
 
+ protected:
   byte header_[kHeaderSize];
   byte data_[kRomSize];
 
-  Address title_screen_table = 0x0184da;
-  Address overworld_song_table = 0x01a000;
-  Address town_song_table = 0x01a3ca;
-  Address palace_song_table = 0x01a62f;
-  Address great_palace_song_table = 0x01a936;
-
-  std::unordered_map<SongTitle, Song> songs_;
+  RomLayout layout_;
+  std::array<Address, kSongTables> tables_;
+  std::array<Score, kSongTables> scores_;
   Credits credits_;
   PitchLUT pitch_lut_, title_pitch_lut_;
   DurationLUT duration_lut_, title_duration_lut_;
   std::vector<SFXNotes> sfx_notes_;
+  EncodeCache encode_cache_;
+  size_t encode_threads_ = 0;
+
+  // Encoded note data for the patterns being committed, by cache key
+  typedef std::unordered_map<std::string, std::vector<byte>,
+                             EncodeCache::KeyHash, std::equal_to<>>
+      EncodedPatterns;
 
-  void commit(Address address, std::vector<SongTitle> songs);
+  const RomLayout::Slot& song_slot(SongTitle title) const;
+
+  bool load_image(const std::string& filename);
+  void copy_image(std::string_view image);
+  void decode();
+
+  Address commit(Address address, const Score& score,
+                 const EncodedPatterns& encoded, uint64_t luts);
+  bool check_song_tables(const std::array<Address, kSongTables>& ends,
+                         std::vector<std::string>& errors) const;
   Address get_song_table_address(Address loader_address) const;
 
   PitchLUT read_pitch_lut(Address address, size_t entries) const;
   DurationLUT read_duration_lut(Address address, size_t entries) const;
   DurationLUT::Row read_duration_lut_row(Address address, size_t entries) const;
 
-  Song read_song(Address address, byte entry) const;
+  Score read_score(Address address) const;
+  Song read_song(Address address, byte offset) const;
   Pattern read_pattern(Address address) const;
-  std::vector<Note> read_notes(Address address, byte offset,
-                               size_t max_length = 0) const;
+  // Appends to notes, returning the length of what was read in ticks
+  size_t read_notes(Address address, byte offset, std::vector<Note>& notes,
+                    size_t max_length = 0) const;
 
   Credits read_credits(Address address) const;
   void read_sfx_notes(Address address, size_t length);
   void read_all_sfx_notes();
 
-  void rebuild_pitch_lut();
+  bool rebuild_pitch_lut(std::vector<std::string>& errors);
 
   void commit_pitch_lut(Address address);
   void commit_credits(Address address);
   void commit_sfx_notes();
 
+  uint64_t lut_fingerprint() const;
   std::vector<byte> encode_pattern(const Pattern& pattern);
-
-  std::vector<byte> encode_note_data(const std::vector<Note>& notes,
+  std::vector<byte> encode_pattern(const Pattern& pattern, uint64_t luts);
+  // Encodes every pattern in every table, the ones not in the encode cache
+  // in parallel.
+  EncodedPatterns encode_patterns(uint64_t luts);
+
+  // These only read the LUTs, so they are safe to call from many threads.
+  EncodeCache::Entry encode_pattern_data(const Pattern& pattern) const;
+  std::vector<byte> encode_note_data(std::span<const Note> notes,
                                      byte offset, bool null_terminated,
-                                     bool title);
+                                     bool title) const;
 
+  friend class RomCache;
   friend class TestWithFakeRom;
   friend class RomTest_AutomaticPitchLUT_Test;
+  friend class RomTest_SharedSongs_Test;
+  friend class RomTest_ReadPitchLUT_Test;
 };
 
 }  // namespace z2music
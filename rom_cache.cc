@@ -0,0 +1,304 @@
+#include "rom_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "binary_io.h"
+
+namespace z2music {
+
+namespace {
+
+std::string layout_bytes(const RomLayout& layout) {
+  std::string out;
+  BinaryWriter w(out);
+
+  w.u32(layout.bank_offset);
+  w.u32(layout.music_reset);
+  for (const auto& table : layout.tables) {
+    w.u32(table.loader);
+    w.u32(table.address);
+    for (byte b : table.slots) w.u8(b);
+  }
+  for (const auto& lut : {layout.pitch_lut, layout.title_pitch_lut,
+                          layout.duration_lut, layout.title_duration_lut}) {
+    w.u32(lut.address);
+    w.u32(lut.entries);
+  }
+  w.u32(layout.credits_table);
+  w.u32(layout.credits_bank_offset);
+  w.u32(layout.sfx.size());
+  for (const auto& sfx : layout.sfx) {
+    w.u32(sfx.address);
+    w.u32(sfx.length);
+  }
+  w.u32(layout.songs.size());
+  for (const auto& song : layout.songs) {
+    w.u8(static_cast<uint8_t>(song.table));
+    w.u8(song.slot);
+  }
+
+  return out;
+}
+
+}  // namespace
+
+RomCache::RomCache(std::string directory, size_t max_entries)
+    : directory_(std::move(directory)), max_entries_(max_entries) {
+  std::error_code ec;
+  std::filesystem::create_directories(directory_, ec);
+  if (ec) LOG(ERROR) << "Unable to create cache directory " << directory_;
+}
+
+std::string RomCache::source(const Rom& rom) {
+  std::string out;
+  BinaryWriter(out).u16(Rom::kDecoderVersion);
+  out += layout_bytes(rom.layout_);
+  out.append(reinterpret_cast<const char*>(rom.header_), Rom::kHeaderSize);
+  out.append(reinterpret_cast<const char*>(rom.data_), Rom::kRomSize);
+  return out;
+}
+
+uint64_t RomCache::key(const Rom& rom) { return fingerprint(source(rom)); }
+
+std::filesystem::path RomCache::path(uint64_t key) const {
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx",
+                static_cast<unsigned long long>(key));
+  return directory_ / (std::string(name) + std::string(kExtension));
+}
+
+Rom RomCache::open(const std::string& filename, const RomLayout& layout) {
+  Rom rom(layout);
+  if (rom.load_image(filename) && !load(rom)) {
+    rom.decode();
+    store(rom);
+  }
+  return rom;
+}
+
+bool RomCache::load(Rom& rom) {
+  const std::string expected = source(rom);
+  const uint64_t k = fingerprint(expected);
+  const auto file = path(k);
+
+  std::ifstream input(file, std::ios::binary);
+  if (!input) {
+    ++misses_;
+    return false;
+  }
+  std::ostringstream contents;
+  contents << input.rdbuf();
+  input.close();
+
+  const std::string data = contents.str();
+  BinaryReader r(data);
+
+  const bool valid = r.bytes(kMagic.size()) == kMagic &&
+                     r.u16() == kVersion && r.u16() == 0 && r.u64() == k;
+  const std::string_view stored = r.bytes(r.u64());
+  const uint64_t payload_hash = r.u64();
+  const uint64_t size = r.u64();
+  const std::string_view payload = r.bytes(size);
+
+  // Another image with the same key is a miss, but not a broken entry
+  if (valid && !r.failed() && stored != expected) {
+    ++misses_;
+    return false;
+  }
+
+  if (!valid || r.failed() || !r.done() ||
+      fingerprint(payload) != payload_hash || !deserialize(payload, rom)) {
+    LOG(WARNING) << "Discarding invalid cache entry " << file;
+    std::error_code ec;
+    std::filesystem::remove(file, ec);
+    ++misses_;
+    return false;
+  }
+
+  // Bump the modification time so eviction drops least recently used entries
+  std::error_code ec;
+  std::filesystem::last_write_time(
+      file, std::filesystem::file_time_type::clock::now(), ec);
+
+  ++hits_;
+  return true;
+}
+
+void RomCache::store(const Rom& rom) {
+  const auto payload = serialize(rom);
+  if (!payload) {
+    LOG(WARNING) << "ROM model does not fit the cache format, not caching it";
+    return;
+  }
+
+  const std::string expected = source(rom);
+  const uint64_t k = fingerprint(expected);
+
+  std::string data;
+  BinaryWriter w(data);
+  w.bytes(kMagic);
+  w.u16(kVersion);
+  w.u16(0);
+  w.u64(k);
+  w.u64(expected.size());
+  w.bytes(expected);
+  w.u64(fingerprint(*payload));
+  w.u64(payload->size());
+  w.bytes(*payload);
+
+  // Write to a temporary file first so other processes never see a partial
+  // entry.
+  const auto file = path(k);
+  auto temp = file;
+  temp += ".tmp" + std::to_string(std::chrono::steady_clock::now()
+                                      .time_since_epoch()
+                                      .count());
+
+  std::ofstream output(temp, std::ios::binary);
+  output.write(data.data(), data.size());
+  output.close();
+
+  std::error_code ec;
+  if (output) std::filesystem::rename(temp, file, ec);
+  if (!output || ec) {
+    LOG(ERROR) << "Unable to write cache entry " << file;
+    std::filesystem::remove(temp, ec);
+    return;
+  }
+
+  evict();
+}
+
+void RomCache::evict() {
+  std::vector<std::pair<std::filesystem::file_time_type,
+                        std::filesystem::path>>
+      entries;
+
+  std::error_code ec;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(directory_, ec)) {
+    if (entry.path().extension() != kExtension) continue;
+    entries.emplace_back(entry.last_write_time(ec), entry.path());
+  }
+  if (entries.size() <= max_entries_) return;
+
+  std::sort(entries.begin(), entries.end());
+  for (size_t i = 0; i < entries.size() - max_entries_; ++i) {
+    LOG(INFO) << "Evicting cache entry " << entries[i].second;
+    std::filesystem::remove(entries[i].second, ec);
+  }
+}
+
+std::optional<std::string> RomCache::serialize(const Rom& rom) {
+  std::string out;
+  BinaryWriter w(out);
+
+  for (Address address : rom.tables_) w.u32(address);
+
+  for (const auto& score : rom.scores_) {
+    w.u16(score.song_count());
+    for (byte slot : score.layout()) w.u8(slot);
+
+    for (const auto& song : score) {
+      const auto& sequence = song.sequence();
+      w.u16(song.pattern_count());
+      w.u16(sequence.size());
+      for (byte n : sequence) w.u8(n);
+      for (size_t i = 0; i < song.pattern_count(); ++i) {
+        w.pattern(song.pattern(i));
+      }
+    }
+  }
+
+  for (const auto& text : rom.credits_) {
+    w.string(text.title);
+    w.string(text.name1);
+    w.string(text.name2);
+  }
+
+  w.pitches(rom.pitch_lut_);
+  w.pitches(rom.title_pitch_lut_);
+  w.durations(rom.duration_lut_);
+  w.durations(rom.title_duration_lut_);
+
+  w.u16(rom.sfx_notes_.size());
+  for (const auto& sfx : rom.sfx_notes_) {
+    w.u32(sfx.address());
+    w.u16(sfx.size());
+    for (const auto& pitch : sfx) w.u16(pitch.timer());
+  }
+
+  if (!w.ok()) return std::nullopt;
+  return out;
+}
+
+bool RomCache::deserialize(std::string_view data, Rom& rom) {
+  BinaryReader r(data);
+
+  std::array<Address, kSongTables> tables;
+  for (auto& address : tables) address = r.u32();
+
+  std::array<Score, kSongTables> scores;
+  for (auto& score : scores) {
+    std::vector<Song> songs(r.u16());
+    Score::Layout layout;
+    for (auto& slot : layout) slot = r.u8();
+
+    for (auto& song : songs) {
+      const uint16_t patterns = r.u16();
+      const std::string_view sequence = r.bytes(r.u16());
+      for (size_t i = 0; i < patterns && !r.failed(); ++i) {
+        song.add_pattern(r.pattern());
+      }
+      song.set_sequence(std::vector<byte>(sequence.begin(), sequence.end()));
+    }
+
+    for (byte slot : layout) {
+      if (slot >= songs.size()) r.fail("Slot refers to missing song");
+    }
+    if (r.failed()) return false;
+    score = Score(std::move(songs), layout);
+  }
+
+  Credits credits;
+  for (byte page = 0; page < Credits::kPages; ++page) {
+    credits[page].title = r.string();
+    credits[page].name1 = r.string();
+    credits[page].name2 = r.string();
+  }
+
+  PitchLUT pitch_lut = r.pitches();
+  PitchLUT title_pitch_lut = r.pitches();
+  DurationLUT duration_lut = r.durations();
+  DurationLUT title_duration_lut = r.durations();
+
+  std::vector<SFXNotes> sfx_notes;
+  const uint16_t sfx_count = r.u16();
+  for (size_t i = 0; i < sfx_count && !r.failed(); ++i) {
+    const Address address = r.u32();
+    std::vector<Pitch> pitches(r.u16());
+    for (auto& pitch : pitches) pitch = Pitch(WordBE(r.u16()));
+    sfx_notes.emplace_back(address, std::move(pitches));
+  }
+
+  if (r.failed() || !r.done()) return false;
+
+  rom.tables_ = tables;
+  rom.scores_ = std::move(scores);
+  rom.credits_ = std::move(credits);
+  rom.pitch_lut_ = std::move(pitch_lut);
+  rom.title_pitch_lut_ = std::move(title_pitch_lut);
+  rom.duration_lut_ = std::move(duration_lut);
+  rom.title_duration_lut_ = std::move(title_duration_lut);
+  rom.sfx_notes_ = std::move(sfx_notes);
+  return true;
+}
+
+}  // namespace z2music
@@ -0,0 +1,65 @@
+#ifndef Z2MUSIC_ROM_CACHE_H_
+#define Z2MUSIC_ROM_CACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "rom.h"
+
+namespace z2music {
+
+// Keeps the decoded songs, LUTs, credits and SFX notes of ROM images in a
+// directory, keyed by a hash of the image and layout, so tools run over and
+// over against the same base ROM only decode it once.  Each entry holds the
+// image and layout it was decoded from, and is only used if they match.
+// Entries that fail validation are deleted, and the least recently used
+// entries are evicted once there are more than max_entries.
+class RomCache {
+ public:
+  static constexpr size_t kDefaultEntries = 16;
+
+  explicit RomCache(std::string directory,
+                    size_t max_entries = kDefaultEntries);
+
+  // Loads a ROM file, restoring its decoded model from the cache when there
+  // is an entry for it and decoding and storing one when there isn't.
+  Rom open(const std::string& filename,
+           const RomLayout& layout = RevisionLayout<Revision::US>::kLayout);
+
+  // Restores the decoded model for the image loaded in rom.  Returns false if
+  // there is no valid entry for it.
+  bool load(Rom& rom);
+
+  // Saves the decoded model of rom, evicting old entries if needed.
+  void store(const Rom& rom);
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+  static uint64_t key(const Rom& rom);
+  std::filesystem::path path(uint64_t key) const;
+
+ private:
+  static constexpr std::string_view kMagic = "Z2MC";
+  static constexpr uint16_t kVersion = 3;
+  static constexpr std::string_view kExtension = ".z2mc";
+
+  std::filesystem::path directory_;
+  size_t max_entries_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+
+  // The decoder version, layout, header and image an entry is for
+  static std::string source(const Rom& rom);
+  static std::optional<std::string> serialize(const Rom& rom);
+  static bool deserialize(std::string_view data, Rom& rom);
+
+  void evict();
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_ROM_CACHE_H_
@@ -0,0 +1,168 @@
+#include "rom_cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "binary_io.h"
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "project.h"
+#include "rom.h"
+
+namespace z2music {
+namespace {
+
+class RomCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::path(::testing::TempDir()) /
+           ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directories(dir_);
+  }
+
+  // Saves a ROM with a town theme using the given notes.
+  std::string save_rom(const std::string& name, const std::string& notes) {
+    const auto project = Project::parse("song TownTheme\npattern 0x18\n" +
+                                        notes + "\n\n\n\nsequence 1\n");
+    EXPECT_TRUE(project.ok());
+
+    FakeRom rom;
+    project.apply(rom);
+    rom.make_decodable();
+
+    const std::string filename = (dir_ / name).string();
+    rom.save(filename);
+    return filename;
+  }
+
+  std::string town_notes(const Rom& rom) {
+    return rom.song(Rom::SongTitle::TownTheme)
+        .pattern(0)
+        .dump_notes(Pattern::Channel::Pulse1);
+  }
+
+  size_t entries(const std::filesystem::path& dir) {
+    size_t count = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+      if (entry.path().extension() == ".z2mc") ++count;
+    }
+    return count;
+  }
+
+  std::filesystem::path dir_;
+};
+
+TEST_F(RomCacheTest, HitMatchesDecode) {
+  const std::string filename = save_rom("town.nes", "a4.4 c5 e5 a5");
+  RomCache cache((dir_ / "cache").string());
+
+  const Rom decoded(filename);
+  const Rom first = cache.open(filename);
+  EXPECT_EQ(cache.misses(), 1);
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_TRUE(std::filesystem::exists(cache.path(RomCache::key(first))));
+
+  const Rom second = cache.open(filename);
+  EXPECT_EQ(cache.hits(), 1);
+
+  EXPECT_EQ(town_notes(second), "A4.4 C5 E5 A5");
+  EXPECT_EQ(town_notes(second), town_notes(decoded));
+  EXPECT_EQ(&second.song(Rom::SongTitle::HouseTheme) ==
+                &second.song(Rom::SongTitle::TownTheme),
+            &decoded.song(Rom::SongTitle::HouseTheme) ==
+                &decoded.song(Rom::SongTitle::TownTheme));
+
+  for (SongTable t : {SongTable::Title, SongTable::Town, SongTable::Palace}) {
+    EXPECT_EQ(second.song_table_address(t), decoded.song_table_address(t));
+  }
+}
+
+TEST_F(RomCacheTest, DiscardsCorruptEntries) {
+  const std::string filename = save_rom("town.nes", "a4.4 c5");
+  RomCache cache((dir_ / "cache").string());
+
+  const Rom rom = cache.open(filename);
+  const auto entry = cache.path(RomCache::key(rom));
+
+  std::string data;
+  {
+    std::ifstream file(entry, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), {});
+  }
+  data[data.size() / 2] ^= 0x55;
+  {
+    std::ofstream file(entry, std::ios::binary | std::ios::trunc);
+    file << data;
+  }
+
+  const Rom reloaded = cache.open(filename);
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_EQ(cache.misses(), 2);
+  EXPECT_EQ(town_notes(reloaded), "A4.4 C5");
+
+  // The bad entry was replaced by a good one
+  cache.open(filename);
+  EXPECT_EQ(cache.hits(), 1);
+}
+
+TEST_F(RomCacheTest, ChecksImageOnHit) {
+  const std::string a = save_rom("a.nes", "a4.4 c5");
+  const std::string b = save_rom("b.nes", "e5.4 c5");
+  RomCache cache((dir_ / "cache").string());
+
+  const Rom rom = cache.open(a);
+  const Rom other(b);
+  ASSERT_NE(town_notes(rom), town_notes(other));
+
+  // Put a's entry where b's would be, as if their keys were the same
+  std::string data;
+  {
+    std::ifstream file(cache.path(RomCache::key(rom)), std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), {});
+  }
+  std::string key;
+  BinaryWriter(key).u64(RomCache::key(other));
+  data.replace(8, 8, key);
+  {
+    std::ofstream file(cache.path(RomCache::key(other)), std::ios::binary);
+    file << data;
+  }
+
+  EXPECT_EQ(town_notes(cache.open(b)), town_notes(other));
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_EQ(cache.misses(), 2);
+}
+
+TEST_F(RomCacheTest, EvictsOldEntries) {
+  RomCache cache((dir_ / "cache").string(), 2);
+
+  cache.open(save_rom("a.nes", "a4.4"));
+  cache.open(save_rom("b.nes", "b4.4"));
+  cache.open(save_rom("c.nes", "c5.4"));
+
+  EXPECT_EQ(cache.misses(), 3);
+  EXPECT_EQ(entries(dir_ / "cache"), 2);
+}
+
+TEST(FingerprintTest, EveryBitMatters) {
+  const std::string data(64, '\0');
+  const uint64_t h = fingerprint(data);
+
+  // Changes in the top bit of two words used to cancel out
+  std::string changed = data;
+  changed[7] ^= 0x80;
+  changed[15] ^= 0x80;
+  EXPECT_NE(fingerprint(changed), h);
+
+  for (size_t i = 0; i < data.size(); ++i) {
+    changed = data;
+    changed[i] ^= 1;
+    EXPECT_NE(fingerprint(changed), h) << i;
+  }
+}
+
+}  // namespace
+}  // namespace z2music
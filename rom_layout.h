@@ -0,0 +1,202 @@
+#ifndef Z2MUSIC_ROM_LAYOUT_H_
+#define Z2MUSIC_ROM_LAYOUT_H_
+
+#include <array>
+#include <span>
+
+#include "score.h"
+#include "util.h"
+
+namespace z2music {
+
+// The five song tables, in the order they are listed in RomLayout::tables.
+enum class SongTable { Title, Overworld, Town, Palace, GreatPalace };
+constexpr size_t kSongTables = 5;
+
+// Every song the game plays, whichever table it is in.  RomLayout::songs
+// says where each one is and registry.h has their names.
+enum class SongTitle {
+  Unknown,
+
+  TitleIntro,
+  TitleThemeStart,
+  TitleThemeBuildup,
+  TitleThemeMain,
+  TitleThemeBreakdown,
+
+  OverworldIntro,
+  OverworldTheme,
+  BattleTheme,
+  CaveItemFanfare,
+
+  TownIntro,
+  TownTheme,
+  HouseTheme,
+  TownItemFanfare,
+
+  PalaceIntro,
+  PalaceTheme,
+  BossTheme,
+  PalaceItemFanfare,
+  CrystalFanfare,
+
+  GreatPalaceIntro,
+  GreatPalaceTheme,
+  ZeldaTheme,
+  CreditsTheme,
+  GreatPalaceItemFanfare,
+  TriforceFanfare,
+  FinalBossTheme,
+};
+
+enum class Revision { US };
+
+// Where everything the music code touches lives in a particular ROM.  Lists
+// whose length differs between revisions are spans over static arrays, so a
+// layout has to outlive every Rom made from it.
+struct RomLayout {
+  struct Table {
+    // Address of the LDA $addr,y which loads from the table
+    Address loader;
+    // Where the table is if there is no ROM to read it from
+    Address address;
+    Score::Layout slots;
+  };
+
+  struct LUT {
+    Address address;
+    size_t entries;
+  };
+
+  struct SFX {
+    Address address;
+    size_t length;
+  };
+
+  struct Slot {
+    SongTable table;
+    byte slot;
+  };
+
+  static constexpr byte kNoSlot = 0xff;
+
+  // Offset between addresses in the music bank and the ROM
+  Address bank_offset;
+  // Where to stop looking for loads when moving a table
+  Address music_reset;
+
+  std::array<Table, kSongTables> tables;
+
+  LUT pitch_lut;
+  LUT title_pitch_lut;
+  LUT duration_lut;
+  LUT title_duration_lut;
+
+  Address credits_table;
+  Address credits_bank_offset;
+
+  std::span<const SFX> sfx;
+
+  // Indexed by SongTitle
+  std::span<const Slot> songs;
+
+  const Table& table(SongTable t) const {
+    return tables[static_cast<size_t>(t)];
+  }
+
+  // Where the song is, or null if this layout doesn't have it
+  constexpr const Slot* song(SongTitle title) const {
+    const size_t i = static_cast<size_t>(title);
+    return i < songs.size() && songs[i].slot != kNoSlot ? &songs[i] : nullptr;
+  }
+};
+
+template <Revision R>
+struct RevisionLayout;
+
+template <>
+struct RevisionLayout<Revision::US> {
+  static constexpr RomLayout::SFX kSFX[] = {
+      {0x0192cb, 1},
+      {0x0192dc, 1},
+      {0x01936f, 1},
+      {0x019373, 1},
+      {0x0193f5, 1},
+      {0x019401, 1},
+      {0x0194fa, 1},
+      {0x019506, 1},
+      {0x01950e, 1},
+      {0x019538, 1},
+      {0x01955e, 1},
+      {0x019562, 1},
+      {0x01957a, 1},
+      {0x0190fe, 6},
+      {0x01963f, 5},
+      {0x01964b, 7},
+      {0x019658, 6},
+      {0x019667, 9},
+      {0x0196b6, 31},
+  };
+
+  static constexpr RomLayout::Slot kSongs[] = {
+      {SongTable::Title, RomLayout::kNoSlot},
+
+      {SongTable::Title, 0},
+      {SongTable::Title, 1},
+      {SongTable::Title, 2},
+      {SongTable::Title, 3},
+      {SongTable::Title, 4},
+
+      {SongTable::Overworld, 0},
+      {SongTable::Overworld, 1},
+      {SongTable::Overworld, 2},
+      {SongTable::Overworld, 4},
+
+      {SongTable::Town, 0},
+      {SongTable::Town, 1},
+      {SongTable::Town, 2},
+      {SongTable::Town, 4},
+
+      {SongTable::Palace, 0},
+      {SongTable::Palace, 1},
+      {SongTable::Palace, 3},
+      {SongTable::Palace, 4},
+      {SongTable::Palace, 6},
+
+      {SongTable::GreatPalace, 0},
+      {SongTable::GreatPalace, 1},
+      {SongTable::GreatPalace, 2},
+      {SongTable::GreatPalace, 3},
+      {SongTable::GreatPalace, 4},
+      {SongTable::GreatPalace, 5},
+      {SongTable::GreatPalace, 6},
+  };
+
+  static constexpr RomLayout kLayout = {
+      .bank_offset = 0x010000,
+      .music_reset = 0x019c74,
+
+      .tables = {{
+          {0x0182fd, 0x0184da, {0, 1, 2, 3, 4, 5, 5, 5}},
+          {0x019b90, 0x01a000, {0, 1, 2, 2, 3, 4, 4, 4}},
+          {0x019bcf, 0x01a3ca, {0, 1, 2, 2, 3, 4, 4, 4}},
+          {0x019c0e, 0x01a62f, {0, 1, 1, 2, 3, 5, 4, 5}},
+          {0x019c4b, 0x01a936, {0, 1, 2, 3, 4, 5, 6, 7}},
+      }},
+
+      .pitch_lut = {0x01918f, 62},
+      .title_pitch_lut = {0x01808f, 64},
+      .duration_lut = {0x01914d, 48},
+      .title_duration_lut = {0x018084, 11},
+
+      .credits_table = 0x015259,
+      .credits_bank_offset = 0xc000,
+
+      .sfx = kSFX,
+      .songs = kSongs,
+  };
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_ROM_LAYOUT_H_
@@ -1,8 +1,14 @@
 #include "rom.h"
 
+#include <fstream>
+#include <string>
+#include <vector>
+
 #include "fake_rom.h"
 #include "gtest/gtest.h"
 #include "pattern.h"
+#include "pitch_lut.h"
+#include "rom_layout.h"
 
 namespace z2music {
 
@@ -23,7 +29,9 @@ TEST(RomTest, AutomaticPitchLUT) {
   rom.write(0x12345, {0x38, 0x48, 0x08, 0x06, 0x08, 0x06});  // A5 G#5 G#3 G3
   rom.read_sfx_notes(0x12345, 6);
 
-  rom.rebuild_pitch_lut();
+  std::vector<std::string> errors;
+  ASSERT_TRUE(rom.rebuild_pitch_lut(errors));
+  EXPECT_TRUE(errors.empty());
   auto& lut = rom.pitch_lut();
 
   EXPECT_EQ(lut.size(), 7);
@@ -45,4 +53,131 @@ TEST(RomTest, AutomaticPitchLUT) {
   EXPECT_EQ(data, expected);
 }
 
+TEST(RomTest, CommitReportsOverlappingTables) {
+  FakeRom rom;
+  Song& song = rom.song(Rom::SongTitle::TownTheme);
+  song.add_pattern({0x18, Pattern::parse_notes("A4.4 C5 E5 A5"), {}, {}, {}});
+  song.set_sequence({0});
+
+  // Put the town table right on top of the overworld one
+  const RomLayout& layout = RevisionLayout<Revision::US>::kLayout;
+  rom.move_song_table(SongTable::Town,
+                      rom.song_table_address(SongTable::Overworld) -
+                          layout.bank_offset);
+
+  std::vector<std::string> errors;
+  EXPECT_FALSE(rom.commit(errors));
+  ASSERT_FALSE(errors.empty());
+  EXPECT_NE(errors[0].find("overlaps song table"), std::string::npos);
+}
+
+TEST(RomTest, SharedSongs) {
+  FakeRom rom;
+
+  Song& theme = rom.song(Rom::SongTitle::PalaceTheme);
+  theme.add_pattern({0x18, Pattern::parse_notes("A4.8 r"), {}, {}, {}});
+  theme.set_sequence({0, 0});
+
+  rom.share_song(Rom::SongTitle::BossTheme, Rom::SongTitle::PalaceTheme);
+  rom.commit();
+
+  // Slots 1, 2 and 3 all play the same sequence, written only once
+  const auto table = rom.read(rom.song_table_address(SongTable::Palace), 8);
+  EXPECT_EQ(table[1], 8);
+  EXPECT_EQ(table[2], 8);
+  EXPECT_EQ(table[3], 8);
+  EXPECT_EQ(table[0], 11);
+  EXPECT_EQ(table[4], 11);
+
+  const Score score = rom.read_score(rom.song_table_address(SongTable::Palace));
+  EXPECT_EQ(score.index(1), score.index(3));
+  EXPECT_EQ(score.song(3).sequence_length(), 2);
+  EXPECT_EQ(score.song(3).pattern_count(), 1);
+}
+
+TEST(RomTest, ReadPitchLUT) {
+  FakeRom rom;
+
+  rom.putwr(0x12345, Pitch(Pitch::A4).timer());
+  rom.putwr(0x12347, Pitch(Pitch::C5).timer());  // Not a pitch, index 2 rests
+  rom.putwr(0x12349, Pitch(Pitch::E5).timer());
+  rom.putwr(0x1234b, Pitch(Pitch::G5).timer());
+
+  const PitchLUT lut = rom.read_pitch_lut(0x12345, 4);
+  EXPECT_EQ(lut.size(), 4);
+  EXPECT_EQ(lut[0x00], Pitch(Pitch::A4));
+  EXPECT_EQ(lut[0x02], Pitch::none());
+  EXPECT_EQ(lut[0x04], Pitch(Pitch::E5));
+  EXPECT_EQ(lut[0x06], Pitch(Pitch::G5));
+}
+
+TEST(RomTest, FromImage) {
+  FakeRom rom;
+  Song& song = rom.song(Rom::SongTitle::TownTheme);
+  song.add_pattern({0x18, Pattern::parse_notes("A4.4 C5 E5 A5"), {}, {}, {}});
+  song.set_sequence({0});
+  rom.commit();
+  rom.make_decodable();
+
+  const std::string image = rom.image();
+  const std::string filename = ::testing::TempDir() + "/from_image.nes";
+  {
+    std::ofstream file(filename, std::ios::binary);
+    file << image;
+  }
+
+  const Rom loaded(filename);
+  const Rom decoded = Rom::from_image(image);
+  EXPECT_EQ(decoded.image(), image);
+  EXPECT_EQ(decoded.song(Rom::SongTitle::TownTheme)
+                .pattern(0)
+                .dump_notes(Pattern::Channel::Pulse1),
+            loaded.song(Rom::SongTitle::TownTheme)
+                .pattern(0)
+                .dump_notes(Pattern::Channel::Pulse1));
+
+  // The rest stored at index 2 of the pitch LUT must not shift the pitches
+  EXPECT_EQ(decoded.song(Rom::SongTitle::TownTheme)
+                .pattern(0)
+                .dump_notes(Pattern::Channel::Pulse1),
+            "A4.4 C5 E5 A5");
+}
+
+TEST(RomTest, TitleFromImage) {
+  FakeRom rom;
+  Song& title = rom.song(Rom::SongTitle::TitleIntro);
+  title.add_pattern({0x00, Pattern::parse_notes("D2.8 C5 E5 r G5 C#7"), {}, {},
+                     {}});
+  title.set_sequence({0});
+  Song& town = rom.song(Rom::SongTitle::TownTheme);
+  town.add_pattern({0x18, Pattern::parse_notes("A4.4 C5 E5 A5"), {}, {}, {}});
+  town.set_sequence({0});
+  ASSERT_TRUE(rom.commit());
+  rom.make_decodable();
+
+  // Offset 2 is a rest whatever is stored there
+  rom.putwr(rom.layout().title_pitch_lut.address + 2,
+            Pitch(Pitch::A4).timer());
+
+  // Title notes are looked up 4 bytes into their LUT, and skipping the rest
+  // when reading it must not shift them, from the lowest up to the highest
+  const Rom decoded = Rom::from_image(rom.image());
+  EXPECT_EQ(decoded.song(Rom::SongTitle::TitleIntro)
+                .pattern(0)
+                .dump_notes(Pattern::Channel::Pulse1),
+            "D2.8 C5 E5 r G5 C#7");
+  EXPECT_EQ(decoded.song(Rom::SongTitle::TownTheme)
+                .pattern(0)
+                .dump_notes(Pattern::Channel::Pulse1),
+            "A4.4 C5 E5 A5");
+}
+
+TEST(RomTest, ImageWithoutLayout) {
+  // A correctly sized image of some other game has no song table loaders
+  const std::string image(Rom::kHeaderSize + Rom::kRomSize, '\0');
+  const Rom rom = Rom::from_image(image);
+  EXPECT_FALSE(rom.matches_layout());
+  EXPECT_EQ(rom.image(), image);
+}
+
 }  // namespace z2music
@@ -0,0 +1,77 @@
+#include "score.h"
+
+#include <algorithm>
+
+#include "absl/log/log.h"
+
+namespace z2music {
+
+Score::Score() : songs_(1) { slots_.fill(0); }
+
+Score::Score(const Score::Layout& layout)
+    : Score(std::vector<Song>(*std::max_element(layout.begin(), layout.end()) +
+                              1),
+            layout) {}
+
+Score::Score(std::vector<Song> songs, const Score::Layout& layout)
+    : songs_(std::move(songs)) {
+  for (size_t i = 0; i < kSlots; ++i) {
+    if (layout[i] >= songs_.size()) {
+      LOG(ERROR) << "Slot " << i << " refers to missing song " << layout[i];
+      slots_[i] = 0;
+    } else {
+      slots_[i] = layout[i];
+    }
+  }
+}
+
+size_t Score::add_song(Song song) {
+  songs_.push_back(std::move(song));
+  return songs_.size() - 1;
+}
+
+void Score::set_slot(size_t slot, size_t index) {
+  if (index >= songs_.size()) {
+    LOG(ERROR) << "No song " << index << " for slot " << slot;
+    return;
+  }
+  slots_.at(slot) = index;
+  prune();
+}
+
+void Score::share(size_t slot, size_t other) { set_slot(slot, index(other)); }
+
+void Score::unshare(size_t slot) {
+  if (!shared(slot)) return;
+  set_slot(slot, add_song(song(slot)));
+}
+
+bool Score::shared(size_t slot) const {
+  return std::count(slots_.begin(), slots_.end(), index(slot)) > 1;
+}
+
+Score::Layout Score::layout() const {
+  Layout layout;
+  for (size_t i = 0; i < kSlots; ++i) {
+    layout[i] = slots_[i];
+  }
+  return layout;
+}
+
+void Score::prune() {
+  // Drop any songs that no slot refers to anymore, keeping the order of the
+  // remaining songs so they are written back the same way.
+  std::vector<size_t> remap(songs_.size(), 0);
+  std::vector<Song> songs;
+
+  for (size_t i = 0; i < songs_.size(); ++i) {
+    if (std::find(slots_.begin(), slots_.end(), i) == slots_.end()) continue;
+    remap[i] = songs.size();
+    songs.push_back(std::move(songs_[i]));
+  }
+
+  for (auto& s : slots_) s = remap[s];
+  songs_ = std::move(songs);
+}
+
+}  // namespace z2music
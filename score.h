@@ -0,0 +1,54 @@
+#ifndef Z2MUSIC_SCORE_H_
+#define Z2MUSIC_SCORE_H_
+
+#include <array>
+#include <vector>
+
+#include "song.h"
+#include "util.h"
+
+namespace z2music {
+
+// A song table, made of eight slots that each play one of the songs in the
+// table.  Several slots may share a song, which is then only stored once.
+class Score {
+ public:
+  static constexpr size_t kSlots = 8;
+  typedef std::array<byte, kSlots> Layout;
+
+  Score();
+  explicit Score(const Layout& layout);
+  Score(std::vector<Song> songs, const Layout& layout);
+
+  size_t add_song(Song song);
+  void set_slot(size_t slot, size_t index);
+
+  void share(size_t slot, size_t other);
+  void unshare(size_t slot);
+  bool shared(size_t slot) const;
+
+  Song& song(size_t slot) { return songs_.at(slots_.at(slot)); }
+  const Song& song(size_t slot) const { return songs_.at(slots_.at(slot)); }
+
+  Song& at(size_t index) { return songs_.at(index); }
+  const Song& at(size_t index) const { return songs_.at(index); }
+
+  size_t index(size_t slot) const { return slots_.at(slot); }
+  size_t song_count() const { return songs_.size(); }
+  Layout layout() const;
+
+  std::vector<Song>::iterator begin() { return songs_.begin(); }
+  std::vector<Song>::iterator end() { return songs_.end(); }
+  std::vector<Song>::const_iterator begin() const { return songs_.begin(); }
+  std::vector<Song>::const_iterator end() const { return songs_.end(); }
+
+ private:
+  std::vector<Song> songs_;
+  std::array<size_t, kSlots> slots_;
+
+  void prune();
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_SCORE_H_
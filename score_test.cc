@@ -0,0 +1,50 @@
+#include "score.h"
+
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "song.h"
+
+namespace z2music {
+
+namespace {
+Song make_song(byte tempo) {
+  Song song;
+  song.add_pattern({tempo, Pattern::parse_notes("a4.8 r"), {}, {}, {}});
+  song.set_sequence({0});
+  return song;
+}
+}  // namespace
+
+TEST(ScoreTest, Layout) {
+  const Score score({0, 1, 1, 2, 3, 5, 4, 5});
+
+  EXPECT_EQ(score.song_count(), 6);
+  EXPECT_EQ(score.index(2), 1);
+  EXPECT_TRUE(score.shared(1));
+  EXPECT_TRUE(score.shared(5));
+  EXPECT_FALSE(score.shared(0));
+  EXPECT_EQ(score.layout(), Score::Layout({0, 1, 1, 2, 3, 5, 4, 5}));
+}
+
+TEST(ScoreTest, ShareAndUnshare) {
+  Score score({0, 1, 2, 3, 4, 5, 6, 7});
+  score.song(1) = make_song(0x18);
+  score.song(3) = make_song(0x20);
+
+  score.share(3, 1);
+  EXPECT_EQ(score.song_count(), 7);
+  EXPECT_EQ(score.index(3), score.index(1));
+  EXPECT_EQ(score.song(3).pattern(0).tempo(), 0x18);
+
+  // Changes to a shared song show up in every slot using it
+  score.song(1).pattern(0).tempo(0x28);
+  EXPECT_EQ(score.song(3).pattern(0).tempo(), 0x28);
+
+  score.unshare(3);
+  EXPECT_EQ(score.song_count(), 8);
+  EXPECT_FALSE(score.shared(1));
+  score.song(3).pattern(0).tempo(0x10);
+  EXPECT_EQ(score.song(1).pattern(0).tempo(), 0x28);
+}
+
+}  // namespace z2music
@@ -1,10 +1,14 @@
 #include "song.h"
 
+#include <utility>
+
 namespace z2music {
 
 Song::Song() {}
 
-void Song::add_pattern(const Pattern& pattern) { patterns_.push_back(pattern); }
+void Song::add_pattern(Pattern pattern) {
+  patterns_.push_back(std::move(pattern));
+}
 
 void Song::set_sequence(const std::vector<byte>& seq) { sequence_ = seq; }
 
@@ -59,10 +63,12 @@ const Pattern* Song::at(byte i) const {
 
 PitchSet Song::pitches_used() const {
   PitchSet pitches;
-  for (const auto& p : patterns_) {
-    pitches.merge(p.pitches_used());
-  }
+  pitches_used(pitches);
   return pitches;
 }
 
+void Song::pitches_used(PitchSet& pitches) const {
+  for (const auto& p : patterns_) p.pitches_used(pitches);
+}
+
 }  // namespace z2music
@@ -13,7 +13,7 @@ class Song {
  public:
   Song();
 
-  void add_pattern(const Pattern& pattern);
+  void add_pattern(Pattern pattern);
   void set_sequence(const std::vector<byte>& seq);
   void append_sequence(byte n);
 
@@ -27,15 +27,18 @@ class Song {
   bool empty() const { return patterns_.empty(); }
   bool title() const { return empty() || patterns_[0].voiced(); }
 
-  std::vector<Pattern> patterns() { return patterns_; }
-  const std::vector<Pattern> patterns() const { return patterns_; }
+  const std::vector<Pattern>& patterns() const { return patterns_; }
 
   Pattern* at(byte i);
   const Pattern* at(byte i) const;
 
-  const std::vector<byte> sequence() const { return sequence_; }
+  Pattern& pattern(size_t n) { return patterns_.at(n); }
+  const Pattern& pattern(size_t n) const { return patterns_.at(n); }
+
+  const std::vector<byte>& sequence() const { return sequence_; }
 
   PitchSet pitches_used() const;
+  void pitches_used(PitchSet& pitches) const;
 
  private:
   std::vector<Pattern> patterns_;
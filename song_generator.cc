@@ -0,0 +1,151 @@
+#include "song_generator.h"
+
+#include <algorithm>
+
+#include "absl/log/log.h"
+
+namespace z2music {
+
+SongGenerator::SongGenerator(const DurationLUT& lut, uint64_t seed)
+    : lut_(lut), rng_(seed) {}
+
+Song SongGenerator::generate(const Options& options) {
+  // A tempo of 0 marks a title pattern, so the first row can't be used
+  std::vector<byte> rows;
+  byte offset = 0;
+  for (const auto& row : lut_.rows()) {
+    if (offset > 0) rows.push_back(offset);
+    offset += row.size();
+  }
+
+  std::vector<byte> tempos;
+  for (byte tempo : options.tempos) {
+    if (std::find(rows.begin(), rows.end(), tempo) == rows.end()) {
+      LOG(WARNING) << "No duration LUT row at offset " << tempo;
+    } else {
+      tempos.push_back(tempo);
+    }
+  }
+  if (tempos.empty()) tempos = rows;
+
+  const std::vector<Pitch> pitches = pick_pitches(options);
+  const std::array<Pattern::Channel, 4> channels = {
+      Pattern::Channel::Pulse1,
+      Pattern::Channel::Pulse2,
+      Pattern::Channel::Triangle,
+      Pattern::Channel::Noise,
+  };
+
+  Song song;
+  for (size_t i = 0; i < options.patterns; ++i) {
+    const byte tempo = tempos[pick(tempos.size())];
+    const std::vector<int> durations =
+        pick_durations(tempo, options.durations);
+
+    // Which lengths the durations can add up to exactly, so that every
+    // channel can be filled to the same length without running over.
+    const int shortest = *std::min_element(durations.begin(), durations.end());
+    const int target = std::max(options.pattern_length, shortest);
+    std::vector<bool> reachable(target + 1, false);
+    reachable[0] = true;
+    for (int t = 1; t <= target; ++t) {
+      for (int d : durations) {
+        if (d <= t && reachable[t - d]) {
+          reachable[t] = true;
+          break;
+        }
+      }
+    }
+    int length = target;
+    while (!reachable[length]) --length;
+
+    Pattern pattern;
+    pattern.tempo(tempo);
+    for (size_t c = 0; c < channels.size(); ++c) {
+      // Pulse 1 is always filled, even if only with rests, since its length
+      // is the pattern's length.
+      const float density = options.density[c];
+      if (c > 0 && density <= 0) continue;
+      pattern.add_notes(channels[c],
+                        fill(length, durations, reachable, pitches, density));
+    }
+
+    song.add_pattern(pattern);
+    song.append_sequence(i);
+  }
+
+  return song;
+}
+
+std::vector<Pitch> SongGenerator::pick_pitches(const Options& options) {
+  std::vector<int> range;
+  for (int p = options.low; p <= options.high; ++p) range.push_back(p);
+
+  // A partial shuffle, picking the first few from what's left each time
+  const size_t count = std::min(options.pitches, range.size());
+  std::vector<Pitch> pitches;
+  for (size_t i = 0; i < count; ++i) {
+    std::swap(range[i], range[i + pick(range.size() - i)]);
+    pitches.emplace_back(static_cast<Pitch::Midi>(range[i]));
+  }
+  return pitches;
+}
+
+std::vector<int> SongGenerator::pick_durations(byte tempo, size_t count) {
+  const size_t row = [&] {
+    size_t index = 0;
+    for (byte offset = 0; offset != tempo; ++index) {
+      offset += lut_.rows()[index].size();
+    }
+    return index;
+  }();
+
+  // The lowest pitch with the first duration in the row encodes as 00,
+  // which ends the channel early, so that duration is never used.
+  const int first = lut_.decode(0, tempo);
+
+  std::vector<int> exact;
+  for (byte b = 1; b < lut_.rows()[row].size(); ++b) {
+    const int ticks = lut_.decode(b, tempo);
+    if (ticks == first || !lut_.exact(ticks, tempo)) continue;
+    if (std::find(exact.begin(), exact.end(), ticks) != exact.end()) continue;
+    exact.push_back(ticks);
+  }
+
+  if (exact.empty()) {
+    LOG(FATAL) << "No usable durations in the LUT row at " << tempo;
+  }
+
+  const size_t n = std::clamp<size_t>(count, 1, exact.size());
+  for (size_t i = 0; i < n; ++i) {
+    std::swap(exact[i], exact[i + pick(exact.size() - i)]);
+  }
+  exact.resize(n);
+  return exact;
+}
+
+std::vector<Note> SongGenerator::fill(int length,
+                                      const std::vector<int>& durations,
+                                      const std::vector<bool>& reachable,
+                                      const std::vector<Pitch>& pitches,
+                                      float density) {
+  std::vector<Note> notes;
+  std::vector<int> fits;
+  while (length > 0) {
+    fits.clear();
+    for (int d : durations) {
+      if (d <= length && reachable[length - d]) fits.push_back(d);
+    }
+
+    const int ticks = fits[pick(fits.size())];
+    if (!pitches.empty() && chance(density)) {
+      notes.emplace_back(pitches[pick(pitches.size())], ticks);
+    } else {
+      notes.push_back(Note::rest(ticks));
+    }
+    length -= ticks;
+  }
+  return notes;
+}
+
+}  // namespace z2music
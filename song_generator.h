@@ -0,0 +1,64 @@
+#ifndef Z2MUSIC_SONG_GENERATOR_H_
+#define Z2MUSIC_SONG_GENERATOR_H_
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "duration_lut.h"
+#include "note.h"
+#include "pattern.h"
+#include "pitch.h"
+#include "song.h"
+#include "util.h"
+
+namespace z2music {
+
+// Makes songs out of random notes, for testing and benchmarking with far more
+// music than the demo projects have.  The same seed and options always give
+// the same songs, on any platform.  Only durations which the LUT encodes
+// exactly are used, so the songs survive a trip through a ROM unchanged as
+// long as they fit in it.
+class SongGenerator {
+ public:
+  struct Options {
+    size_t patterns = 4;
+    // Length of every channel of every pattern in ticks, rounded down to
+    // something the chosen durations can fill.
+    int pattern_length = Note::Whole;
+    // Chance of each note being pitched instead of a rest, by channel.  A
+    // channel with no chance is left empty.
+    std::array<float, 4> density = {1.f, .75f, .75f, .5f};
+    // Different durations in each pattern, at most one LUT row's worth
+    size_t durations = 4;
+    // Different pitches in the song, picked between low and high
+    size_t pitches = 12;
+    Pitch::Midi low = Pitch::C3;
+    Pitch::Midi high = Pitch::B5;
+    // Duration LUT rows the patterns use, by offset, or all of them if empty
+    std::vector<byte> tempos;
+  };
+
+  SongGenerator(const DurationLUT& lut, uint64_t seed);
+
+  Song generate(const Options& options);
+
+ private:
+  const DurationLUT& lut_;
+  std::mt19937_64 rng_;
+
+  // Not std::uniform_int_distribution, which differs between libraries
+  size_t pick(size_t n) { return rng_() % n; }
+  bool chance(float p) { return (rng_() >> 11) * 0x1.0p-53 < p; }
+
+  std::vector<Pitch> pick_pitches(const Options& options);
+  std::vector<int> pick_durations(byte tempo, size_t count);
+  std::vector<Note> fill(int length, const std::vector<int>& durations,
+                         const std::vector<bool>& reachable,
+                         const std::vector<Pitch>& pitches, float density);
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_SONG_GENERATOR_H_
@@ -0,0 +1,84 @@
+#include "song_generator.h"
+
+#include <set>
+#include <string>
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "pattern.h"
+#include "project_writer.h"
+#include "rom.h"
+
+namespace z2music {
+namespace {
+
+std::string dump(const Song& song) {
+  ProjectWriter writer;
+  writer.add_song("PalaceTheme", song);
+  return writer.str();
+}
+
+TEST(SongGeneratorTest, SameSeedSameSong) {
+  FakeRom rom;
+  const SongGenerator::Options options;
+
+  const Song first = SongGenerator(rom.duration_lut(), 7).generate(options);
+  const Song second = SongGenerator(rom.duration_lut(), 7).generate(options);
+  const Song other = SongGenerator(rom.duration_lut(), 8).generate(options);
+
+  EXPECT_EQ(dump(first), dump(second));
+  EXPECT_NE(dump(first), dump(other));
+}
+
+TEST(SongGeneratorTest, FollowsOptions) {
+  FakeRom rom;
+  SongGenerator::Options options;
+  options.patterns = 10;
+  options.durations = 3;
+  options.pitches = 5;
+  options.density = {1.f, 1.f, 0.f, .5f};
+  options.tempos = {0x08, 0x10};
+
+  const Song song = SongGenerator(rom.duration_lut(), 1).generate(options);
+  ASSERT_EQ(song.pattern_count(), 10);
+  EXPECT_EQ(song.sequence_length(), 10);
+  EXPECT_LE(song.pitches_used().size(), 6);
+
+  for (size_t i = 0; i < song.pattern_count(); ++i) {
+    const Pattern& pattern = song.pattern(i);
+    EXPECT_TRUE(pattern.tempo() == 0x08 || pattern.tempo() == 0x10);
+    EXPECT_GT(pattern.length(), Note::Whole - Note::Half);
+    EXPECT_LE(pattern.length(), Note::Whole);
+    EXPECT_TRUE(pattern.notes(Pattern::Channel::Triangle).empty());
+
+    std::set<int> durations;
+    for (auto ch : {Pattern::Channel::Pulse1, Pattern::Channel::Pulse2,
+                    Pattern::Channel::Noise}) {
+      int length = 0;
+      for (const auto& note : pattern.notes(ch)) {
+        EXPECT_TRUE(rom.can_encode_duration(note.ticks(), pattern.tempo()));
+        durations.insert(note.ticks());
+        length += note.ticks();
+      }
+      EXPECT_EQ(length, pattern.length());
+    }
+    EXPECT_LE(durations.size(), 3);
+  }
+}
+
+TEST(SongGeneratorTest, RoundTrips) {
+  FakeRom rom;
+  SongGenerator::Options options;
+  options.patterns = 6;
+  rom.song(Rom::SongTitle::PalaceTheme) =
+      SongGenerator(rom.duration_lut(), 42).generate(options);
+  rom.commit();
+  rom.make_decodable();
+
+  const Rom decoded = Rom::from_image(rom.image());
+  EXPECT_EQ(dump(decoded.song(Rom::SongTitle::PalaceTheme)),
+            dump(rom.song(Rom::SongTitle::PalaceTheme)));
+}
+
+}  // namespace
+}  // namespace z2music
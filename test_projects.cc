@@ -0,0 +1,17 @@
+#include "test_projects.h"
+
+namespace z2music {
+
+std::string too_many_pitches() {
+  static constexpr const char* kNames[] = {"c",  "c#", "d",  "d#", "e",  "f",
+                                           "f#", "g",  "g#", "a",  "a#", "b"};
+  std::string notes;
+  for (int octave = 3; octave <= 5; ++octave) {
+    for (const char* name : kNames) {
+      notes += name + std::to_string(octave) + ".8 ";
+    }
+  }
+  return "song TownTheme\npattern 0x18\n" + notes + "\n\n\n\nsequence 1\n";
+}
+
+}  // namespace z2music
@@ -0,0 +1,14 @@
+#ifndef Z2MUSIC_TEST_PROJECTS_H_
+#define Z2MUSIC_TEST_PROJECTS_H_
+
+#include <string>
+
+namespace z2music {
+
+// A project whose town theme uses three octaves of every semitone, more
+// pitches than the LUT has slots for, so it parses but can't be committed.
+std::string too_many_pitches();
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_TEST_PROJECTS_H_
@@ -0,0 +1,133 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace z2music {
+
+namespace {
+
+// Which pool and worker the current thread belongs to
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads, size_t max_queued)
+    : max_queued_(max_queued) {
+  if (threads == 0) threads = default_threads();
+  queues_.resize(threads);
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this, i] { work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_ready_.notify_all();
+  for (auto& worker : workers_) worker.join();
+}
+
+size_t ThreadPool::default_threads() {
+  const size_t threads = std::thread::hardware_concurrency();
+  return threads > 0 ? threads : 1;
+}
+
+size_t ThreadPool::steals() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return steals_;
+}
+
+int ThreadPool::worker_index() const {
+  return current_pool == this ? static_cast<int>(current_worker) : -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  const int worker = worker_index();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // A task waiting for space could wait forever if every worker did it
+    if (max_queued_ > 0 && worker < 0) {
+      space_ready_.wait(lock, [this] { return queued_ < max_queued_; });
+    }
+
+    const size_t queue =
+        worker >= 0 ? worker : next_queue_++ % queues_.size();
+    queues_[queue].push_back(std::move(task));
+    ++queued_;
+  }
+  work_ready_.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return queued_ == 0 && running_ == 0; });
+}
+
+bool ThreadPool::take(size_t worker, std::function<void()>& task) {
+  auto& own = queues_[worker];
+  if (!own.empty()) {
+    task = std::move(own.back());
+    own.pop_back();
+    return true;
+  }
+
+  for (size_t i = 1; i < queues_.size(); ++i) {
+    auto& other = queues_[(worker + i) % queues_.size()];
+    if (!other.empty()) {
+      task = std::move(other.front());
+      other.pop_front();
+      ++steals_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::work(size_t worker) {
+  current_pool = this;
+  current_worker = worker;
+
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_ready_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+      // Drain the queues before stopping
+      if (!take(worker, task)) return;
+
+      --queued_;
+      ++running_;
+    }
+    space_ready_.notify_one();
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --running_;
+      if (queued_ == 0 && running_ == 0) idle_.notify_all();
+    }
+  }
+}
+
+void parallel_for(size_t count, size_t threads,
+                  const std::function<void(size_t)>& fn) {
+  std::atomic<size_t> next = 0;
+  auto work = [&] {
+    for (size_t i = next++; i < count; i = next++) fn(i);
+  };
+
+  std::vector<std::thread> helpers;
+  threads = std::min(threads, count);
+  for (size_t i = 1; i < threads; ++i) helpers.emplace_back(work);
+  work();
+  for (auto& helper : helpers) helper.join();
+}
+
+}  // namespace z2music
@@ -0,0 +1,73 @@
+#ifndef Z2MUSIC_THREAD_POOL_H_
+#define Z2MUSIC_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace z2music {
+
+// A fixed number of worker threads sharing tasks by work stealing.  Every
+// worker has its own queue.  Tasks submitted from outside the pool are dealt
+// out to the queues in turn, and tasks submitted by a task go on the queue of
+// the worker running it.  Workers run the newest task on their own queue, and
+// when it is empty they steal the oldest task from another queue.
+//
+// With max_queued set, submitting from outside the pool blocks while that
+// many tasks are already waiting, so a fast producer can't queue up unbounded
+// work.  Tasks submitted by tasks never block.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads = 0, size_t max_queued = 0);
+  // Finishes every task already submitted before returning.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> task);
+  // Blocks until every task submitted so far has finished.  Must not be
+  // called from a task.
+  void wait();
+
+  size_t size() const { return workers_.size(); }
+  // Tasks which one worker took from another's queue
+  size_t steals() const;
+
+  // Worker count to use when none is given, at least one
+  static size_t default_threads();
+
+ private:
+  std::vector<std::thread> workers_;
+  const size_t max_queued_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable space_ready_;
+  std::condition_variable idle_;
+  std::vector<std::deque<std::function<void()>>> queues_;
+  size_t queued_ = 0;
+  size_t running_ = 0;
+  size_t next_queue_ = 0;
+  size_t steals_ = 0;
+  bool stopping_ = false;
+
+  // Index of the worker running on this thread, or -1
+  int worker_index() const;
+  bool take(size_t worker, std::function<void()>& task);
+  void work(size_t worker);
+};
+
+// Calls fn(i) for every i below count, on up to threads threads counting the
+// caller, and returns once every call has finished.  For short bursts of work
+// where a whole pool isn't worth keeping around.
+void parallel_for(size_t count, size_t threads,
+                  const std::function<void(size_t)>& fn);
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_THREAD_POOL_H_
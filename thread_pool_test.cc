@@ -0,0 +1,55 @@
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace z2music {
+namespace {
+
+TEST(ThreadPoolTest, RunsEveryTask) {
+  std::atomic<int> sum = 0;
+  {
+    ThreadPool pool(4, 2);
+    EXPECT_EQ(pool.size(), 4);
+    for (int i = 1; i <= 100; ++i) pool.submit([&sum, i] { sum += i; });
+    pool.wait();
+    EXPECT_EQ(sum, 5050);
+
+    for (int i = 0; i < 10; ++i) pool.submit([&sum] { ++sum; });
+  }
+  // The destructor finishes queued tasks
+  EXPECT_EQ(sum, 5060);
+}
+
+TEST(ThreadPoolTest, StealsWork) {
+  std::atomic<int> count = 0;
+  ThreadPool pool(2);
+  pool.submit([&pool, &count] {
+    // These all go on this worker's queue, so the other has to steal them
+    for (int i = 0; i < 100; ++i) pool.submit([&count] { ++count; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  });
+  pool.wait();
+
+  EXPECT_EQ(count, 100);
+  EXPECT_GT(pool.steals(), 0);
+}
+
+TEST(ThreadPoolTest, ParallelFor) {
+  std::vector<int> values(1000);
+  parallel_for(values.size(), 4, [&values](size_t i) { values[i] = i * 2; });
+  for (size_t i = 0; i < values.size(); ++i) EXPECT_EQ(values[i], i * 2);
+
+  // Runs on the calling thread alone
+  size_t calls = 0;
+  parallel_for(10, 1, [&calls](size_t) { ++calls; });
+  EXPECT_EQ(calls, 10);
+  parallel_for(0, 4, [](size_t) { FAIL(); });
+}
+
+}  // namespace
+}  // namespace z2music
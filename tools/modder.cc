@@ -1,188 +1,440 @@
+#include <chrono>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
 #include "absl/log/log.h"
+#include "alloc_tracker.h"
+#include "batch.h"
+#include "build_server.h"
+#include "builder.h"
+#include "incremental_parser.h"
+#include "ips.h"
+#include "metrics.h"
+#include "optimizer.h"
+#include "project.h"
 #include "rom.h"
+#include "rom_cache.h"
 #include "util.h"
 
 ABSL_FLAG(std::string, rom, "", "Path to the rom file to modify.");
 ABSL_FLAG(std::string, output, "", "Path where modified rom should be saved.");
+ABSL_FLAG(std::vector<std::string>, optimize, {},
+          "Optimizer passes to run before saving (merge_rests, "
+          "elide_silent_channels, fold_noise_loops, reorder_rest_runs).");
+ABSL_FLAG(std::string, cache_dir, "",
+          "Directory for caching decoded ROMs, so runs against the same ROM "
+          "skip decoding it.");
+ABSL_FLAG(bool, watch, false,
+          "Keep running and rebuild the output every time the project file "
+          "is saved.  Linux only.");
+ABSL_FLAG(bool, ips, false,
+          "Write an IPS patch against the base rom instead of a whole rom.");
+ABSL_FLAG(std::string, serve, "",
+          "Keep running and serve builds on this Unix socket, keeping base "
+          "roms loaded between builds.  --rom is the default base.  Linux "
+          "only.");
+ABSL_FLAG(std::string, connect, "",
+          "Send the build to a server started with --serve on this socket.  "
+          "Linux only.");
+ABSL_FLAG(bool, server_stats, false,
+          "With --connect, print the server's throughput and latency.");
+ABSL_FLAG(std::string, batch, "",
+          "Build every project listed in this manifest, which has a "
+          "\"project output\" pair on each line, against --rom.");
+ABSL_FLAG(size_t, threads, 0,
+          "Worker threads for --serve and --batch.  Defaults to one per "
+          "core.");
+ABSL_FLAG(std::string, metrics, "",
+          "Write stage timings, counters and, in builds with "
+          "--define=track_allocs=1, heap use to this JSON file on exit.");
+
+std::string read_file(std::istream& file) {
+  std::ostringstream data;
+  data << file.rdbuf();
+  return data.str();
+}
 
-std::string read_line(std::istream& file) {
-  std::string line;
-  std::getline(file, line);
-  return line;
+bool write_file(const std::string& filename, std::string_view data) {
+  std::ofstream file(filename, std::ios::binary);
+  file.write(data.data(), data.size());
+  file.close();
+  if (!file) LOG(ERROR) << "Could not write " << filename;
+  return static_cast<bool>(file);
 }
 
-z2music::Song* get_song_by_name(z2music::Rom& rom, const std::string& name) {
-  auto title = rom.title_by_name(name);
-  if (title == z2music::Rom::SongTitle::Unknown)
-    LOG(FATAL) << "Unknown song name " << name;
-  return &rom.song(title);
+// Reads the project named on the command line, or from stdin if there isn't
+// one.  Sets filename to the name used in messages.
+std::string read_project(const std::vector<char*>& args,
+                         std::string& filename) {
+  if (args.size() > 1) {
+    filename = args[1];
+    LOG(INFO) << "Parsing data from given filename: " << filename;
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) LOG(FATAL) << "Could not open " << filename;
+    return read_file(file);
+  }
+
+  filename = "<stdin>";
+  LOG(INFO) << "Parsing data from STDIN";
+  return read_file(std::cin);
 }
 
-z2music::Address get_loader_by_name(z2music::Rom& rom,
-                                    const std::string& name) {
-  if (name == "Title") return z2music::Rom::kTitleScreenLoader;
-  if (name == "Overworld") return z2music::Rom::kOverworldLoader;
-  if (name == "Town") return z2music::Rom::kTownLoader;
-  if (name == "Palace") return z2music::Rom::kPalaceLoader;
-  if (name == "GreatPalace") return z2music::Rom::kGreatPalaceLoader;
-  return z2music::Address(0);
+z2music::Rom load_rom(const std::string& filename) {
+  const std::string cache_dir = absl::GetFlag(FLAGS_cache_dir);
+  return cache_dir.empty() ? z2music::Rom(filename)
+                           : z2music::RomCache(cache_dir).open(filename);
 }
 
-void rtrim(std::string& str) {
-  str.erase(std::find_if(str.rbegin(), str.rend(),
-                         [](unsigned char c) { return !std::isspace(c); })
-                .base(),
-            str.end());
+std::vector<z2music::Optimizer::Pass> optimizer_passes(
+    const std::vector<std::string>& names) {
+  std::vector<z2music::Optimizer::Pass> passes;
+  for (const auto& name : names) {
+    const auto pass = z2music::Optimizer::pass_by_name(name);
+    if (pass == z2music::Optimizer::Pass::Unknown)
+      LOG(FATAL) << "Unknown optimizer pass: " << name;
+    passes.push_back(pass);
+  }
+  return passes;
 }
 
-void process_modfile(z2music::Rom& rom, std::istream& file) {
-  int transpose = 0;
-  size_t patterns = 0;
-  bool sequenced = false;
-  z2music::Song* song = nullptr;
+void optimize(z2music::Rom& rom, const std::vector<std::string>& passes) {
+  z2music::Optimizer optimizer([&rom](int ticks, z2music::byte tempo) {
+    return rom.can_encode_duration(ticks, tempo);
+  });
 
-  std::string line;
-  size_t line_number = 0;
-  while (std::getline(file, line)) {
-    rtrim(line);
-    ++line_number;
+  for (auto pass : optimizer_passes(passes)) optimizer.add_pass(pass);
 
-    if (line == "") continue;
+  if (optimizer.empty()) return;
 
-    std::istringstream input(line);
-    std::string command;
+  for (const auto& report : rom.optimize(optimizer)) {
+    LOG(INFO) << "Pass " << z2music::Optimizer::pass_name(report.pass)
+              << " changed note data by " << report.byte_delta << " bytes"
+              << (report.equivalent ? "" : " (some results discarded)");
+  }
+}
 
-    if (!(input >> command)) {
-      LOG(FATAL) << "Could not parse line: " << line;
+void report(const std::string& filename, const z2music::Project& project) {
+  for (const auto& d : project.diagnostics()) {
+    if (d.level == z2music::Project::Diagnostic::Level::Error) {
+      LOG(ERROR) << filename << ":" << d;
+    } else {
+      LOG(WARNING) << filename << ":" << d;
     }
+  }
+}
+
+// Commits the ROM and writes it, or with --ips a patch against original.
+bool write_output(z2music::Rom& rom, const std::string& original,
+                  const std::string& output) {
+  if (!absl::GetFlag(FLAGS_ips)) return rom.save(output);
+
+  // Changes don't reach the image until they are committed
+  if (!rom.commit()) return false;
+  return write_file(output, z2music::make_ips(original, rom.image()));
+}
+
+// Writes to a temporary file and renames it over the output, so an emulator
+// watching the output never loads half a ROM.
+void save_atomically(z2music::Rom& rom, const std::string& original,
+                     const std::string& output) {
+  const std::string temp = output + ".tmp";
+  if (!write_output(rom, original, temp)) {
+    LOG(ERROR) << "Not replacing " << output;
+    return;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temp, output, ec);
+  if (ec) LOG(ERROR) << "Could not replace " << output << ": " << ec.message();
+}
+
+#ifdef __linux__
+class Watcher {
+ public:
+  Watcher(const z2music::Rom& base, std::string filename, std::string output,
+          std::string encode_cache)
+      : base_(base),
+        filename_(std::move(filename)),
+        output_(std::move(output)),
+        encode_cache_file_(std::move(encode_cache)),
+        original_(base_.image()),
+        parser_(base_.layout()),
+        encode_cache_(std::move(base_.encode_cache())) {}
+
+  int run();
+
+ private:
+  z2music::Rom base_;
+  const std::string filename_;
+  const std::string output_;
+  const std::string encode_cache_file_;
+  // The base image, which patches are made against
+  const std::string original_;
+  z2music::IncrementalParser parser_;
+  z2music::EncodeCache encode_cache_;
+
+  void rebuild();
+};
+
+int Watcher::run() {
+  const std::filesystem::path path(filename_);
+  const std::filesystem::path dir =
+      path.has_parent_path() ? path.parent_path() : ".";
+
+  // Watch the directory rather than the file, since many editors save by
+  // writing a new file and renaming it over the old one.
+  const int fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0) LOG(FATAL) << "Could not start inotify";
+  if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    LOG(FATAL) << "Could not watch " << dir;
+  }
+
+  rebuild();
+  std::cout << "Watching " << filename_ << " for changes" << std::endl;
+
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    const ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR) continue;
+    if (length <= 0) LOG(FATAL) << "Could not read inotify events";
+
+    bool changed = false;
+    for (ssize_t i = 0; i < length;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(buffer + i);
+      if (event->len > 0 && path.filename() == event->name) changed = true;
+      i += sizeof(inotify_event) + event->len;
+    }
+
+    if (changed) rebuild();
+  }
+}
+
+void Watcher::rebuild() {
+  const auto start = std::chrono::steady_clock::now();
+
+  std::ifstream file(filename_, std::ios::binary);
+  if (!file) {
+    LOG(ERROR) << "Could not open " << filename_;
+    return;
+  }
+  const std::string data = read_file(file);
+
+  const z2music::Project binary =
+      z2music::Project::is_binary(data)
+          ? z2music::Project::read_binary(data, base_.layout())
+          : z2music::Project();
+  const z2music::Project& project =
+      z2music::Project::is_binary(data) ? binary : parser_.parse(data);
+  report(filename_, project);
+  if (!project.ok()) {
+    std::cout << "Not rebuilding, " << filename_ << " has errors"
+              << std::endl;
+    return;
+  }
+
+  // Start over from the base ROM each time, but keep the encoded patterns
+  z2music::Rom rom = base_;
+  rom.encode_cache() = std::move(encode_cache_);
+  const size_t encoded = rom.encode_cache().misses();
+
+  project.apply(rom);
+  optimize(rom, absl::GetFlag(FLAGS_optimize));
+  save_atomically(rom, original_, output_);
+
+  const size_t patterns = rom.encode_cache().misses() - encoded;
+  encode_cache_ = std::move(rom.encode_cache());
+  if (!encode_cache_file_.empty()) encode_cache_.save(encode_cache_file_);
+
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Rebuilt " << output_ << " in " << elapsed.count() << " ms ("
+            << parser_.parsed() << " of " << parser_.blocks()
+            << " blocks parsed, " << patterns << " patterns encoded)"
+            << std::endl;
+}
+#endif
+
+int serve(const std::string& socket) {
+  const std::string default_rom = absl::GetFlag(FLAGS_rom);
+  z2music::BuildServer server(
+      [&default_rom](const std::string& id) -> std::unique_ptr<z2music::Rom> {
+        const std::string filename = id.empty() ? default_rom : id;
+        if (!std::filesystem::is_regular_file(filename)) return nullptr;
+        return std::make_unique<z2music::Rom>(load_rom(filename));
+      },
+      optimizer_passes(absl::GetFlag(FLAGS_optimize)),
+      absl::GetFlag(FLAGS_threads));
+  return server.serve(socket) ? 0 : 1;
+}
+
+int send_build(const std::string& socket, const std::vector<char*>& args) {
+  z2music::BuildServer::Request request;
+  if (absl::GetFlag(FLAGS_server_stats)) {
+    request.kind = z2music::BuildServer::Kind::Stats;
+  } else {
+    // The server doesn't necessarily share our working directory
+    const std::string rom = absl::GetFlag(FLAGS_rom);
+    if (!rom.empty()) request.base = std::filesystem::absolute(rom).string();
+    request.output = absl::GetFlag(FLAGS_ips) ? z2music::Builder::Output::Ips
+                                              : z2music::Builder::Output::Rom;
+    std::string filename;
+    request.project = read_project(args, filename);
+  }
+
+  const auto response = z2music::BuildServer::send(socket, request);
+  if (!response) LOG(FATAL) << "No response from server on " << socket;
 
-    if (command == "song") {
-      std::string name;
-      if (!(input >> name)) {
-        LOG(FATAL) << "Song requires name";
-      }
-
-      if (song && !sequenced && patterns > 0) {
-        LOG(WARNING) << "Song changed without setting sequence";
-      }
-      song = get_song_by_name(rom, name);
-      song->clear();
-      transpose = 0;
-      patterns = 0;
-      sequenced = false;
-
-      LOG(INFO) << "Clearing song " << name;
-
-    } else if (command == "loader") {
-      std::string name;
-      z2music::Address address;
-
-      if (!(input >> name >> address)) {
-        LOG(FATAL) << "Loader requires name and address";
-      }
-
-      z2music::Address loader = get_loader_by_name(rom, name);
-      if (loader == 0) LOG(FATAL) << "Unknown loader name: " << name;
-      rom.move_song_table(loader, address);
-
-      LOG(INFO) << "Moving loader " << name << " to " << address;
-
-    } else if (command == "transpose") {
-      if (!(input >> transpose)) {
-        LOG(FATAL) << "Transpose requires offset";
-      }
-
-      LOG(INFO) << "Transpose set to " << transpose;
-
-    } else if (command == "pattern") {
-      if (!song) LOG(FATAL) << "Pattern set with no song";
-      if (sequenced) LOG(WARNING) << "Song already sequenced";
-
-      z2music::byte tempo, voice2;
-      if (!(input >> tempo)) {
-        LOG(FATAL) << "Pattern requires tempo";
-      }
-
-      if (input >> voice2) {
-        // two bytes means a voiced pattern (i.e. title music)
-        song->add_pattern({
-            tempo,
-            voice2,
-            z2music::Pattern::parse_notes(read_line(file)),
-            z2music::Pattern::parse_notes(read_line(file)),
-            z2music::Pattern::parse_notes(read_line(file)),
-            z2music::Pattern::parse_notes(read_line(file)),
-        });
-      } else {
-        song->add_pattern({
-            tempo,
-            z2music::Pattern::parse_notes(read_line(file)),
-            z2music::Pattern::parse_notes(read_line(file)),
-            z2music::Pattern::parse_notes(read_line(file)),
-            z2music::Pattern::parse_notes(read_line(file)),
-        });
-      }
-
-      ++patterns;
-      LOG(INFO) << "Added pattern " << patterns;
-
-    } else if (command == "sequence") {
-      if (!song) LOG(FATAL) << "Sequence set with no song";
-      if (sequenced) LOG(WARNING) << "Song already sequenced";
-
-      z2music::byte n;
-      std::vector<z2music::byte> sequence;
-      while (input >> n) {
-        if (n > patterns || n == 0) {
-          LOG(ERROR) << "No such pattern: " << n << " (" << patterns << ")";
-        }
-        sequence.push_back(n - 1);
-        sequenced = true;
-      }
-
-      song->set_sequence(sequence);
-      LOG(INFO) << "Sequence set";
+  std::cerr << response->diagnostics;
+  if (!response->ok) return 1;
+  if (request.kind == z2music::BuildServer::Kind::Stats) {
+    std::cout << response->data;
+    return 0;
+  }
+  return write_file(absl::GetFlag(FLAGS_output), response->data) ? 0 : 1;
+}
 
+int run_batch(const std::string& manifest) {
+  std::ifstream file(manifest, std::ios::binary);
+  if (!file) LOG(FATAL) << "Could not open " << manifest;
+
+  std::vector<std::string> errors;
+  const auto jobs =
+      z2music::Batch::parse(read_file(file),
+                            std::filesystem::path(manifest).parent_path(),
+                            errors);
+  for (const auto& error : errors) LOG(ERROR) << manifest << ":" << error;
+
+  const auto start = std::chrono::steady_clock::now();
+  const z2music::Builder builder(
+      load_rom(absl::GetFlag(FLAGS_rom)),
+      optimizer_passes(absl::GetFlag(FLAGS_optimize)));
+  const auto results = z2music::Batch(builder, absl::GetFlag(FLAGS_threads))
+                           .run(jobs, absl::GetFlag(FLAGS_ips));
+
+  size_t failed = errors.size();
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    const auto& job = jobs[i];
+    const auto& result = results[i];
+    if (result.ok) {
+      std::cout << "ok " << job.output << " (" << result.ms << " ms)"
+                << std::endl;
     } else {
-      LOG(WARNING) << "Unknown keyword '" << command << "'";
+      ++failed;
+      std::cout << "FAILED " << job.output << " from " << manifest << ":"
+                << job.line << std::endl;
+    }
+
+    std::istringstream diagnostics(result.diagnostics);
+    for (std::string line; std::getline(diagnostics, line);) {
+      std::cout << "  " << job.project << ":" << line << std::endl;
     }
   }
 
-  LOG(INFO) << "Parsed " << line_number << " lines of music data";
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << jobs.size() << " jobs, " << failed << " failed, in "
+            << elapsed.count() * 1000 << " ms ("
+            << jobs.size() / elapsed.count() << " jobs/s)" << std::endl;
+  return failed > 0 ? 1 : 0;
+}
 
-  if (song && !sequenced) {
-    LOG(WARNING) << "Reached end of file with unsequenced song";
+int run(const std::vector<char*>& args) {
+  if (const std::string manifest = absl::GetFlag(FLAGS_batch);
+      !manifest.empty()) {
+    return run_batch(manifest);
+  }
+  if (const std::string socket = absl::GetFlag(FLAGS_serve); !socket.empty()) {
+    return serve(socket);
   }
+  if (const std::string socket = absl::GetFlag(FLAGS_connect);
+      !socket.empty()) {
+    return send_build(socket, args);
+  }
+
+  const std::string cache_dir = absl::GetFlag(FLAGS_cache_dir);
+  z2music::Rom rom = load_rom(absl::GetFlag(FLAGS_rom));
+  // Applying the project can change the image, such as when it moves a
+  // loader, so patches are made against the image as it was loaded.
+  const std::string original = absl::GetFlag(FLAGS_ips) ? rom.image() : "";
+
+  // Patterns encoded by earlier runs don't need encoding again
+  const std::string encode_cache =
+      cache_dir.empty()
+          ? ""
+          : (std::filesystem::path(cache_dir) / "patterns.z2ec").string();
+  if (!encode_cache.empty()) rom.encode_cache().load(encode_cache);
+
+  if (absl::GetFlag(FLAGS_watch)) {
+#ifdef __linux__
+    if (args.size() < 2) LOG(FATAL) << "--watch needs a project file";
+    return Watcher(rom, args[1], absl::GetFlag(FLAGS_output), encode_cache)
+        .run();
+#else
+    LOG(FATAL) << "--watch is only supported on Linux";
+#endif
+  }
+
+  std::string filename;
+  const std::string data = read_project(args, filename);
+
+  const auto project = z2music::Project::load(data, rom.layout());
+  if (z2music::Project::is_binary(data)) {
+    LOG(INFO) << "Loaded binary project";
+  } else {
+    LOG(INFO) << "Parsed " << project.lines() << " lines of music data";
+  }
+
+  report(filename, project);
+  if (!project.apply(rom)) return 1;
+
+  optimize(rom, absl::GetFlag(FLAGS_optimize));
+  if (!write_output(rom, original, absl::GetFlag(FLAGS_output))) return 1;
+
+  if (!encode_cache.empty()) {
+    LOG(INFO) << "Encoded patterns: " << rom.encode_cache().hits()
+              << " cached, " << rom.encode_cache().misses() << " encoded";
+    rom.encode_cache().save(encode_cache);
+  }
+  return 0;
 }
 
 int main(int argc, char** argv) {
   std::ostringstream usage;
   usage << "Modifies the music in a Zelda 2 ROM." << std::endl;
   usage << "Example usage:" << std::endl;
-  usage << argv[0] << " <musicfile> --rom <rom> --output <output>";
+  usage << argv[0] << " <musicfile> --rom <rom> --output <output> [--watch]"
+        << std::endl;
+  usage << argv[0] << " --batch <manifest> --rom <rom>" << std::endl;
+  usage << argv[0] << " --serve <socket> --rom <rom>" << std::endl;
+  usage << argv[0]
+        << " <musicfile> --connect <socket> --rom <rom> --output <output>";
   absl::SetProgramUsageMessage(usage.str());
 
-  auto args = absl::ParseCommandLine(argc, argv);
-  z2music::Rom rom(absl::GetFlag(FLAGS_rom));
-
-  if (args.size() > 1) {
-    LOG(INFO) << "Parsing data from given filename: " << args[1];
-    std::ifstream file(args[1]);
-    process_modfile(rom, file);
-  } else {
-    LOG(INFO) << "Parsing data from STDIN";
-    process_modfile(rom, std::cin);
+  const auto args = absl::ParseCommandLine(argc, argv);
+  const std::string metrics = absl::GetFlag(FLAGS_metrics);
+  if (!metrics.empty()) {
+    z2music::Metrics::enable();
+    z2music::AllocTracker::enable();
   }
 
-  rom.save(absl::GetFlag(FLAGS_output));
-  return 0;
+  const int result = run(args);
+  if (!metrics.empty() && !z2music::Metrics::write(metrics)) {
+    LOG(ERROR) << "Could not write metrics to " << metrics;
+  }
+  return result;
 }
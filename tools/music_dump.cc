@@ -1,59 +1,187 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
 #include "absl/log/log.h"
+#include "alloc_tracker.h"
+#include "binary_io.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "project_writer.h"
+#include "registry.h"
 #include "rom.h"
+#include "rom_cache.h"
+#include "thread_pool.h"
 #include "util.h"
 
 ABSL_FLAG(std::string, rom, "", "Path to the rom file to dump.");
 ABSL_FLAG(std::optional<std::string>, song, std::nullopt,
           "Dump only the listed song.");
+ABSL_FLAG(std::string, cache_dir, "",
+          "Directory for caching decoded ROMs, so runs against the same ROM "
+          "skip decoding it.");
+ABSL_FLAG(std::string, corpus, "",
+          "Dump every .nes file under this directory instead of one --rom.");
+ABSL_FLAG(std::string, output_dir, "",
+          "With --corpus, write a project file for each unique ROM and an "
+          "index.tsv here, instead of printing the index.");
+ABSL_FLAG(size_t, threads, 0,
+          "Worker threads for --corpus.  Defaults to one per core.");
+ABSL_FLAG(std::string, metrics, "",
+          "Write stage timings, counters and, in builds with "
+          "--define=track_allocs=1, heap use to this JSON file on exit.");
 
-void dump_song(const std::string& title, const z2music::Song& song) {
-  std::cout << "song " << title << std::endl;
+void dump_songs(const z2music::Rom& rom, z2music::ProjectWriter& writer) {
+  for (const auto& entry : z2music::kSongs) {
+    writer.add_song(entry.name, rom.song(entry.title));
+  }
+}
 
-  for (const auto& pattern : song.patterns()) {
-    if (pattern.voiced()) {
-      std::cout << "pattern " << pattern.voice1() << " " << pattern.voice2()
-                << std::endl;
-    } else {
-      std::cout << "pattern " << pattern.tempo() << std::endl;
+struct CorpusEntry {
+  std::filesystem::path path;
+  bool valid = false;
+  uint64_t hash = 0;
+  // Hash of the dumped project, the same for ROMs with the same music
+  uint64_t music_hash = 0;
+  // Index of the first entry with the same image
+  size_t original = 0;
+};
+
+std::string hex(uint64_t hash) {
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx",
+                static_cast<unsigned long long>(hash));
+  return buffer;
+}
+
+int dump_corpus(const std::filesystem::path& dir) {
+  std::vector<CorpusEntry> entries;
+  std::error_code ec;
+  for (const auto& file :
+       std::filesystem::recursive_directory_iterator(dir, ec)) {
+    if (file.is_regular_file() && file.path().extension() == ".nes") {
+      entries.push_back({file.path()});
+    }
+  }
+  if (ec) LOG(FATAL) << "Could not read " << dir << ": " << ec.message();
+
+  // Sorted, so the same file is dumped out of a set of duplicates every time
+  std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return a.path < b.path; });
+
+  const std::filesystem::path output_dir = absl::GetFlag(FLAGS_output_dir);
+  z2music::ThreadPool pool(absl::GetFlag(FLAGS_threads));
+
+  for (auto& entry : entries) {
+    pool.submit([&entry] {
+      const z2music::MappedFile file(entry.path.string());
+      const auto data = file.data();
+      entry.valid =
+          file.ok() && data.size() == z2music::Rom::kHeaderSize +
+                                          z2music::Rom::kRomSize;
+      if (entry.valid) entry.hash = z2music::fingerprint(data);
+    });
+  }
+  pool.wait();
+
+  // Entries with the same hash are only duplicates if the bytes match too
+  std::unordered_map<uint64_t, std::vector<size_t>> originals;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    auto& entry = entries[i];
+    if (!entry.valid) continue;
+
+    auto& candidates = originals[entry.hash];
+    entry.original = i;
+    if (!candidates.empty()) {
+      const z2music::MappedFile file(entry.path.string());
+      for (size_t c : candidates) {
+        const z2music::MappedFile other(entries[c].path.string());
+        if (file.data() == other.data()) {
+          entry.original = c;
+          break;
+        }
+      }
     }
+    if (entry.original != i) continue;
+    candidates.push_back(i);
+
+    pool.submit([&entry, &dir, &output_dir] {
+      const z2music::MappedFile file(entry.path.string());
+      const auto rom = z2music::Rom::from_image(file.data());
+      if (!rom.matches_layout()) {
+        entry.valid = false;
+        return;
+      }
 
-    std::cout << pattern.dump_notes(z2music::Pattern::Channel::Pulse1)
-              << std::endl;
-    std::cout << pattern.dump_notes(z2music::Pattern::Channel::Pulse2)
-              << std::endl;
-    std::cout << pattern.dump_notes(z2music::Pattern::Channel::Triangle)
-              << std::endl;
-    std::cout << pattern.dump_notes(z2music::Pattern::Channel::Noise)
-              << std::endl;
+      z2music::ProjectWriter writer;
+      dump_songs(rom, writer);
+      entry.music_hash = z2music::fingerprint(writer.str());
+      if (output_dir.empty()) return;
+
+      auto output = output_dir / std::filesystem::relative(entry.path, dir);
+      output.replace_extension(".z2music");
+      std::error_code ec;
+      std::filesystem::create_directories(output.parent_path(), ec);
+      std::ofstream out(output, std::ios::binary);
+      writer.write(out);
+      if (!out) LOG(ERROR) << "Could not write " << output;
+    });
   }
+  pool.wait();
 
-  if (!song.empty()) {
-    std::cout << "sequence";
-    for (size_t n : song.sequence()) {
-      std::cout << " " << (n + 1);
+  // Path, image hash, music hash and whether it was dumped
+  std::ostringstream index;
+  size_t dumped = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const auto& entry = entries[i];
+    index << entry.path.string() << "\t";
+    // A copy of an image which didn't decode is just as invalid
+    if (!entry.valid || !entries[entry.original].valid) {
+      index << "-\t-\tinvalid" << std::endl;
+    } else if (entry.original != i) {
+      index << hex(entry.hash) << "\t"
+            << hex(entries[entry.original].music_hash) << "\tduplicate of "
+            << entries[entry.original].path.string() << std::endl;
+    } else {
+      index << hex(entry.hash) << "\t" << hex(entry.music_hash)
+            << "\tunique" << std::endl;
+      ++dumped;
     }
-    std::cout << std::endl << std::endl;
   }
+
+  LOG(INFO) << "Found " << entries.size() << " ROMs, " << dumped
+            << " unique, with " << pool.steals() << " tasks stolen";
+  if (output_dir.empty()) {
+    std::cout << index.str();
+  } else {
+    std::ofstream out(output_dir / "index.tsv", std::ios::binary);
+    out << index.str();
+  }
+  return 0;
 }
 
-int main(int argc, char** argv) {
-  std::ostringstream usage;
-  usage << "Dumps the music from a Zelda 2 ROM." << std::endl;
-  usage << "Example usage:" << std::endl;
-  usage << argv[0] << " --rom <rom> [--song <songname>]";
-  absl::SetProgramUsageMessage(usage.str());
+int run() {
+  if (const std::string corpus = absl::GetFlag(FLAGS_corpus);
+      !corpus.empty()) {
+    return dump_corpus(corpus);
+  }
 
-  auto args = absl::ParseCommandLine(argc, argv);
-  const z2music::Rom rom(absl::GetFlag(FLAGS_rom));
+  const std::string cache_dir = absl::GetFlag(FLAGS_cache_dir);
+  const z2music::Rom rom =
+      cache_dir.empty()
+          ? z2music::Rom(absl::GetFlag(FLAGS_rom))
+          : z2music::RomCache(cache_dir).open(absl::GetFlag(FLAGS_rom));
+  z2music::ProjectWriter writer;
 
   if (absl::GetFlag(FLAGS_song).has_value()) {
     const auto title = absl::GetFlag(FLAGS_song).value();
@@ -61,54 +189,35 @@ int main(int argc, char** argv) {
     if (song_title == z2music::Rom::SongTitle::Unknown) {
       LOG(FATAL) << "Unknown song title: " << title;
     }
-    const z2music::Song song = rom.song(song_title);
-    dump_song(title, song);
+    writer.add_song(title, rom.song(song_title));
   } else {
-    dump_song("TitleIntro", rom.song(z2music::Rom::SongTitle::TitleIntro));
-    dump_song("TitleThemeStart",
-              rom.song(z2music::Rom::SongTitle::TitleThemeStart));
-    dump_song("TitleThemeBuildup",
-              rom.song(z2music::Rom::SongTitle::TitleThemeBuildup));
-    dump_song("TitleThemeMain",
-              rom.song(z2music::Rom::SongTitle::TitleThemeMain));
-    dump_song("TitleThemeBreakdown",
-              rom.song(z2music::Rom::SongTitle::TitleThemeBreakdown));
-
-    dump_song("OverworldIntro",
-              rom.song(z2music::Rom::SongTitle::OverworldIntro));
-    dump_song("OverworldTheme",
-              rom.song(z2music::Rom::SongTitle::OverworldTheme));
-    dump_song("BattleTheme", rom.song(z2music::Rom::SongTitle::BattleTheme));
-    dump_song("CaveItemFanfare",
-              rom.song(z2music::Rom::SongTitle::CaveItemFanfare));
-
-    dump_song("TownIntro", rom.song(z2music::Rom::SongTitle::TownIntro));
-    dump_song("TownTheme", rom.song(z2music::Rom::SongTitle::TownTheme));
-    dump_song("HouseTheme", rom.song(z2music::Rom::SongTitle::HouseTheme));
-    dump_song("TownItemFanfare",
-              rom.song(z2music::Rom::SongTitle::TownItemFanfare));
-
-    dump_song("PalaceIntro", rom.song(z2music::Rom::SongTitle::PalaceIntro));
-    dump_song("PalaceTheme", rom.song(z2music::Rom::SongTitle::PalaceTheme));
-    dump_song("BossTheme", rom.song(z2music::Rom::SongTitle::BossTheme));
-    dump_song("PalaceItemFanfare",
-              rom.song(z2music::Rom::SongTitle::PalaceItemFanfare));
-    dump_song("CrystalFanfare",
-              rom.song(z2music::Rom::SongTitle::CrystalFanfare));
-
-    dump_song("GreatPalaceIntro",
-              rom.song(z2music::Rom::SongTitle::GreatPalaceIntro));
-    dump_song("GreatPalaceTheme",
-              rom.song(z2music::Rom::SongTitle::GreatPalaceTheme));
-    dump_song("ZeldaTheme", rom.song(z2music::Rom::SongTitle::ZeldaTheme));
-    dump_song("CreditsTheme", rom.song(z2music::Rom::SongTitle::CreditsTheme));
-    dump_song("GreatPalaceItemFanfare",
-              rom.song(z2music::Rom::SongTitle::GreatPalaceItemFanfare));
-    dump_song("TriforceFanfare",
-              rom.song(z2music::Rom::SongTitle::TriforceFanfare));
-    dump_song("FinalBossTheme",
-              rom.song(z2music::Rom::SongTitle::FinalBossTheme));
+    dump_songs(rom, writer);
   }
 
+  writer.write(std::cout);
+
   return 0;
 }
+
+int main(int argc, char** argv) {
+  std::ostringstream usage;
+  usage << "Dumps the music from a Zelda 2 ROM." << std::endl;
+  usage << "Example usage:" << std::endl;
+  usage << argv[0] << " --rom <rom> [--song <songname>] [--cache_dir <dir>]"
+        << std::endl;
+  usage << argv[0] << " --corpus <dir> [--output_dir <dir>]";
+  absl::SetProgramUsageMessage(usage.str());
+
+  absl::ParseCommandLine(argc, argv);
+  const std::string metrics = absl::GetFlag(FLAGS_metrics);
+  if (!metrics.empty()) {
+    z2music::Metrics::enable();
+    z2music::AllocTracker::enable();
+  }
+
+  const int result = run();
+  if (!metrics.empty() && !z2music::Metrics::write(metrics)) {
+    LOG(ERROR) << "Could not write metrics to " << metrics;
+  }
+  return result;
+}
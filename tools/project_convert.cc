@@ -0,0 +1,55 @@
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/log.h"
+#include "project.h"
+
+ABSL_FLAG(std::string, output, "", "Path to save the converted project.");
+ABSL_FLAG(bool, binary, true,
+          "Write a binary project.  With --nobinary, write text instead.");
+
+int main(int argc, char** argv) {
+  std::ostringstream usage;
+  usage << "Converts a modder project between text and binary." << std::endl;
+  usage << "Example usage:" << std::endl;
+  usage << argv[0] << " <musicfile> --output <output> [--nobinary]";
+  absl::SetProgramUsageMessage(usage.str());
+
+  auto args = absl::ParseCommandLine(argc, argv);
+  if (args.size() < 2) LOG(FATAL) << "No project file given";
+
+  std::ifstream input(args[1], std::ios::binary);
+  if (!input) LOG(FATAL) << "Could not open " << args[1];
+  std::ostringstream data;
+  data << input.rdbuf();
+
+  const auto project = z2music::Project::load(data.str());
+  for (const auto& d : project.diagnostics()) {
+    if (d.level == z2music::Project::Diagnostic::Level::Error) {
+      LOG(ERROR) << args[1] << ":" << d;
+    } else {
+      LOG(WARNING) << args[1] << ":" << d;
+    }
+  }
+  if (!project.ok()) return 1;
+
+  const std::optional<std::string> output = absl::GetFlag(FLAGS_binary)
+                                               ? project.to_binary()
+                                               : project.to_text();
+  if (!output) {
+    LOG(ERROR) << args[1] << " is too big for the binary format";
+    return 1;
+  }
+
+  std::ofstream file(absl::GetFlag(FLAGS_output), std::ios::binary);
+  file.write(output->data(), output->size());
+  if (!file) LOG(FATAL) << "Could not write " << absl::GetFlag(FLAGS_output);
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef Z2MUSIC_TRACE_H_
+#define Z2MUSIC_TRACE_H_
+
+#include "absl/base/log_severity.h"
+#include "absl/log/globals.h"
+#include "absl/log/log.h"
+
+namespace z2music {
+
+inline bool tracing() {
+  return absl::MinLogLevel() <= absl::LogSeverityAtLeast::kInfo;
+}
+
+}  // namespace z2music
+
+// Logging for the hot loops, once for every note, pitch or byte read or
+// written.  Used like LOG(INFO), but nothing streamed into it is evaluated
+// unless INFO messages are being logged, so it costs a single check at
+// --minloglevel 1.  Opt builds define Z2MUSIC_STRIP_TRACE, which compiles it
+// out altogether.
+#ifdef Z2MUSIC_STRIP_TRACE
+#define TRACE LOG_IF(INFO, false)
+#else
+#define TRACE LOG_IF(INFO, ::z2music::tracing())
+#endif
+
+#endif  // Z2MUSIC_TRACE_H_
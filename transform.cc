@@ -0,0 +1,201 @@
+#include "transform.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "note.h"
+#include "pitch.h"
+#include "thread_pool.h"
+
+namespace z2music {
+
+namespace {
+
+constexpr int kLowest = Pitch::C1;
+constexpr int kHighest = Pitch::B8;
+
+// Pitch::midi() for every timer, counted up from the lowest note a timer can
+// play so that it fits in a byte.  Found once, so that transposing a note is
+// two table lookups instead of a search.
+const std::vector<uint8_t>& note_indices() {
+  static const std::vector<uint8_t> indices = [] {
+    const int lowest = Pitch(WordBE(0xffff)).midi();
+    std::vector<uint8_t> indices(0x10000);
+    for (size_t timer = 0; timer < indices.size(); ++timer) {
+      indices[timer] = Pitch(WordBE(timer)).midi() - lowest;
+    }
+    return indices;
+  }();
+  return indices;
+}
+
+}  // namespace
+
+Transform Transform::transpose(int semitones) {
+  Transform transform(Kind::Transpose);
+
+  // Timer 0 is a rest and has the highest index of all
+  const auto& indices = note_indices();
+  const int lowest = Pitch(WordBE(0xffff)).midi();
+  const int rest = indices[0];
+  transform.timers_.assign(rest + 1, 0);
+  for (int midi = kLowest; midi <= kHighest; ++midi) {
+    const int from = midi - semitones - lowest;
+    if (from < 0 || from >= rest) continue;
+    transform.timers_[from] = Pitch(static_cast<Pitch::Midi>(midi)).timer();
+  }
+  return transform;
+}
+
+Transform Transform::stretch(int numerator, int denominator) {
+  Transform transform(Kind::Stretch);
+  transform.numerator_ = numerator;
+  transform.denominator_ = denominator;
+  return transform;
+}
+
+Transform Transform::swap_channels(Channel a, Channel b) {
+  Transform transform(Kind::SwapChannels);
+  transform.first_ = a;
+  transform.second_ = b;
+  return transform;
+}
+
+Transform Transform::copy_channel(Channel from, Channel to) {
+  Transform transform(Kind::CopyChannel);
+  transform.first_ = from;
+  transform.second_ = to;
+  return transform;
+}
+
+bool Transform::valid(const Pattern& pattern) const {
+  const auto notes = pattern.all_notes();
+  switch (kind_) {
+    case Kind::Transpose:
+      return std::all_of(notes.begin(), notes.end(), [this](Note note) {
+        return note.pitch().timer() == 0 || transposed(note) != 0;
+      });
+
+    case Kind::Stretch:
+      if (numerator_ <= 0 || denominator_ <= 0) return false;
+      return std::all_of(notes.begin(), notes.end(), [this](Note note) {
+        const int64_t ticks = int64_t{note.ticks()} * numerator_;
+        return ticks % denominator_ == 0 &&
+               ticks / denominator_ <= Note::kMaxTicks;
+      });
+
+    case Kind::SwapChannels:
+    case Kind::CopyChannel:
+      return true;
+  }
+  return false;
+}
+
+uint16_t Transform::transposed(Note note) const {
+  return timers_[note_indices()[note.pitch().timer()]];
+}
+
+bool Transform::fits_title_lut(const Song& song, const PitchLUT& lut) const {
+  if (kind_ != Kind::Transpose) return true;
+  for (const Pattern& pattern : song.patterns()) {
+    if (!pattern.voiced()) continue;
+    for (const Note note : pattern.all_notes()) {
+      if (!lut.has_pitch(Pitch(WordBE(transposed(note))))) return false;
+    }
+  }
+  return true;
+}
+
+bool Transform::valid(const Song& song) const {
+  const auto& patterns = song.patterns();
+  return std::all_of(patterns.begin(), patterns.end(),
+                     [this](const Pattern& p) { return valid(p); });
+}
+
+bool Transform::apply(Pattern& pattern) const {
+  if (!valid(pattern)) return false;
+  change(pattern);
+  return true;
+}
+
+bool Transform::apply(Song& song) const {
+  if (!valid(song)) return false;
+  for (size_t i = 0; i < song.pattern_count(); ++i) change(song.pattern(i));
+  return true;
+}
+
+bool Transform::apply(Rom& rom, size_t threads) const {
+  std::vector<Song*> songs;
+  for (size_t t = 0; t < kSongTables; ++t) {
+    for (Song& song : rom.score(static_cast<SongTable>(t))) {
+      songs.push_back(&song);
+    }
+  }
+  if (threads == 0) threads = ThreadPool::default_threads();
+
+  // Every song is checked before any is changed, so that a song which can't
+  // take the change leaves the whole ROM as it was.  Not vector<bool>, whose
+  // elements can't be written from different threads.
+  std::vector<char> ok(songs.size());
+  const PitchLUT& title_lut = rom.title_pitch_lut();
+  parallel_for(songs.size(), threads, [&](size_t i) {
+    ok[i] = valid(*songs[i]) && fits_title_lut(*songs[i], title_lut);
+  });
+  if (std::count(ok.begin(), ok.end(), 0) > 0) return false;
+
+  parallel_for(songs.size(), threads, [&](size_t i) {
+    for (size_t p = 0; p < songs[i]->pattern_count(); ++p) {
+      change(songs[i]->pattern(p));
+    }
+  });
+  return true;
+}
+
+void Transform::change(Pattern& pattern) const {
+  switch (kind_) {
+    case Kind::Transpose: {
+      // Two lookups per note, with no branches or searches
+      const uint8_t* indices = note_indices().data();
+      const uint16_t* timers = timers_.data();
+      for (Note& note : pattern.all_notes()) {
+        const uint16_t timer = timers[indices[note.pitch().timer()]];
+        note = Note(Pitch(WordBE(timer)), note.ticks());
+      }
+      break;
+    }
+
+    case Kind::Stretch: {
+      // valid() has checked that every product divides exactly, and products
+      // of up to 47 bits are exact in a double, so this gives the same ticks
+      // as integer division.  Unlike int64_t division, it vectorizes.
+      const double numerator = numerator_;
+      const double denominator = denominator_;
+      for (Note& note : pattern.all_notes()) {
+        const double ticks = note.ticks() * numerator / denominator;
+        note = Note(note.pitch(), static_cast<int>(ticks));
+      }
+      break;
+    }
+
+    case Kind::SwapChannels: {
+      if (first_ == second_) break;
+      const auto a = pattern.notes(first_);
+      const auto b = pattern.notes(second_);
+      std::vector<Note> first(b.begin(), b.end());
+      std::vector<Note> second(a.begin(), a.end());
+      pattern.set_notes(first_, std::move(first));
+      pattern.set_notes(second_, std::move(second));
+      break;
+    }
+
+    case Kind::CopyChannel: {
+      if (first_ == second_) break;
+      const auto notes = pattern.notes(first_);
+      pattern.set_notes(second_, std::vector<Note>(notes.begin(), notes.end()));
+      break;
+    }
+  }
+}
+
+}  // namespace z2music
@@ -0,0 +1,65 @@
+#ifndef Z2MUSIC_TRANSFORM_H_
+#define Z2MUSIC_TRANSFORM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "pattern.h"
+#include "pitch_lut.h"
+#include "rom.h"
+#include "song.h"
+
+namespace z2music {
+
+// A change to loaded music, made in place on each pattern's note buffer so
+// that a project can be reworked without dumping and parsing it again.  A
+// transform either changes every note it applies to or, if any of them
+// can't take it, none of them.
+class Transform {
+ public:
+  typedef Pattern::Channel Channel;
+
+  // Moves every note by semitones, leaving rests alone.  Notes have to stay
+  // between C1 and B8, the range that can be written as text.
+  static Transform transpose(int semitones);
+  // Multiplies every duration by numerator / denominator, which has to come
+  // out to a whole number of ticks for every note.
+  static Transform stretch(int numerator, int denominator);
+  static Transform swap_channels(Channel a, Channel b);
+  static Transform copy_channel(Channel from, Channel to);
+
+  bool valid(const Pattern& pattern) const;
+  bool valid(const Song& song) const;
+
+  // Return false without changing anything unless the transform is valid
+  // for all of it.
+  bool apply(Pattern& pattern) const;
+  bool apply(Song& song) const;
+  // Every song in every table, on up to threads threads, 0 for one per core.
+  // Title music can only play the pitches in the ROM's fixed title pitch LUT,
+  // so a transposition which moves it anywhere else isn't valid.
+  bool apply(Rom& rom, size_t threads = 0) const;
+
+ private:
+  enum class Kind { Transpose, Stretch, SwapChannels, CopyChannel };
+
+  explicit Transform(Kind kind) : kind_(kind) {}
+
+  Kind kind_;
+  int numerator_ = 1;
+  int denominator_ = 1;
+  Channel first_ = Channel::Pulse1;
+  Channel second_ = Channel::Pulse1;
+  // For transpositions, the new timer for each note_index() of the old one,
+  // or 0 where the note would leave the range.  Rests map to rests.
+  std::vector<uint16_t> timers_;
+
+  uint16_t transposed(Note note) const;
+  bool fits_title_lut(const Song& song, const PitchLUT& lut) const;
+  void change(Pattern& pattern) const;
+};
+
+}  // namespace z2music
+
+#endif  // Z2MUSIC_TRANSFORM_H_
@@ -0,0 +1,122 @@
+#include "transform.h"
+
+#include <vector>
+
+#include "fake_rom.h"
+#include "gtest/gtest.h"
+#include "note.h"
+#include "pattern.h"
+#include "pitch.h"
+#include "song.h"
+
+namespace z2music {
+namespace {
+
+typedef Pattern::Channel Channel;
+
+std::vector<Note> notes(const Pattern& pattern, Channel ch) {
+  const auto span = pattern.notes(ch);
+  return {span.begin(), span.end()};
+}
+
+TEST(TransformTest, Transpose) {
+  Pattern pattern(0x18, Pattern::parse_notes("A4.4 r C5"),
+                  Pattern::parse_notes("E5.4 r"), {}, {});
+
+  EXPECT_TRUE(Transform::transpose(2).apply(pattern));
+  EXPECT_EQ(notes(pattern, Channel::Pulse1),
+            Pattern::parse_notes("B4.4 r D5"));
+  EXPECT_EQ(notes(pattern, Channel::Pulse2), Pattern::parse_notes("F#5.4 r"));
+}
+
+TEST(TransformTest, TransposeOutOfRange) {
+  Pattern pattern(0x18, Pattern::parse_notes("A4.4 C8"), {}, {}, {});
+
+  // C8 can't go up an octave and a half, so A4 doesn't move either
+  EXPECT_FALSE(Transform::transpose(18).apply(pattern));
+  EXPECT_EQ(notes(pattern, Channel::Pulse1), Pattern::parse_notes("A4.4 C8"));
+}
+
+TEST(TransformTest, Stretch) {
+  Pattern pattern(0x18, Pattern::parse_notes("A4.4 r.8"), {}, {}, {});
+  const int quarter = pattern.notes(Channel::Pulse1)[0].ticks();
+  const int eighth = pattern.notes(Channel::Pulse1)[1].ticks();
+
+  EXPECT_TRUE(Transform::stretch(3, 2).apply(pattern));
+  EXPECT_EQ(pattern.notes(Channel::Pulse1)[0].ticks(), quarter * 3 / 2);
+  EXPECT_EQ(pattern.notes(Channel::Pulse1)[1].ticks(), eighth * 3 / 2);
+
+  // Neither note is long enough to shrink by that much
+  EXPECT_FALSE(Transform::stretch(1, quarter * 2).apply(pattern));
+  EXPECT_FALSE(Transform::stretch(0, 1).apply(pattern));
+  EXPECT_EQ(pattern.notes(Channel::Pulse1)[0].ticks(), quarter * 3 / 2);
+}
+
+TEST(TransformTest, StretchLargeRatio) {
+  Pattern pattern(0x18, Pattern::parse_notes("A4.4"), {}, {}, {});
+  const int quarter = pattern.notes(Channel::Pulse1)[0].ticks();
+  ASSERT_EQ(quarter, 96);
+
+  // The numerator times the ticks doesn't fit in an int
+  EXPECT_TRUE(Transform::stretch(1 << 27, 1 << 27).apply(pattern));
+  EXPECT_EQ(pattern.notes(Channel::Pulse1)[0].ticks(), quarter);
+}
+
+TEST(TransformTest, Channels) {
+  Pattern pattern(0x18, Pattern::parse_notes("A4.4 C5"),
+                  Pattern::parse_notes("E5.8"), {}, {});
+
+  EXPECT_TRUE(Transform::swap_channels(Channel::Pulse1, Channel::Pulse2)
+                  .apply(pattern));
+  EXPECT_EQ(notes(pattern, Channel::Pulse1), Pattern::parse_notes("E5.8"));
+  EXPECT_EQ(notes(pattern, Channel::Pulse2), Pattern::parse_notes("A4.4 C5"));
+
+  EXPECT_TRUE(Transform::copy_channel(Channel::Pulse2, Channel::Triangle)
+                  .apply(pattern));
+  EXPECT_EQ(notes(pattern, Channel::Triangle),
+            Pattern::parse_notes("A4.4 C5"));
+  EXPECT_EQ(notes(pattern, Channel::Pulse2), Pattern::parse_notes("A4.4 C5"));
+}
+
+TEST(TransformTest, Rom) {
+  FakeRom rom;
+  Song& town = rom.song(Rom::SongTitle::TownTheme);
+  town.add_pattern({0x18, Pattern::parse_notes("A4.4 C5"), {}, {}, {}});
+  Song& palace = rom.song(Rom::SongTitle::PalaceTheme);
+  palace.add_pattern({0x20, Pattern::parse_notes("E5.8 r"), {}, {}, {}});
+
+  EXPECT_TRUE(Transform::transpose(-12).apply(rom, 2));
+  EXPECT_EQ(notes(town.pattern(0), Channel::Pulse1),
+            Pattern::parse_notes("A3.4 C4"));
+  EXPECT_EQ(notes(palace.pattern(0), Channel::Pulse1),
+            Pattern::parse_notes("E4.8 r"));
+
+  // One pattern can't go that low, so no song changes
+  EXPECT_FALSE(Transform::transpose(-40).apply(rom));
+  EXPECT_EQ(notes(town.pattern(0), Channel::Pulse1),
+            Pattern::parse_notes("A3.4 C4"));
+}
+
+TEST(TransformTest, TitleLUT) {
+  FakeRom rom;
+  Song& title = rom.song(Rom::SongTitle::TitleIntro);
+  title.add_pattern({0x00, Pattern::parse_notes("C7.8 r"), {}, {}, {}});
+  Song& town = rom.song(Rom::SongTitle::TownTheme);
+  town.add_pattern({0x18, Pattern::parse_notes("A4.4"), {}, {}, {}});
+
+  // The fake title LUT goes up to C#7, and the title music can't leave it
+  EXPECT_FALSE(Transform::transpose(2).apply(rom));
+  EXPECT_EQ(notes(title.pattern(0), Channel::Pulse1),
+            Pattern::parse_notes("C7.8 r"));
+  EXPECT_EQ(notes(town.pattern(0), Channel::Pulse1),
+            Pattern::parse_notes("A4.4"));
+
+  EXPECT_TRUE(Transform::transpose(1).apply(rom));
+  EXPECT_EQ(notes(title.pattern(0), Channel::Pulse1),
+            Pattern::parse_notes("C#7.8 r"));
+  EXPECT_EQ(notes(town.pattern(0), Channel::Pulse1),
+            Pattern::parse_notes("A#4.4"));
+}
+
+}  // namespace
+}  // namespace z2music